@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2026 Red Hat, Inc.
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+// Parses the modules.yaml of several large generated modular repos one after another and
+// with ModuleMetadata::parseFiles().
+//
+// usage: benchmark_modulemd [repos [modules [rounds]]]
+
+#include "libdnf/hy-iutil-private.hpp"
+#include "libdnf/module/modulemd/ModuleMetadata.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#define BENCHMARK_DIR "/tmp/libdnfbenchXXXXXX"
+
+static constexpr int STREAMS = 4;
+static constexpr int RPMS = 20;
+
+static void
+writeModulesYaml(const std::string & path, int repo, int modules)
+{
+    std::ofstream out(path);
+    for (int module = 0; module < modules; ++module) {
+        for (int stream = 0; stream < STREAMS; ++stream) {
+            out << "---\n"
+                << "document: modulemd\n"
+                << "version: 2\n"
+                << "data:\n"
+                << "  name: module" << module << "\n"
+                << "  stream: stream" << stream << "\n"
+                << "  version: " << repo + 1 << "\n"
+                << "  context: c0ffee42\n"
+                << "  arch: x86_64\n"
+                << "  summary: Module " << module << "\n"
+                << "  description: Stream " << stream << " of module " << module << "\n"
+                << "  license:\n"
+                << "    module: [MIT]\n"
+                << "  dependencies:\n"
+                << "  - buildrequires:\n"
+                << "      platform: [f" << 30 + repo << "]\n"
+                << "    requires:\n"
+                << "      platform: [f" << 30 + repo << "]\n"
+                << "  profiles:\n"
+                << "    default:\n"
+                << "      rpms: [pkg" << module << "]\n"
+                << "  artifacts:\n"
+                << "    rpms:\n";
+            for (int rpm = 0; rpm < RPMS; ++rpm) {
+                out << "    - pkg" << module << "-sub" << rpm << "-0:" << stream << ".0-1.module_"
+                    << repo << ".x86_64\n";
+            }
+            out << "...\n";
+        }
+    }
+}
+
+static double
+millisecondsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int
+main(int argc, char * argv[])
+{
+    int repos = argc > 1 ? atoi(argv[1]) : 8;
+    int modules = argc > 2 ? atoi(argv[2]) : 500;
+    int rounds = argc > 3 ? atoi(argv[3]) : 5;
+    if (repos <= 0 || modules <= 0 || rounds <= 0) {
+        std::cerr << "usage: " << argv[0] << " [repos [modules [rounds]]]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    char tmpdir[] = BENCHMARK_DIR;
+    if (!mkdtemp(tmpdir)) {
+        std::cerr << "cannot create " << BENCHMARK_DIR << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::vector<std::string> paths;
+    for (int repo = 0; repo < repos; ++repo) {
+        paths.push_back(std::string(tmpdir) + "/repo" + std::to_string(repo) + "-modules.yaml");
+        writeModulesYaml(paths.back(), repo, modules);
+    }
+
+    // the best round of each, the first rounds warm up the page cache
+    double serialBest = 0;
+    double parallelBest = 0;
+    for (int round = 0; round < rounds; ++round) {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<libdnf::ModuleMetadata::IndexPtr> serial;
+        for (const auto & path : paths)
+            serial.emplace_back(libdnf::ModuleMetadata::parseFile(path), g_object_unref);
+        double serialTime = millisecondsSince(start);
+
+        start = std::chrono::steady_clock::now();
+        auto parallel = libdnf::ModuleMetadata::parseFiles(paths);
+        double parallelTime = millisecondsSince(start);
+
+        if (round == 0 || serialTime < serialBest)
+            serialBest = serialTime;
+        if (round == 0 || parallelTime < parallelBest)
+            parallelBest = parallelTime;
+    }
+
+    std::cout << repos << " repos of " << modules * STREAMS << " streams: serial " << serialBest
+              << " ms, parseFiles " << parallelBest << " ms" << std::endl;
+
+    g_autoptr(GError) error = nullptr;
+    if (!dnf_remove_recursive_v2(tmpdir, &error)) {
+        std::cerr << "cannot remove " << tmpdir << ": " << error->message << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2026 Red Hat, Inc.
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+// Times the NEVRA and reldep parsers against the regular expressions they replaced.
+//
+// usage: benchmark_parsers [rounds]
+
+#include "tests/libdnf/sack/ParserReference.hpp"
+
+#include "libdnf/repo/DependencySplitter.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+static const char * const NEVRAS[]{
+    "kernel-core-5.14.0-70.13.1.el9_0.x86_64", "python3-libdnf-1:0.67.0-3.fc36.noarch"};
+static const char * const RELDEPS[]{"glibc >= 2.34", "pkgconfig(gio-2.0) = 2.70"};
+
+static long
+nanosecondsPerRound(std::chrono::steady_clock::time_point start, int rounds)
+{
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / rounds;
+}
+
+int
+main(int argc, char * argv[])
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : 100000;
+    if (rounds <= 0) {
+        std::cerr << "usage: " << argv[0] << " [rounds]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    int matched = 0;
+    libdnf::Nevra nevra;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; ++i)
+        matched += referenceNevra(NEVRAS[i % 2], HY_FORM_NEVRA, nevra);
+    auto nevraRegexTime = nanosecondsPerRound(start, rounds);
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; ++i)
+        matched += nevra.parse(NEVRAS[i % 2], HY_FORM_NEVRA);
+    auto nevraTime = nanosecondsPerRound(start, rounds);
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; ++i)
+        matched += referenceReldep(RELDEPS[i % 2]).parsed;
+    auto reldepRegexTime = nanosecondsPerRound(start, rounds);
+    libdnf::DependencySplitter splitter;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; ++i)
+        matched += splitter.parse(RELDEPS[i % 2]);
+    auto reldepTime = nanosecondsPerRound(start, rounds);
+
+    // every input is valid, a miss means the timed code is broken
+    if (matched != 4 * rounds) {
+        std::cerr << "only " << matched << " of " << 4 * rounds << " parses matched" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "parsing NEVRA: regex " << nevraRegexTime << " ns, parser " << nevraTime
+              << " ns; reldep: regex " << reldepRegexTime << " ns, parser " << reldepTime << " ns"
+              << std::endl;
+    return EXIT_SUCCESS;
+}
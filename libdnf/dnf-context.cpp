@@ -1807,31 +1807,47 @@ dnf_context_setup_sack_with_flags(DnfContext               *context,
     dnf_sack_set_installonly(priv->sack, dnf_context_get_installonly_pkgs(context));
     dnf_sack_set_installonly_limit(priv->sack, dnf_context_get_installonly_limit(context));
 
-    /* add installed packages */
     const gboolean skip_rpmdb = ((flags & DNF_CONTEXT_SETUP_SACK_FLAG_SKIP_RPMDB) > 0);
-    if (!skip_rpmdb && have_existing_install(context)) {
-        if (!dnf_sack_load_system_repo(priv->sack,
-                                       nullptr,
-                                       DNF_SACK_LOAD_FLAG_NONE,
-                                       error))
-            return FALSE;
-    }
-
+    const gboolean load_rpmdb = !skip_rpmdb && have_existing_install(context);
     DnfSackAddFlags add_flags = DNF_SACK_ADD_FLAG_NONE;
     if ((flags & DNF_CONTEXT_SETUP_SACK_FLAG_LOAD_UPDATEINFO) > 0)
         add_flags = static_cast<DnfSackAddFlags>(add_flags | DNF_SACK_ADD_FLAG_UPDATEINFO);
     if (priv->enable_filelists && !((flags & DNF_CONTEXT_SETUP_SACK_FLAG_SKIP_FILELISTS) > 0))
         add_flags = static_cast<DnfSackAddFlags>(add_flags | DNF_SACK_ADD_FLAG_FILELISTS);
+    if ((flags & DNF_CONTEXT_SETUP_SACK_FLAG_LAZY_FILELISTS) > 0)
+        add_flags = static_cast<DnfSackAddFlags>(add_flags | DNF_SACK_ADD_FLAG_LAZY_EXTENSIONS);
+
+    if ((flags & DNF_CONTEXT_SETUP_SACK_FLAG_USE_SNAPSHOT) > 0) {
+        /* add installed packages and remote */
+        ret = dnf_sack_add_repos_snapshot(priv->sack,
+                                          priv->repos,
+                                          priv->cache_age,
+                                          add_flags,
+                                          load_rpmdb,
+                                          state,
+                                          error);
+        if (!ret)
+            return FALSE;
+    } else {
+        /* add installed packages */
+        if (load_rpmdb) {
+            if (!dnf_sack_load_system_repo(priv->sack,
+                                           nullptr,
+                                           DNF_SACK_LOAD_FLAG_NONE,
+                                           error))
+                return FALSE;
+        }
 
-    /* add remote */
-    ret = dnf_sack_add_repos(priv->sack,
-                             priv->repos,
-                             priv->cache_age,
-                             add_flags,
-                             state,
-                             error);
-    if (!ret)
-        return FALSE;
+        /* add remote */
+        ret = dnf_sack_add_repos(priv->sack,
+                                 priv->repos,
+                                 priv->cache_age,
+                                 add_flags,
+                                 state,
+                                 error);
+        if (!ret)
+            return FALSE;
+    }
 
     DnfSack *sack = priv->sack;
     if (sack != nullptr) {
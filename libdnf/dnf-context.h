@@ -91,6 +91,8 @@ typedef enum {
  * @DNF_CONTEXT_SETUP_SACK_FLAG_SKIP_RPMDB:       Don't load system's rpmdb
  * @DNF_CONTEXT_SETUP_SACK_FLAG_SKIP_FILELISTS:   Don't load filelists
  * @DNF_CONTEXT_SETUP_SACK_FLAG_LOAD_UPDATEINFO:  Load updateinfo if available
+ * @DNF_CONTEXT_SETUP_SACK_FLAG_LAZY_FILELISTS:   Load filelists only when first needed
+ * @DNF_CONTEXT_SETUP_SACK_FLAG_USE_SNAPSHOT:     Restore the repos from a snapshot of the last unchanged sack
  *
  * The sack setup flags.
  *
@@ -101,6 +103,8 @@ typedef enum {
         DNF_CONTEXT_SETUP_SACK_FLAG_SKIP_RPMDB      = (1 << 1),
         DNF_CONTEXT_SETUP_SACK_FLAG_SKIP_FILELISTS  = (1 << 2),
         DNF_CONTEXT_SETUP_SACK_FLAG_LOAD_UPDATEINFO = (1 << 3),
+        DNF_CONTEXT_SETUP_SACK_FLAG_LAZY_FILELISTS  = (1 << 4),
+        DNF_CONTEXT_SETUP_SACK_FLAG_USE_SNAPSHOT    = (1 << 5),
 } DnfContextSetupSackFlags;
 
 gboolean         dnf_context_globals_init               (GError **error);
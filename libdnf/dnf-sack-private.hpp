@@ -23,6 +23,9 @@
 
 #include <stdio.h>
 #include <solv/pool.h>
+#include <map>
+#include <memory>
+#include <string>
 #include <vector>
 
 #include "dnf-sack.h"
@@ -62,9 +65,56 @@ libdnf::PackageSet *dnf_sack_get_pkg_solvables(DnfSack *sack);
 libdnf::ModulePackageContainer * dnf_sack_set_module_container(
     DnfSack *sack, libdnf::ModulePackageContainer * newConteiner);
 libdnf::ModulePackageContainer * dnf_sack_get_module_container(DnfSack *sack);
+
+namespace libdnf {
+
+/// Memo of Query::filterUnneeded() and Query::filterSafeToRemove()
+struct UnneededCache {
+    /// State of the sack and of the history the results belong to
+    std::string key;
+    /// Installed packages which the history does not mark as dependencies
+    std::unique_ptr<PackageSet> userInstalled;
+    /// Unneeded packages by the user installed packages taken out, no package for filterUnneeded()
+    std::map<std::vector<Id>, std::unique_ptr<PackageSet>> unneeded;
+};
+
+}
+
+libdnf::UnneededCache & dnf_sack_get_unneeded_cache(DnfSack *sack);
 void         dnf_sack_make_provides_ready   (DnfSack    *sack);
+guint        dnf_sack_get_provides_generation (DnfSack  *sack);
+void         dnf_sack_prepare_concurrent_solves (DnfSack *sack);
+void         dnf_sack_prepare_whatprovides  (DnfSack    *sack,
+                                             Id          dep);
+std::string  dnf_sack_rpmdb_stamp           (DnfSack    *sack);
+void         dnf_sack_snapshot_key          (DnfSack    *sack,
+                                             const std::vector<HyRepo> & hrepos,
+                                             gboolean    system_repo,
+                                             int         flags,
+                                             unsigned char *key);
+gboolean     dnf_sack_write_snapshot        (DnfSack    *sack,
+                                             const unsigned char *key,
+                                             GError    **error);
+gboolean     dnf_sack_load_snapshot         (DnfSack    *sack,
+                                             const std::vector<HyRepo> & hrepos,
+                                             gboolean    system_repo,
+                                             const unsigned char *key);
+gboolean     dnf_sack_add_repos_snapshot    (DnfSack    *sack,
+                                             GPtrArray  *repos,
+                                             guint       permissible_cache_age,
+                                             DnfSackAddFlags flags,
+                                             gboolean    load_system_repo,
+                                             DnfState   *state,
+                                             GError    **error);
+int          dnf_sack_get_lazy_extensions   (DnfSack    *sack);
+gboolean     dnf_sack_load_lazy_extensions  (DnfSack    *sack,
+                                             int         flags,
+                                             Repo       *repo,
+                                             GError    **error);
 Id           dnf_sack_running_kernel        (DnfSack    *sack);
 void         dnf_sack_recompute_considered_map  (DnfSack * sack, Map ** considered, libdnf::Query::ExcludeFlags flags);
+const Map   *dnf_sack_get_considered_map    (DnfSack    *sack,
+                                             libdnf::Query::ExcludeFlags flags);
 void         dnf_sack_recompute_considered  (DnfSack    *sack);
 Id           dnf_sack_last_solvable         (DnfSack    *sack);
 const char * dnf_sack_get_arch              (DnfSack    *sack);
@@ -75,9 +125,31 @@ void         dnf_sack_set_running_kernel_fn (DnfSack    *sack,
                                              dnf_sack_running_kernel_fn_t fn);
 DnfPackage  *dnf_sack_add_cmdline_package_flags   (DnfSack *sack,
                             const char *fn, const int flags);
+
+namespace libdnf {
+
+/// Duration and size of one phase of module filtering
+struct ModuleFilteringPhase {
+    /// load_metadata, add_platform, defaults, obsoletes, resolve, collect_artifacts or exclude_queries
+    std::string name;
+    double seconds;
+    /// number of module packages, platform solvables, active modules, artifacts or excluded packages,
+    /// 0 for defaults and obsoletes
+    std::size_t count;
+};
+
+}
+
+/**
+ * @brief Filter the packages of the sack by the active modules.
+ *
+ * @param phases if not nullptr, the phases of the filtering are measured, logged at debug level and
+ *        appended to it
+ */
 std::pair<std::vector<std::vector<std::string>>, libdnf::ModulePackageContainer::ModuleErrorType> dnf_sack_filter_modules_v2(
     DnfSack *sack, libdnf::ModulePackageContainer * moduleContainer, const char ** hotfixRepos,
-    const char *install_root, const char * platformModule, bool updateOnly, bool debugSolver, bool applyObsoletes);
+    const char *install_root, const char * platformModule, bool updateOnly, bool debugSolver, bool applyObsoletes,
+    std::vector<libdnf::ModuleFilteringPhase> * phases = nullptr);
 
 std::vector<libdnf::ModulePackage *> requiresModuleEnablement(DnfSack * sack, const libdnf::PackageSet * installSet);
 
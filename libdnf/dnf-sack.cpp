@@ -33,13 +33,19 @@
 
 
 #include <algorithm>
+#include <array>
+#include <chrono>
 #include <assert.h>
 #include <errno.h>
 #include <functional>
+#include <limits.h>
 #include <unistd.h>
+#include <sys/stat.h>
 #include <iostream>
 #include <list>
 #include <set>
+#include <unordered_map>
+#include <unordered_set>
 
 extern "C" {
 #include <solv/evr.h>
@@ -57,6 +63,8 @@ extern "C" {
 #include <solv/solver.h>
 }
 
+#include <rpm/rpmmacro.h>
+
 #include <cstring>
 #include <sstream>
 
@@ -66,13 +74,16 @@ extern "C" {
 #include "dnf-package.h"
 #include "hy-iutil-private.hpp"
 #include "hy-query.h"
+#include "hy-query-private.hpp"
 #include "hy-repo-private.hpp"
 #include "dnf-sack-private.hpp"
 #include "hy-util.h"
 
 #include "utils/bgettext/bgettext-lib.h"
 
+#include "sack/cachewriter.hpp"
 #include "sack/query.hpp"
+#include "sack/subjectmatcher.hpp"
 #include "nevra.hpp"
 #include "conf/ConfigParser.hpp"
 #include "conf/OptionBool.hpp"
@@ -89,6 +100,10 @@ extern "C" {
 #define DEFAULT_CACHE_ROOT "/var/cache/hawkey"
 #define DEFAULT_CACHE_USER "/var/tmp/hawkey"
 
+/* number of Query::ExcludeFlags combinations with a cached considered map */
+static constexpr int CONSIDERED_VARIANTS =
+    static_cast<int>(libdnf::Query::ExcludeFlags::IGNORE_EXCLUDES) + 1;
+
 typedef struct
 {
     Id                   running_kernel_id;
@@ -102,16 +117,21 @@ typedef struct
     Pool                *pool;
     Queue                installonly;
     Repo                *cmdline_repo;
-    gboolean             considered_uptodate;
+    int                  considered_uptodate;   /* bit per Query::ExcludeFlags with an up to date map */
     gboolean             have_set_arch;
     gboolean             all_arch;
     gboolean             provides_ready;
+    guint                provides_generation;   /* bumped whenever the provides are recreated */
     gboolean             allow_vendor_change;
+    int                  lazy_ext_flags;    /* DNF_SACK_LOAD_FLAG_USE_* registered for lazy loading */
     gchar               *cache_dir;
     char                *arch;
     dnf_sack_running_kernel_fn_t  running_kernel_fn;
     guint                installonly_limit;
     libdnf::ModulePackageContainer * moduleContainer;
+    Map                 *considered_maps[CONSIDERED_VARIANTS]; /* by Query::ExcludeFlags, [0] is pool->considered */
+    libdnf::CacheWriter *cache_writer;
+    libdnf::UnneededCache *unneeded_cache;
 } DnfSackPrivate;
 
 G_DEFINE_TYPE_WITH_PRIVATE(DnfSack, dnf_sack, G_TYPE_OBJECT)
@@ -136,6 +156,9 @@ dnf_sack_finalize(GObject *object)
             continue;
         libdnf::repoGetImpl(hrepo)->detachLibsolvRepo();
     }
+    /* waits for the caches still being written */
+    delete priv->cache_writer;
+    delete priv->unneeded_cache;
     g_free(priv->cache_dir);
     g_free(priv->arch);
     queue_free(&priv->installonly);
@@ -146,6 +169,8 @@ dnf_sack_finalize(GObject *object)
     free_map_fully(priv->module_excludes);
     free_map_fully(priv->module_includes);
     free_map_fully(pool->considered);
+    for (auto considered : priv->considered_maps)
+        free_map_fully(considered);
     free_map_fully(priv->pkg_solvables);
     pool_free(priv->pool);
     if (priv->moduleContainer) {
@@ -187,9 +212,10 @@ dnf_sack_init(DnfSack *sack)
     pool_set_flag(priv->pool, POOL_FLAG_WHATPROVIDESWITHDISABLED, 1);
     priv->running_kernel_id = -1;
     priv->running_kernel_fn = running_kernel;
-    priv->considered_uptodate = TRUE;
+    priv->considered_uptodate = 1;      /* without excludes a NULL pool->considered is valid */
     priv->cmdline_repo = NULL;
     priv->allow_vendor_change = TRUE;
+    priv->cache_writer = new libdnf::CacheWriter;
     queue_init(&priv->installonly);
 
     /* logging up after this*/
@@ -224,6 +250,75 @@ dnf_sack_new(void)
     return DNF_SACK(g_object_new(DNF_TYPE_SACK, NULL));
 }
 
+// Compute the checksum that validates a solv cache built from the given metadata types. Only
+// the repomd records of these types are covered, so the cache stays valid when other
+// metadata of the repo change. Falls back to the checksum of the whole repomd.xml.
+static void
+cache_checksum(HyRepo hrepo, std::initializer_list<const char *> md_types, unsigned char *out)
+{
+    auto repoImpl = libdnf::repoGetImpl(hrepo);
+    std::vector<std::string> parts;
+    for (auto md_type : md_types) {
+        auto it = repoImpl->metadataChecksums.find(md_type);
+        if (it == repoImpl->metadataChecksums.end()) {
+            memcpy(out, repoImpl->checksum, CHKSUM_BYTES);
+            return;
+        }
+        parts.emplace_back(md_type);
+        parts.push_back(it->second);
+    }
+    checksum_strings(out, parts);
+}
+
+// The main solv only depends on primary, extensions extend its solvables in order and so
+// depend on both primary and their own metadata. Updateinfo adds separate solvables.
+static void
+ext_cache_checksum(HyRepo hrepo, _hy_repo_repodata which_repodata, unsigned char *out)
+{
+    switch (which_repodata) {
+        case _HY_REPODATA_FILENAMES:
+            cache_checksum(hrepo, {MD_TYPE_PRIMARY, MD_TYPE_FILELISTS}, out);
+            break;
+        case _HY_REPODATA_OTHER:
+            cache_checksum(hrepo, {MD_TYPE_PRIMARY, MD_TYPE_OTHER}, out);
+            break;
+        case _HY_REPODATA_PRESTO:
+            cache_checksum(hrepo, {MD_TYPE_PRIMARY, MD_TYPE_PRESTODELTA}, out);
+            break;
+        case _HY_REPODATA_UPDATEINFO:
+            cache_checksum(hrepo, {MD_TYPE_UPDATEINFO}, out);
+            break;
+        default:
+            assert(0);
+            memcpy(out, libdnf::repoGetImpl(hrepo)->checksum, CHKSUM_BYTES);
+    }
+}
+
+// Store the checksums of the single records of repomd.xml, calls rewind(fp) before returning
+static void
+read_repomd_checksums(HyRepo hrepo, FILE *fp)
+{
+    auto repoImpl = libdnf::repoGetImpl(hrepo);
+    g_autoptr(GError) err = NULL;
+    LrYumRepoMd *repomd = lr_yum_repomd_init();
+
+    repoImpl->metadataChecksums.clear();
+    rewind(fp);
+    if (lr_yum_repomd_parse_file(repomd, fileno(fp), NULL, NULL, &err)) {
+        for (auto elem = repomd->records; elem; elem = g_slist_next(elem)) {
+            auto record = static_cast<LrYumRepoMdRecord *>(elem->data);
+            if (!record->type || !record->checksum)
+                continue;
+            std::string value(record->checksum_type ? record->checksum_type : "");
+            repoImpl->metadataChecksums[record->type] = value + ":" + record->checksum;
+        }
+    } else {
+        g_debug("Cannot parse records of %s: %s", repoImpl->repomdFn.c_str(), err->message);
+    }
+    lr_yum_repomd_free(repomd);
+    rewind(fp);
+}
+
 // Try to load cached solv file into repo otherwise return FALSE
 static gboolean
 try_to_use_cached_solvfile(const char *path, Repo *repo, int flags, const unsigned char *checksum, GError **err){
@@ -309,6 +404,24 @@ dnf_sack_last_solvable(DnfSack *sack)
     return dnf_sack_get_pool(sack)->nsolvables - 1;
 }
 
+// set the bits of [start, end) using whole bytes where possible
+static void
+map_set_range(Map *m, Id start, Id end)
+{
+    for (; start < end && (start & 7); ++start)
+        MAPSET(m, start);
+    for (; end > start && (end & 7); --end)
+        MAPSET(m, end - 1);
+    if (start < end)
+        memset(m->map + (start >> 3), 0xff, (end - start) >> 3);
+}
+
+static inline bool
+map_contains(const Map *m, Id p)
+{
+    return m && p < (m->size << 3) && MAPTST(m, p);
+}
+
 void
 dnf_sack_recompute_considered_map(DnfSack * sack, Map ** considered, libdnf::Query::ExcludeFlags flags)
 {
@@ -349,10 +462,15 @@ dnf_sack_recompute_considered_map(DnfSack * sack, Map ** considered, libdnf::Que
             FOR_REPOS(repoid, repo) {
                 auto hyrepo = static_cast<HyRepo>(repo->appdata);
                 if (!hyrepo->getUseIncludes()) {
-                    Id solvableid;
-                    Solvable *solvable;
-                    FOR_REPO_SOLVABLES(repo, solvableid, solvable)
-                        MAPSET(&pkg_includes_tmp, solvableid);
+                    if (repo->end - repo->start == repo->nsolvables) {
+                        // the solvables of the repo are contiguous
+                        map_set_range(&pkg_includes_tmp, repo->start, repo->end);
+                    } else {
+                        Id solvableid;
+                        Solvable *solvable;
+                        FOR_REPO_SOLVABLES(repo, solvableid, solvable)
+                            MAPSET(&pkg_includes_tmp, solvableid);
+                    }
                 }
             }
 
@@ -362,6 +480,99 @@ dnf_sack_recompute_considered_map(DnfSack * sack, Map ** considered, libdnf::Que
     }
 }
 
+// whether the solvable is considered by the map of the given ExcludeFlags
+static bool
+is_considered(DnfSackPrivate *priv, int flags, Id p)
+{
+    if (!(flags & static_cast<int>(libdnf::Query::ExcludeFlags::IGNORE_MODULAR_EXCLUDES)) &&
+        map_contains(priv->module_excludes, p))
+        return false;
+    if (flags & static_cast<int>(libdnf::Query::ExcludeFlags::IGNORE_REGULAR_EXCLUDES))
+        return true;
+    if (map_contains(priv->repo_excludes, p) || map_contains(priv->pkg_excludes, p))
+        return false;
+    if (priv->pkg_includes && !map_contains(priv->pkg_includes, p)) {
+        Repo *repo = pool_id2solvable(priv->pool, p)->repo;
+        auto hyrepo = repo ? static_cast<HyRepo>(repo->appdata) : nullptr;
+        return hyrepo && !hyrepo->getUseIncludes();
+    }
+    return true;
+}
+
+static Map **
+considered_map_ptr(DnfSackPrivate *priv, int flags)
+{
+    return flags ? &priv->considered_maps[flags] : &priv->pool->considered;
+}
+
+// Update the up to date considered maps for the solvables in changed, whose exclude or include
+// state has changed. The maps of all other solvables stay valid.
+static void
+considered_update(DnfSackPrivate *priv, const Map *changed)
+{
+    for (int flags = 0; flags < CONSIDERED_VARIANTS; ++flags) {
+        if (!(priv->considered_uptodate & (1 << flags)))
+            continue;
+        Map *considered = *considered_map_ptr(priv, flags);
+        if (!considered || (considered->size << 3) < priv->pool->nsolvables) {
+            // the map is created or grown by the full computation
+            priv->considered_uptodate &= ~(1 << flags);
+            continue;
+        }
+        int size = std::min(changed->size, considered->size);
+        for (int i = 0; i < size; ++i) {
+            if (!changed->map[i])
+                continue;
+            for (Id p = i << 3; p < (i + 1) << 3; ++p) {
+                if (!MAPTST(changed, p))
+                    continue;
+                if (is_considered(priv, flags, p))
+                    MAPSET(considered, p);
+                else
+                    MAPCLR(considered, p);
+            }
+        }
+    }
+}
+
+// update the considered maps for all solvables of the repo
+static void
+considered_update_repo(DnfSackPrivate *priv, Repo *repo)
+{
+    Map changed;
+    map_init(&changed, priv->pool->nsolvables);
+    if (repo->end - repo->start == repo->nsolvables) {
+        map_set_range(&changed, repo->start, repo->end);
+    } else {
+        Id p;
+        Solvable *s;
+        FOR_REPO_SOLVABLES(repo, p, s)
+            MAPSET(&changed, p);
+    }
+    considered_update(priv, &changed);
+    map_free(&changed);
+}
+
+/**
+ * dnf_sack_get_considered_map:
+ *
+ * Returns the map of the solvables considered with the given flags, it is kept
+ * up to date by the sack. %NULL means all solvables are considered.
+ */
+const Map *
+dnf_sack_get_considered_map(DnfSack *sack, libdnf::Query::ExcludeFlags flags)
+{
+    DnfSackPrivate *priv = GET_PRIVATE(sack);
+    int variant = static_cast<int>(flags);
+    Map **considered = considered_map_ptr(priv, variant);
+
+    if (!(priv->considered_uptodate & (1 << variant))) {
+        dnf_sack_recompute_considered_map(sack, considered, flags);
+        priv->considered_uptodate |= 1 << variant;
+    }
+    return *considered;
+}
+
 /**
  * dnf_sack_recompute_considered:
  * @sack: a #DnfSack instance.
@@ -373,13 +584,7 @@ dnf_sack_recompute_considered_map(DnfSack * sack, Map ** considered, libdnf::Que
 void
 dnf_sack_recompute_considered(DnfSack *sack)
 {
-    DnfSackPrivate *priv = GET_PRIVATE(sack);
-    Pool *pool = dnf_sack_get_pool(sack);
-    if (priv->considered_uptodate)
-        return;
-    dnf_sack_recompute_considered_map(
-        sack, &pool->considered, libdnf::Query::ExcludeFlags::APPLY_EXCLUDES);
-    priv->considered_uptodate = TRUE;
+    dnf_sack_get_considered_map(sack, libdnf::Query::ExcludeFlags::APPLY_EXCLUDES);
 }
 
 static gboolean
@@ -396,7 +601,8 @@ load_ext(DnfSack *sack, HyRepo hrepo, _hy_repo_repodata which_repodata,
     gboolean done = FALSE;
 
     char *fn_cache =  dnf_sack_give_cache_fn(sack, name, suffix);
-    assert(libdnf::repoGetImpl(hrepo)->checksum);
+    unsigned char checksum[CHKSUM_BYTES];
+    ext_cache_checksum(hrepo, which_repodata, checksum);
 
     int flags = 0;
     /* the updateinfo is not a real extension */
@@ -405,7 +611,7 @@ load_ext(DnfSack *sack, HyRepo hrepo, _hy_repo_repodata which_repodata,
     /* do not pollute the main pool with directory component ids */
     if (which_repodata == _HY_REPODATA_FILENAMES || which_repodata == _HY_REPODATA_OTHER)
         flags |= REPO_LOCALPOOL;
-    if (try_to_use_cached_solvfile(fn_cache, repo, flags, libdnf::repoGetImpl(hrepo)->checksum, error)) {
+    if (try_to_use_cached_solvfile(fn_cache, repo, flags, checksum, error)) {
         g_debug("%s: using cache file: %s", __func__, fn_cache);
         done = TRUE;
         repo_update_state(hrepo, which_repodata, _HY_LOADED_CACHE);
@@ -501,7 +707,9 @@ write_main(DnfSack *sack, HyRepo hrepo, int switchtosolv, GError **error)
     auto repoImpl = libdnf::repoGetImpl(hrepo);
     Repo *repo = repoImpl->libsolvRepo;
     const char *name = repo->name;
-    const char *chksum = pool_checksum_str(dnf_sack_get_pool(sack), repoImpl->checksum);
+    unsigned char checksum[CHKSUM_BYTES];
+    cache_checksum(hrepo, {MD_TYPE_PRIMARY}, checksum);
+    const char *chksum = pool_checksum_str(dnf_sack_get_pool(sack), checksum);
     char *fn = dnf_sack_give_cache_fn(sack, name, NULL);
     char *tmp_fn_templ = solv_dupjoin(fn, ".XXXXXX", NULL);
     int tmp_fd  = mkstemp(tmp_fn_templ);
@@ -531,7 +739,7 @@ write_main(DnfSack *sack, HyRepo hrepo, int switchtosolv, GError **error)
         }
 
         SolvUserdata solv_userdata;
-        if (solv_userdata_fill(&solv_userdata, repoImpl->checksum, error)) {
+        if (solv_userdata_fill(&solv_userdata, checksum, error)) {
             ret = FALSE;
             fclose(fp);
             goto done;
@@ -565,7 +773,7 @@ write_main(DnfSack *sack, HyRepo hrepo, int switchtosolv, GError **error)
     if (switchtosolv && repo_is_one_piece(repo)) {
         repo_empty(repo, 1);
         /* switch over to written solv file activate paging */
-        gboolean loaded = try_to_use_cached_solvfile(tmp_fn_templ, repo, 0, repoImpl->checksum, error);
+        gboolean loaded = try_to_use_cached_solvfile(tmp_fn_templ, repo, 0, checksum, error);
         if (error && *error) {
             g_prefix_error(error, _("Failed to use newly written primary cache: %s: "), tmp_fn_templ);
             ret = FALSE;
@@ -579,7 +787,7 @@ write_main(DnfSack *sack, HyRepo hrepo, int switchtosolv, GError **error)
         }
     }
 
-    ret = mv(tmp_fn_templ, fn, error);
+    ret = GET_PRIVATE(sack)->cache_writer->commit(tmp_fn_templ, fn, error);
     if (!ret)
         goto done;
     repoImpl->state_main = _HY_WRITTEN;
@@ -617,6 +825,8 @@ write_ext(DnfSack *sack, HyRepo hrepo, _hy_repo_repodata which_repodata,
     char *fn = dnf_sack_give_cache_fn(sack, name, suffix);
     char *tmp_fn_templ = solv_dupjoin(fn, ".XXXXXX", NULL);
     int tmp_fd = mkstemp(tmp_fn_templ);
+    unsigned char checksum[CHKSUM_BYTES];
+    ext_cache_checksum(hrepo, which_repodata, checksum);
     gboolean success;
     if (tmp_fd < 0) {
         success = FALSE;
@@ -632,7 +842,7 @@ write_ext(DnfSack *sack, HyRepo hrepo, _hy_repo_repodata which_repodata,
         g_debug("%s: storing %s to: %s", __func__, repo->name, tmp_fn_templ);
 
         SolvUserdata solv_userdata;
-        if (solv_userdata_fill(&solv_userdata, repoImpl->checksum, error)) {
+        if (solv_userdata_fill(&solv_userdata, checksum, error)) {
             fclose(fp);
             success = FALSE;
             goto done;
@@ -687,7 +897,7 @@ write_ext(DnfSack *sack, HyRepo hrepo, _hy_repo_repodata which_repodata,
             flags |= REPO_LOCALPOOL;
         repodata_extend_block(data, repo->start, repo->end - repo->start);
         data->state = REPODATA_LOADING;
-        int loaded = try_to_use_cached_solvfile(tmp_fn_templ, repo, flags, repoImpl->checksum, error);
+        int loaded = try_to_use_cached_solvfile(tmp_fn_templ, repo, flags, checksum, error);
         if (error && *error) {
             g_prefix_error(error, _("Failed to use newly written extension cache: %s (%d): "),
                            tmp_fn_templ, which_repodata);
@@ -704,7 +914,7 @@ write_ext(DnfSack *sack, HyRepo hrepo, _hy_repo_repodata which_repodata,
         data->state = REPODATA_AVAILABLE;
     }
 
-    if (!mv(tmp_fn_templ, fn, error)) {
+    if (!GET_PRIVATE(sack)->cache_writer->commit(tmp_fn_templ, fn, error)) {
         success = FALSE;
         goto done;
     }
@@ -718,6 +928,165 @@ write_ext(DnfSack *sack, HyRepo hrepo, _hy_repo_repodata which_repodata,
     return success;
 }
 
+static gboolean
+load_and_write_ext(DnfSack *sack, HyRepo hrepo, _hy_repo_repodata which_repodata,
+                   const char *suffix, const char *which_filename,
+                   int (*cb)(Repo *, FILE *), GError **error)
+{
+    auto repoImpl = libdnf::repoGetImpl(hrepo);
+    GError *error_local = NULL;
+
+    if (!load_ext(sack, hrepo, which_repodata, suffix, which_filename, cb, &error_local)) {
+        /* allow missing files */
+        if (!g_error_matches(error_local, DNF_ERROR, DNF_ERROR_NO_CAPABILITY)) {
+            g_propagate_error(error, error_local);
+            return FALSE;
+        }
+        g_debug("no %s metadata available for %s", which_filename,
+                repoImpl->conf->name().getValue().c_str());
+        g_clear_error(&error_local);
+    }
+    if (repo_get_state(hrepo, which_repodata) == _HY_LOADED_FETCH &&
+        (repoImpl->load_flags & DNF_SACK_LOAD_FLAG_BUILD_CACHE))
+        return write_ext(sack, hrepo, which_repodata, suffix, error);
+    return TRUE;
+}
+
+static gboolean
+load_and_write_ext_by_flag(DnfSack *sack, HyRepo hrepo, int flag, GError **error)
+{
+    switch (flag) {
+        case DNF_SACK_LOAD_FLAG_USE_FILELISTS:
+            return load_and_write_ext(sack, hrepo, _HY_REPODATA_FILENAMES, HY_EXT_FILENAMES,
+                                      MD_TYPE_FILELISTS, load_filelists_cb, error);
+        case DNF_SACK_LOAD_FLAG_USE_OTHER:
+            return load_and_write_ext(sack, hrepo, _HY_REPODATA_OTHER, HY_EXT_OTHER,
+                                      MD_TYPE_OTHER, load_other_cb, error);
+        case DNF_SACK_LOAD_FLAG_USE_PRESTO:
+            return load_and_write_ext(sack, hrepo, _HY_REPODATA_PRESTO, HY_EXT_PRESTO,
+                                      MD_TYPE_PRESTODELTA, load_presto_cb, error);
+        case DNF_SACK_LOAD_FLAG_USE_UPDATEINFO:
+            return load_and_write_ext(sack, hrepo, _HY_REPODATA_UPDATEINFO, HY_EXT_UPDATEINFO,
+                                      MD_TYPE_UPDATEINFO, load_updateinfo_cb, error);
+        default:
+            assert(0);
+            return FALSE;
+    }
+}
+
+/* load the extensions of a repo that were registered with DNF_SACK_LOAD_FLAG_LAZY_EXTENSIONS,
+   fails also for extensions that failed to load before */
+static gboolean
+load_lazy_ext(DnfSack *sack, HyRepo hrepo, int flags, GError **error)
+{
+    auto repoImpl = libdnf::repoGetImpl(hrepo);
+    Repo *repo = repoImpl->libsolvRepo;
+    int pending = repoImpl->lazy_load_flags & flags;
+
+    if (!repo)
+        return TRUE;
+    if (pending) {
+        repoImpl->lazy_load_flags &= ~pending;
+
+        /* updateinfo solvables may already follow the main ones, but the extensions
+           have to cover the main solvables only. The loaders extend the existing solvables
+           and add no new ones, and the pool is not used by anything else meanwhile, so the
+           updateinfo solvables are just hidden for the duration of the load. */
+        int oldnsolvables = repo->nsolvables;
+        int oldend = repo->end;
+        repo->nsolvables = repoImpl->main_nsolvables;
+        repo->end = repoImpl->main_end;
+        for (int flag : {DNF_SACK_LOAD_FLAG_USE_FILELISTS, DNF_SACK_LOAD_FLAG_USE_OTHER,
+                         DNF_SACK_LOAD_FLAG_USE_PRESTO}) {
+            if (!(pending & flag))
+                continue;
+            g_autoptr(GError) local_error = NULL;
+            g_debug("loading deferred extension (%d) of %s", flag, repo->name);
+            if (!load_and_write_ext_by_flag(sack, hrepo, flag, &local_error)) {
+                g_warning("Loading deferred extension of %s failed: %s",
+                          repo->name, local_error->message);
+                repoImpl->lazy_load_failed |= flag;
+            }
+        }
+        repo->nsolvables = oldnsolvables;
+        repo->end = oldend;
+    }
+    if (repoImpl->lazy_load_failed & flags) {
+        g_set_error(error, DNF_ERROR, DNF_ERROR_FILE_INVALID,
+                    _("Metadata of repository %s are incomplete, deferred loading failed"),
+                    repo->name);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/**
+ * dnf_sack_get_lazy_extensions: (skip)
+ * @sack: a #DnfSack instance.
+ *
+ * Returns: the DNF_SACK_LOAD_FLAG_USE_* flags of extensions that may still wait for loading
+ *
+ * Since: 0.66.0
+ */
+int
+dnf_sack_get_lazy_extensions(DnfSack *sack)
+{
+    DnfSackPrivate *priv = GET_PRIVATE(sack);
+    return priv->lazy_ext_flags;
+}
+
+/**
+ * dnf_sack_load_lazy_extensions: (skip)
+ * @sack: a #DnfSack instance.
+ * @flags: DNF_SACK_LOAD_FLAG_USE_* flags of the extensions that are needed.
+ * @repo: a libsolv #Repo, or %NULL for all repositories.
+ *
+ * @error: a #GError or %NULL.
+ *
+ * Loads extensions registered with %DNF_SACK_LOAD_FLAG_LAZY_EXTENSIONS that were not
+ * loaded yet. An extension that fails to load stays missing, the repository is marked
+ * and every later call for it fails as well, so the callers know the data are incomplete.
+ *
+ * Returns: %FALSE if an extension of a requested repository is missing
+ *
+ * Since: 0.66.0
+ */
+gboolean
+dnf_sack_load_lazy_extensions(DnfSack *sack, int flags, Repo *repo, GError **error)
+{
+    DnfSackPrivate *priv = GET_PRIVATE(sack);
+    Pool *pool = priv->pool;
+
+    if (!(priv->lazy_ext_flags & flags))
+        return TRUE;
+    if (repo) {
+        if (auto hrepo = static_cast<HyRepo>(repo->appdata))
+            return load_lazy_ext(sack, hrepo, flags, error);
+        return TRUE;
+    }
+    gboolean ret = TRUE;
+    gboolean failed = FALSE;
+    Id repoid;
+    FOR_REPOS(repoid, repo) {
+        auto hrepo = static_cast<HyRepo>(repo->appdata);
+        if (!hrepo)
+            continue;
+        g_autoptr(GError) local_error = NULL;
+        if (!load_lazy_ext(sack, hrepo, flags, &local_error)) {
+            failed = TRUE;
+            if (ret) {
+                g_propagate_error(error, local_error);
+                local_error = NULL;
+                ret = FALSE;
+            }
+        }
+    }
+    /* the flags of failed repos stay, the next calls report them again */
+    if (!failed)
+        priv->lazy_ext_flags &= ~flags;
+    return ret;
+}
+
 static gboolean
 load_yum_repo(DnfSack *sack, HyRepo hrepo, GError **error)
 {
@@ -732,6 +1101,7 @@ load_yum_repo(DnfSack *sack, HyRepo hrepo, GError **error)
 
     FILE *fp_primary = NULL;
     FILE *fp_repomd = NULL;
+    unsigned char checksum[CHKSUM_BYTES];
 
     if (!fn_repomd) {
         g_set_error (error,
@@ -752,9 +1122,11 @@ load_yum_repo(DnfSack *sack, HyRepo hrepo, GError **error)
         goto out;
     }
     checksum_fp(repoImpl->checksum, fp_repomd);
+    read_repomd_checksums(hrepo, fp_repomd);
+    cache_checksum(hrepo, {MD_TYPE_PRIMARY}, checksum);
 
-    if (try_to_use_cached_solvfile(fn_cache, repo, 0, repoImpl->checksum, error)) {
-        const char *chksum = pool_checksum_str(pool, repoImpl->checksum);
+    if (try_to_use_cached_solvfile(fn_cache, repo, 0, checksum, error)) {
+        const char *chksum = pool_checksum_str(pool, checksum);
         g_debug("using cached %s (0x%s)", name, chksum);
         repoImpl->state_main = _HY_LOADED_CACHE;
         goto out;
@@ -989,6 +1361,60 @@ dnf_sack_set_rootdir (DnfSack *sack, const gchar *value)
         priv->running_kernel_fn = NULL;
 }
 
+/**
+ * dnf_sack_set_async_cache_writes:
+ * @sack: a #DnfSack instance.
+ * @async_writes: %TRUE to finish the solv caches in the background.
+ *
+ * Finish the written solv caches (sync and rename in place) on a worker thread,
+ * so loading and the first query do not wait for the disk. Errors of the
+ * background writes are returned by dnf_sack_wait_for_cache_writes(). The sack
+ * waits for pending writes when it is destroyed.
+ *
+ * Since: 0.66.0
+ */
+void
+dnf_sack_set_async_cache_writes(DnfSack *sack, gboolean async_writes)
+{
+    DnfSackPrivate *priv = GET_PRIVATE(sack);
+    priv->cache_writer->setAsync(async_writes);
+}
+
+/**
+ * dnf_sack_set_cache_fsync_policy:
+ * @sack: a #DnfSack instance.
+ * @policy: a #DnfSackCacheFsyncPolicy.
+ *
+ * Sets how the written solv caches are synced to the disk. The default is
+ * %DNF_SACK_CACHE_FSYNC_NONE.
+ *
+ * Since: 0.66.0
+ */
+void
+dnf_sack_set_cache_fsync_policy(DnfSack *sack, DnfSackCacheFsyncPolicy policy)
+{
+    DnfSackPrivate *priv = GET_PRIVATE(sack);
+    priv->cache_writer->setFsyncPolicy(policy);
+}
+
+/**
+ * dnf_sack_wait_for_cache_writes:
+ * @sack: a #DnfSack instance.
+ * @error: a #GError or %NULL.
+ *
+ * Waits until all solv caches written in the background are in place.
+ *
+ * Returns: %FALSE if writing of a cache failed since the last call.
+ *
+ * Since: 0.66.0
+ */
+gboolean
+dnf_sack_wait_for_cache_writes(DnfSack *sack, GError **error)
+{
+    DnfSackPrivate *priv = GET_PRIVATE(sack);
+    return priv->cache_writer->wait(error);
+}
+
 /**
  * dnf_sack_setup:
  * @sack: a #DnfSack instance.
@@ -1316,18 +1742,21 @@ dnf_sack_count(DnfSack *sack)
 static void
 dnf_sack_add_excludes_or_includes(DnfSack *sack, Map **dest, const DnfPackageSet *pkgset)
 {
+    DnfSackPrivate *priv = GET_PRIVATE(sack);
     Map *destmap = *dest;
     if (destmap == NULL) {
         destmap = static_cast<Map *>(g_malloc0(sizeof(Map)));
         Pool *pool = dnf_sack_get_pool(sack);
         map_init(destmap, pool->nsolvables);
         *dest = destmap;
+        /* the first includes exclude everything else in repos using includes */
+        if (dest == &priv->pkg_includes)
+            priv->considered_uptodate = FALSE;
     }
 
     auto pkgmap = pkgset->getMap();
     map_or(destmap, pkgmap);
-    DnfSackPrivate *priv = GET_PRIVATE(sack);
-    priv->considered_uptodate = FALSE;
+    considered_update(priv, pkgmap);
 }
 
 /**
@@ -1386,7 +1815,7 @@ dnf_sack_remove_excludes_or_includes(DnfSack *sack, Map *from, const DnfPackageS
     auto pkgmap = pkgset->getMap();
     map_subtract(from, pkgmap);
     DnfSackPrivate *priv = GET_PRIVATE(sack);
-    priv->considered_uptodate = FALSE;
+    considered_update(priv, pkgmap);
 }
 
 /**
@@ -1443,14 +1872,29 @@ dnf_sack_set_excludes_or_includes(DnfSack *sack, Map **dest, const DnfPackageSet
     if (*dest == NULL && pkgset == NULL)
         return;
 
-    *dest = free_map_fully(*dest);
+    DnfSackPrivate *priv = GET_PRIVATE(sack);
+    Map *old = *dest;
+    *dest = NULL;
     if (pkgset) {
         *dest = static_cast<Map *>(g_malloc0(sizeof(Map)));
         auto pkgmap = pkgset->getMap();
         map_init_clone(*dest, pkgmap);
     }
-    DnfSackPrivate *priv = GET_PRIVATE(sack);
-    priv->considered_uptodate = FALSE;
+    if (dest == &priv->pkg_includes && (!old || !*dest)) {
+        /* switching includes on or off changes all repos using them */
+        priv->considered_uptodate = FALSE;
+    } else {
+        /* only the solvables in the old or the new map can change */
+        Map changed;
+        map_init(&changed, priv->pool->nsolvables);
+        if (old)
+            map_or(&changed, old);
+        if (*dest)
+            map_or(&changed, *dest);
+        considered_update(priv, &changed);
+        map_free(&changed);
+    }
+    free_map_fully(old);
 }
 
 void
@@ -1646,7 +2090,8 @@ dnf_sack_set_use_includes(DnfSack *sack, const char *reponame, gboolean enabled)
         if (hyrepo->getUseIncludes() != enabled)
         {
             hyrepo->setUseIncludes(enabled);
-            priv->considered_uptodate = FALSE;
+            if (priv->pkg_includes)
+                considered_update_repo(priv, libdnf::repoGetImpl(hyrepo)->libsolvRepo);
         }
     } else {
         Id repoid;
@@ -1656,7 +2101,8 @@ dnf_sack_set_use_includes(DnfSack *sack, const char *reponame, gboolean enabled)
             if (hyrepo->getUseIncludes() != enabled)
             {
                 hyrepo->setUseIncludes(enabled);
-                priv->considered_uptodate = FALSE;
+                if (priv->pkg_includes)
+                    considered_update_repo(priv, repo);
             }
         }
     }
@@ -1754,7 +2200,7 @@ dnf_sack_repo_enabled(DnfSack *sack, const char *reponame, int enabled)
     else
         FOR_REPO_SOLVABLES(repo, p, s)
             MAPCLR(priv->repo_excludes, p);
-    priv->considered_uptodate = FALSE;
+    considered_update_repo(priv, repo);
     return 0;
 }
 
@@ -1840,9 +2286,7 @@ dnf_sack_load_repo(DnfSack *sack, HyRepo repo, int flags, GError **error) try
 {
     DnfSackPrivate *priv = GET_PRIVATE(sack);
     auto repoImpl = libdnf::repoGetImpl(repo);
-    GError *error_local = NULL;
     const int build_cache = flags & DNF_SACK_LOAD_FLAG_BUILD_CACHE;
-    gboolean retval;
     if (!load_yum_repo(sack, repo, error))
         return FALSE;
     repoImpl->load_flags = flags;
@@ -1853,92 +2297,22 @@ dnf_sack_load_repo(DnfSack *sack, HyRepo repo, int flags, GError **error) try
     repoImpl->main_nsolvables = repoImpl->libsolvRepo->nsolvables;
     repoImpl->main_nrepodata = repoImpl->libsolvRepo->nrepodata;
     repoImpl->main_end = repoImpl->libsolvRepo->end;
-    if (flags & DNF_SACK_LOAD_FLAG_USE_FILELISTS) {
-        retval = load_ext(sack, repo, _HY_REPODATA_FILENAMES,
-                          HY_EXT_FILENAMES, MD_TYPE_FILELISTS,
-                          load_filelists_cb, &error_local);
-        /* allow missing files */
-        if (!retval) {
-            if (g_error_matches (error_local,
-                                 DNF_ERROR,
-                                 DNF_ERROR_NO_CAPABILITY)) {
-                g_debug("no filelists metadata available for %s", repoImpl->conf->name().getValue().c_str());
-                g_clear_error (&error_local);
-            } else {
-                g_propagate_error (error, error_local);
-                return FALSE;
-            }
-        }
-        if (repoImpl->state_filelists == _HY_LOADED_FETCH && build_cache) {
-            if (!write_ext(sack, repo,
-                           _HY_REPODATA_FILENAMES,
-                           HY_EXT_FILENAMES, error))
-                return FALSE;
-        }
-    }
-    if (flags & DNF_SACK_LOAD_FLAG_USE_OTHER) {
-        retval = load_ext(sack, repo, _HY_REPODATA_OTHER,
-                          HY_EXT_OTHER, MD_TYPE_OTHER,
-                          load_other_cb, &error_local);
-        /* allow missing files */
-        if (!retval) {
-            if (g_error_matches (error_local,
-                                 DNF_ERROR,
-                                 DNF_ERROR_NO_CAPABILITY)) {
-                g_debug("no other metadata available for %s", repoImpl->conf->name().getValue().c_str());
-                g_clear_error (&error_local);
-            } else {
-                g_propagate_error (error, error_local);
-                return FALSE;
-            }
-        }
-        if (repoImpl->state_other == _HY_LOADED_FETCH && build_cache) {
-            if (!write_ext(sack, repo,
-                           _HY_REPODATA_OTHER,
-                           HY_EXT_OTHER, error))
-                return FALSE;
-        }
-    }
-    if (flags & DNF_SACK_LOAD_FLAG_USE_PRESTO) {
-        retval = load_ext(sack, repo, _HY_REPODATA_PRESTO,
-                          HY_EXT_PRESTO, MD_TYPE_PRESTODELTA,
-                          load_presto_cb, &error_local);
-        if (!retval) {
-            if (g_error_matches (error_local,
-                                 DNF_ERROR,
-                                 DNF_ERROR_NO_CAPABILITY)) {
-                g_debug("no presto metadata available for %s", repoImpl->conf->name().getValue().c_str());
-                g_clear_error (&error_local);
-            } else {
-                g_propagate_error (error, error_local);
-                return FALSE;
-            }
-        }
-        if (repoImpl->state_presto == _HY_LOADED_FETCH && build_cache)
-            if (!write_ext(sack, repo, _HY_REPODATA_PRESTO, HY_EXT_PRESTO, error))
-                return FALSE;
+    for (int flag : {DNF_SACK_LOAD_FLAG_USE_FILELISTS, DNF_SACK_LOAD_FLAG_USE_OTHER,
+                     DNF_SACK_LOAD_FLAG_USE_PRESTO}) {
+        if (!(flags & flag))
+            continue;
+        if (flags & DNF_SACK_LOAD_FLAG_LAZY_EXTENSIONS) {
+            /* only register the extension, it gets loaded when first needed */
+            repoImpl->lazy_load_flags |= flag;
+            priv->lazy_ext_flags |= flag;
+        } else if (!load_and_write_ext_by_flag(sack, repo, flag, error))
+            return FALSE;
     }
     /* updateinfo must come *after* all other extensions, as it is not a real
        extension, but contains a new set of packages */
     if (flags & DNF_SACK_LOAD_FLAG_USE_UPDATEINFO) {
-        retval = load_ext(sack, repo, _HY_REPODATA_UPDATEINFO,
-                          HY_EXT_UPDATEINFO, MD_TYPE_UPDATEINFO,
-                          load_updateinfo_cb, &error_local);
-        /* allow missing files */
-        if (!retval) {
-            if (g_error_matches (error_local,
-                                 DNF_ERROR,
-                                 DNF_ERROR_NO_CAPABILITY)) {
-                g_debug("no updateinfo available for %s", repoImpl->conf->name().getValue().c_str());
-                g_clear_error (&error_local);
-            } else {
-                g_propagate_error (error, error_local);
-                return FALSE;
-            }
-        }
-        if (repoImpl->state_updateinfo == _HY_LOADED_FETCH && build_cache)
-            if (!write_ext(sack, repo, _HY_REPODATA_UPDATEINFO, HY_EXT_UPDATEINFO, error))
-                return FALSE;
+        if (!load_and_write_ext_by_flag(sack, repo, DNF_SACK_LOAD_FLAG_USE_UPDATEINFO, error))
+            return FALSE;
     }
     priv->considered_uptodate = FALSE;
     return TRUE;
@@ -2021,6 +2395,18 @@ rewrite_repos(DnfSack *sack, Queue *addedfileprovides,
     map_free(&providedids);
 }
 
+// return true if all the file dependencies in q are satisfiable from primary.xml alone
+static bool
+all_primary_files(Pool *pool, Queue *q)
+{
+    for (int i = 0; i < q->count; i++) {
+        Id id = q->elements[i];
+        if (ISRELDEP(id) || !is_primary_file(pool_id2str(pool, id)))
+            return false;
+    }
+    return true;
+}
+
 /**
  * dnf_sack_make_provides_ready:
  * @sack: a #DnfSack instance.
@@ -2043,52 +2429,147 @@ dnf_sack_make_provides_ready(DnfSack *sack)
     queue_init(&addedfileprovides_inst);
     pool_addfileprovides_queue(priv->pool, &addedfileprovides,
                                &addedfileprovides_inst);
+    if ((priv->lazy_ext_flags & DNF_SACK_LOAD_FLAG_USE_FILELISTS) &&
+        !(all_primary_files(priv->pool, &addedfileprovides) &&
+          all_primary_files(priv->pool, &addedfileprovides_inst))) {
+        g_debug("file dependencies not covered by primary metadata, loading filelists");
+        g_autoptr(GError) error = NULL;
+        if (!dnf_sack_load_lazy_extensions(sack, DNF_SACK_LOAD_FLAG_USE_FILELISTS, NULL, &error))
+            g_warning("File provides may be incomplete: %s", error->message);
+        repo_internalize_all_trigger(priv->pool);
+        queue_empty(&addedfileprovides);
+        queue_empty(&addedfileprovides_inst);
+        pool_addfileprovides_queue(priv->pool, &addedfileprovides,
+                                   &addedfileprovides_inst);
+    }
     if (addedfileprovides.count || addedfileprovides_inst.count)
         rewrite_repos(sack, &addedfileprovides, &addedfileprovides_inst);
     queue_free(&addedfileprovides);
     queue_free(&addedfileprovides_inst);
     pool_createwhatprovides(priv->pool);
     priv->provides_ready = 1;
+    ++priv->provides_generation;
 }
 
 /**
- * dnf_sack_running_kernel: (skip)
+ * dnf_sack_get_provides_generation: (skip)
  * @sack: a #DnfSack instance.
  *
- * Returns the ID of the running kernel.
- *
- * Returns: an #Id or 0
+ * Gets a number which changes every time dnf_sack_make_provides_ready() recreates the provides.
+ * Depsolving data computed for one generation stay valid while it does not change.
  *
- * Since: 0.7.0
+ * Returns: the generation of the provides
  */
-Id
-dnf_sack_running_kernel(DnfSack *sack)
+guint
+dnf_sack_get_provides_generation(DnfSack *sack)
 {
     DnfSackPrivate *priv = GET_PRIVATE(sack);
-    if (priv->running_kernel_id >= 0)
-        return priv->running_kernel_id;
-    if (priv->running_kernel_fn)
-        priv->running_kernel_id = priv->running_kernel_fn(sack);
-    return priv->running_kernel_id;
+    return priv->provides_generation;
 }
 
 /**
- * dnf_sack_get_pool: (skip)
+ * dnf_sack_prepare_whatprovides: (skip)
  * @sack: a #DnfSack instance.
+ * @dep: a dependency
  *
- * Gets the internal pool for the sack.
- *
- * Returns: The pool, which is always set
+ * Computes the providers of the dependency and of all dependencies nested in it.
  *
- * Since: 0.7.0
+ * Libsolv computes the providers of relational dependencies on first use and stores them in
+ * the pool.
  */
-Pool *
-dnf_sack_get_pool(DnfSack *sack)
+void
+dnf_sack_prepare_whatprovides(DnfSack *sack, Id dep)
 {
-    DnfSackPrivate *priv = GET_PRIVATE(sack);
-    return priv->pool;
-}
-
+    Pool *pool = dnf_sack_get_pool(sack);
+    while (ISRELDEP(dep)) {
+        pool_whatprovides(pool, dep);
+        Reldep *rd = GETRELDEP(pool, dep);
+        switch (rd->flags) {
+            case REL_AND:
+            case REL_OR:
+            case REL_WITH:
+            case REL_WITHOUT:
+            case REL_COND:
+            case REL_UNLESS:
+            case REL_ELSE:
+                dnf_sack_prepare_whatprovides(sack, rd->evr);
+                break;
+            default:
+                break;
+        }
+        dep = rd->name;
+    }
+    pool_whatprovides(pool, dep);
+}
+
+/**
+ * dnf_sack_prepare_concurrent_solves: (skip)
+ * @sack: a #DnfSack instance.
+ *
+ * Makes the pool safe for concurrent solvers. The considered packages, the provides, the
+ * running kernel and the providers of all dependencies of the packages are computed up front,
+ * the solvers then only read the sack. It must not be modified until they finish.
+ */
+void
+dnf_sack_prepare_concurrent_solves(DnfSack *sack)
+{
+    dnf_sack_recompute_considered(sack);
+    dnf_sack_make_provides_ready(sack);
+    dnf_sack_running_kernel(sack);
+
+    Pool *pool = dnf_sack_get_pool(sack);
+    Id p;
+    Solvable *s;
+    FOR_POOL_SOLVABLES(p) {
+        s = pool_id2solvable(pool, p);
+        for (Offset deps : {s->provides, s->obsoletes, s->conflicts, s->requires, s->recommends,
+                            s->suggests, s->supplements, s->enhances}) {
+            if (!deps)
+                continue;
+            for (Id *dp = s->repo->idarraydata + deps; *dp; ++dp)
+                dnf_sack_prepare_whatprovides(sack, *dp);
+        }
+    }
+}
+
+/**
+ * dnf_sack_running_kernel: (skip)
+ * @sack: a #DnfSack instance.
+ *
+ * Returns the ID of the running kernel.
+ *
+ * Returns: an #Id or 0
+ *
+ * Since: 0.7.0
+ */
+Id
+dnf_sack_running_kernel(DnfSack *sack)
+{
+    DnfSackPrivate *priv = GET_PRIVATE(sack);
+    if (priv->running_kernel_id >= 0)
+        return priv->running_kernel_id;
+    if (priv->running_kernel_fn)
+        priv->running_kernel_id = priv->running_kernel_fn(sack);
+    return priv->running_kernel_id;
+}
+
+/**
+ * dnf_sack_get_pool: (skip)
+ * @sack: a #DnfSack instance.
+ *
+ * Gets the internal pool for the sack.
+ *
+ * Returns: The pool, which is always set
+ *
+ * Since: 0.7.0
+ */
+Pool *
+dnf_sack_get_pool(DnfSack *sack)
+{
+    DnfSackPrivate *priv = GET_PRIVATE(sack);
+    return priv->pool;
+}
+
 /**
  * dnf_sack_set_module_container: (skip)
  * @sack: a #DnfSack instance.
@@ -2125,6 +2606,23 @@ dnf_sack_get_module_container(DnfSack *sack)
     return priv->moduleContainer;
 }
 
+/**
+ * dnf_sack_get_unneeded_cache: (skip)
+ * @sack: a #DnfSack instance.
+ *
+ * Gets the memo of the unneeded packages of the sack, it is created on first use.
+ *
+ * Returns: The UnneededCache
+ */
+libdnf::UnneededCache &
+dnf_sack_get_unneeded_cache(DnfSack *sack)
+{
+    DnfSackPrivate *priv = GET_PRIVATE(sack);
+    if (!priv->unneeded_cache)
+        priv->unneeded_cache = new libdnf::UnneededCache;
+    return *priv->unneeded_cache;
+}
+
 /**********************************************************************/
 
 static void
@@ -2148,49 +2646,62 @@ process_excludes(DnfSack *sack, GPtrArray *enabled_repos)
             continue;
         }
 
+        auto & includes = repo->getConfig()->includepkgs().getValue();
+        auto & excludes = repo->getConfig()->excludepkgs().getValue();
+        if (includes.empty() && excludes.empty())
+            continue;
+
         libdnf::Query repoQuery(sack);
         repoQuery.addFilter(HY_PKG_REPONAME, HY_EQ, repo->getId().c_str());
         repoQuery.apply();
 
-        for (const auto & name : repo->getConfig()->includepkgs().getValue()) {
-            libdnf::Query query(repoQuery);
-            auto ret = query.filterSubject(name.c_str(), nullptr, false, true, false, false);
-            if (ret.first) {
-                repoIncludes += *query.runSet();
+        libdnf::SubjectMatcher matcher(sack);
+        std::vector<std::size_t> includeIdxs;
+        std::vector<std::size_t> excludeIdxs;
+        for (const auto & name : includes)
+            includeIdxs.push_back(matcher.addSubject(name.c_str()));
+        for (const auto & name : excludes)
+            excludeIdxs.push_back(matcher.addSubject(name.c_str()));
+        matcher.match(repoQuery.getResult());
+
+        for (auto idx : includeIdxs) {
+            if (matcher.matched(idx)) {
+                matcher.addMatches(idx, repoIncludes);
                 includesExist = true;
                 repo->setUseIncludes(true);
             }
         }
-
-        for (const auto & name : repo->getConfig()->excludepkgs().getValue()) {
-            libdnf::Query query(repoQuery);
-            auto ret = query.filterSubject(name.c_str(), nullptr, false, true, false, false);
-            if (ret.first) {
-                repoExcludes += *query.runSet();
-            }
-        }
+        for (auto idx : excludeIdxs)
+            matcher.addMatches(idx, repoExcludes);
     }
 
-    if (std::find(disabled.begin(), disabled.end(), "main") == disabled.end()) {
+    auto & includes = mainConf.includepkgs().getValue();
+    auto & excludes = mainConf.excludepkgs().getValue();
+    if (std::find(disabled.begin(), disabled.end(), "main") == disabled.end() &&
+        (!includes.empty() || !excludes.empty())) {
+        libdnf::Query query(sack);
+        query.apply();
+
+        libdnf::SubjectMatcher matcher(sack);
+        std::vector<std::size_t> includeIdxs;
+        std::vector<std::size_t> excludeIdxs;
+        for (const auto & name : includes)
+            includeIdxs.push_back(matcher.addSubject(name.c_str()));
+        for (const auto & name : excludes)
+            excludeIdxs.push_back(matcher.addSubject(name.c_str()));
+        matcher.match(query.getResult());
+
         bool useGlobalIncludes = false;
-        for (const auto & name : mainConf.includepkgs().getValue()) {
-            libdnf::Query query(sack);
-            auto ret = query.filterSubject(name.c_str(), nullptr, false, true, false, false);
-            if (ret.first) {
-                repoIncludes += *query.runSet();
+        for (auto idx : includeIdxs) {
+            if (matcher.matched(idx)) {
+                matcher.addMatches(idx, repoIncludes);
                 includesExist = true;
                 useGlobalIncludes = true;
             }
         }
+        for (auto idx : excludeIdxs)
+            matcher.addMatches(idx, repoExcludes);
 
-        for (const auto & name : mainConf.excludepkgs().getValue()) {
-            libdnf::Query query(sack);
-            auto ret = query.filterSubject(name.c_str(), nullptr, false, true, false, false);
-            if (ret.first) {
-                repoExcludes += *query.runSet();
-            }
-        }
-        
         if (useGlobalIncludes) {
             dnf_sack_set_use_includes(sack, nullptr, true);
         }
@@ -2202,44 +2713,346 @@ process_excludes(DnfSack *sack, GPtrArray *enabled_repos)
     dnf_sack_add_excludes(sack, &repoExcludes);
 }
 
+/* the snapshot file stores the repos of a prepared sack, see dnf_sack_add_repos_snapshot() */
+#define SNAPSHOT_FN "@sack-snapshot"
+static constexpr const std::array<char, 8> snapshot_magic{'\0', 'd', 'n', 'f', 's', 'n', 'a', 'p'};
+
+enum {
+    SNAPSHOT_REPO_FILELISTS = 1 << 0,
+    SNAPSHOT_REPO_PRESTO = 1 << 1,
+    SNAPSHOT_REPO_UPDATEINFO = 1 << 2,
+    SNAPSHOT_REPO_OTHER = 1 << 3,
+};
+
+static bool
+snapshot_write_int(FILE *fp, int64_t value)
+{
+    return fwrite(&value, sizeof(value), 1, fp) == 1;
+}
+
+static bool
+snapshot_read_int(FILE *fp, int64_t *value)
+{
+    return fread(value, sizeof(*value), 1, fp) == 1;
+}
+
+static bool
+snapshot_write_str(FILE *fp, const std::string & value)
+{
+    return snapshot_write_int(fp, value.size()) &&
+        fwrite(value.data(), 1, value.size(), fp) == value.size();
+}
+
+static bool
+snapshot_read_str(FILE *fp, std::string & value)
+{
+    int64_t size;
+    if (!snapshot_read_int(fp, &size) || size < 0 || size > PATH_MAX)
+        return false;
+    value.resize(size);
+    return fread(&value[0], 1, size, fp) == static_cast<size_t>(size);
+}
+
 /**
- * dnf_sack_add_repo:
+ * dnf_sack_rpmdb_stamp: (skip)
+ * @sack: a #DnfSack instance.
+ *
+ * Computes a stat based stamp of the rpm database in the install root of the
+ * sack, the files change with every transaction.
+ *
+ * Returns: the stamp, empty when no database file exists
+ */
+std::string
+dnf_sack_rpmdb_stamp(DnfSack *sack)
+{
+    Pool *pool = dnf_sack_get_pool(sack);
+    char *dbpath = rpmExpand("%{_dbpath}", NULL);
+    const char *root = pool_get_rootdir(pool);
+    std::string stamp;
+
+    for (auto name : {"rpmdb.sqlite", "rpmdb.sqlite-wal", "Packages", "Packages.db"}) {
+        g_autofree gchar *path = g_build_filename(root ? root : "/",
+                                                  dbpath[0] == '/' ? dbpath : "/var/lib/rpm",
+                                                  name, NULL);
+        struct stat st;
+        if (stat(path, &st) != 0)
+            continue;
+        stamp += tfm::format("%s:%lld:%lld.%09ld:%llu;", name,
+                             static_cast<long long>(st.st_size),
+                             static_cast<long long>(st.st_mtim.tv_sec), st.st_mtim.tv_nsec,
+                             static_cast<unsigned long long>(st.st_ino));
+    }
+    free(dbpath);
+    return stamp;
+}
+
+/**
+ * dnf_sack_snapshot_key:
+ *
+ * Computes the key of a snapshot of the sack with the given repos, loaded with
+ * the DnfSackLoadFlags flags. It covers the repomd.xml of every repo, the rpmdb
+ * when system_repo is set and the architecture and install root of the sack.
+ */
+void
+dnf_sack_snapshot_key(DnfSack *sack, const std::vector<HyRepo> & hrepos, gboolean system_repo,
+                      int flags, unsigned char *key)
+{
+    DnfSackPrivate *priv = GET_PRIVATE(sack);
+    const char *root = pool_get_rootdir(priv->pool);
+    std::vector<std::string> parts{std::to_string(flags), priv->arch ? priv->arch : "",
+                                   root ? root : ""};
+
+    parts.push_back(system_repo ? dnf_sack_rpmdb_stamp(sack) : "");
+    for (auto hrepo : hrepos) {
+        auto repoImpl = libdnf::repoGetImpl(hrepo);
+        unsigned char checksum[CHKSUM_BYTES];
+        FILE *fp = fopen(repoImpl->repomdFn.c_str(), "r");
+        parts.push_back(repoImpl->id);
+        if (fp) {
+            checksum_fp(checksum, fp);
+            fclose(fp);
+            parts.push_back(pool_checksum_str(priv->pool, checksum));
+        } else {
+            parts.emplace_back();
+        }
+    }
+    checksum_strings(key, parts);
+}
+
+/**
+ * dnf_sack_write_snapshot:
+ *
+ * Writes all repos of the sack into a single file. The file provides should be
+ * added (see dnf_sack_make_provides_ready()) before, so they are part of the
+ * snapshot. Nothing is written while extensions are registered for lazy loading.
  */
 gboolean
-dnf_sack_add_repo(DnfSack *sack,
-                    DnfRepo *repo,
-                    guint permissible_cache_age,
-                    DnfSackAddFlags flags,
-                    DnfState *state,
-                    GError **error) try
+dnf_sack_write_snapshot(DnfSack *sack, const unsigned char *key, GError **error)
 {
-    gboolean ret = TRUE;
-    GError *error_local = NULL;
-    DnfState *state_local;
-    int flags_hy = DNF_SACK_LOAD_FLAG_BUILD_CACHE;
+    DnfSackPrivate *priv = GET_PRIVATE(sack);
+    Pool *pool = priv->pool;
+    std::vector<Repo *> repos;
+    SolvUserdata solv_userdata;
+    Repo *repo;
+    int i;
 
-    /* set state */
-    ret = dnf_state_set_steps(state, error,
-                   5, /* check repo */
-                   95, /* load solv */
-                   -1);
-    if (!ret)
+    if (priv->lazy_ext_flags) {
+        g_debug("not writing snapshot, extensions are loaded lazily");
+        return TRUE;
+    }
+    FOR_REPOS(i, repo) {
+        if (repo->appdata && repo != priv->cmdline_repo)
+            repos.push_back(repo);
+    }
+    if (solv_userdata_fill(&solv_userdata, key, error))
         return FALSE;
 
-    /* check repo */
-    state_local = dnf_state_get_child(state);
+    g_autofree gchar *fn = g_build_filename(priv->cache_dir, SNAPSHOT_FN, NULL);
+    g_autofree gchar *tmp_fn_templ = g_strconcat(fn, ".XXXXXX", NULL);
+    int tmp_fd = mkstemp(tmp_fn_templ);
+    if (tmp_fd < 0) {
+        g_set_error(error,
+                    DNF_ERROR,
+                    DNF_ERROR_FILE_INVALID,
+                    _("cannot create temporary file: %s"),
+                    tmp_fn_templ);
+        return FALSE;
+    }
+    FILE *fp = fdopen(tmp_fd, "w+");
+    bool ok = fp &&
+        fwrite(snapshot_magic.data(), snapshot_magic.size(), 1, fp) == 1 &&
+        fwrite(&solv_userdata, solv_userdata_size, 1, fp) == 1 &&
+        snapshot_write_int(fp, repos.size());
+
+    for (auto it = repos.begin(); ok && it != repos.end(); ++it) {
+        repo = *it;
+        auto hrepo = static_cast<HyRepo>(repo->appdata);
+        auto repoImpl = libdnf::repoGetImpl(hrepo);
+        int ext = 0;
+        if (repoImpl->state_filelists != _HY_NEW)
+            ext |= SNAPSHOT_REPO_FILELISTS;
+        if (repoImpl->state_presto != _HY_NEW)
+            ext |= SNAPSHOT_REPO_PRESTO;
+        if (repoImpl->state_updateinfo != _HY_NEW)
+            ext |= SNAPSHOT_REPO_UPDATEINFO;
+        if (repoImpl->state_other != _HY_NEW)
+            ext |= SNAPSHOT_REPO_OTHER;
+        ok = snapshot_write_str(fp, repoImpl->id) &&
+            snapshot_write_int(fp, repo == pool->installed) &&
+            snapshot_write_int(fp, repoImpl->load_flags) &&
+            snapshot_write_int(fp, ext) &&
+            snapshot_write_int(fp, repoImpl->main_nsolvables) &&
+            snapshot_write_int(fp, repoImpl->main_end - repo->start);
+        /* the end of the solv data, it is filled in when known */
+        long end_pos = ok ? ftell(fp) : -1;
+        ok = ok && snapshot_write_int(fp, 0);
+        if (ok) {
+            Repowriter *writer = repowriter_create(repo);
+            ok = repowriter_write(writer, fp) == 0;
+            repowriter_free(writer);
+        }
+        long end = ok ? ftell(fp) : -1;
+        ok = ok && fseek(fp, end_pos, SEEK_SET) == 0 && snapshot_write_int(fp, end) &&
+            fseek(fp, end, SEEK_SET) == 0;
+    }
+
+    if (!fp)
+        close(tmp_fd);
+    else if (fclose(fp) != 0)
+        ok = false;
+    if (!ok) {
+        g_set_error(error,
+                    DNF_ERROR,
+                    DNF_ERROR_FILE_INVALID,
+                    _("Failed writing snapshot %s: %s"),
+                    tmp_fn_templ, pool_errstr(pool));
+        unlink(tmp_fn_templ);
+        return FALSE;
+    }
+    return priv->cache_writer->commit(tmp_fn_templ, fn, error);
+}
+
+static void
+snapshot_rollback(Pool *pool, std::vector<Repo *> & repos)
+{
+    for (auto repo : repos) {
+        auto hrepo = static_cast<HyRepo>(repo->appdata);
+        if (repo == pool->installed)
+            pool_set_installed(pool, NULL);
+        if (hrepo)
+            libdnf::repoGetImpl(hrepo)->detachLibsolvRepo();
+        repo_free(repo, 1);
+    }
+}
+
+/**
+ * dnf_sack_load_snapshot:
+ *
+ * Loads the repos from the snapshot written by dnf_sack_write_snapshot() if its
+ * key matches and it contains exactly the given repos and the system repo when
+ * system_repo is set.
+ *
+ * Returns: %FALSE if there is no usable snapshot, nothing is loaded then.
+ */
+gboolean
+dnf_sack_load_snapshot(DnfSack *sack, const std::vector<HyRepo> & hrepos, gboolean system_repo,
+                       const unsigned char *key)
+{
+    DnfSackPrivate *priv = GET_PRIVATE(sack);
+    Pool *pool = priv->pool;
+    g_autofree gchar *fn = g_build_filename(priv->cache_dir, SNAPSHOT_FN, NULL);
+    std::array<char, snapshot_magic.size()> magic;
+    SolvUserdata solv_userdata;
+    std::vector<Repo *> loaded;
+    int64_t nrepos;
+
+    std::unique_ptr<FILE, decltype(&fclose)> fp(fopen(fn, "r"), &fclose);
+    if (!fp)
+        return FALSE;
+    if (fread(magic.data(), magic.size(), 1, fp.get()) != 1 || magic != snapshot_magic ||
+        fread(&solv_userdata, solv_userdata_size, 1, fp.get()) != 1 ||
+        solv_userdata_verify(&solv_userdata, key) ||
+        !snapshot_read_int(fp.get(), &nrepos) ||
+        nrepos != static_cast<int64_t>(hrepos.size()) + (system_repo ? 1 : 0)) {
+        g_debug("snapshot %s is not usable", fn);
+        return FALSE;
+    }
+
+    for (int64_t n = 0; n < nrepos; ++n) {
+        std::string id;
+        int64_t is_system, load_flags, ext, main_nsolvables, main_end, end;
+        if (!snapshot_read_str(fp.get(), id) ||
+            !snapshot_read_int(fp.get(), &is_system) ||
+            !snapshot_read_int(fp.get(), &load_flags) ||
+            !snapshot_read_int(fp.get(), &ext) ||
+            !snapshot_read_int(fp.get(), &main_nsolvables) ||
+            !snapshot_read_int(fp.get(), &main_end) ||
+            !snapshot_read_int(fp.get(), &end)) {
+            snapshot_rollback(pool, loaded);
+            return FALSE;
+        }
+
+        HyRepo hrepo = nullptr;
+        if (is_system) {
+            if (!system_repo || pool->installed) {
+                snapshot_rollback(pool, loaded);
+                return FALSE;
+            }
+            hrepo = hy_repo_create(HY_SYSTEM_REPO_NAME);
+        } else {
+            for (auto candidate : hrepos) {
+                if (libdnf::repoGetImpl(candidate)->id == id) {
+                    hrepo = candidate;
+                    break;
+                }
+            }
+        }
+        if (!hrepo || libdnf::repoGetImpl(hrepo)->libsolvRepo) {
+            snapshot_rollback(pool, loaded);
+            return FALSE;
+        }
+
+        Repo *repo = repo_create(pool, id.c_str());
+        if (repo_add_solv(repo, fp.get(), 0) || fseek(fp.get(), end, SEEK_SET)) {
+            g_debug("snapshot %s is not usable: %s", fn, pool_errstr(pool));
+            repo_free(repo, 1);
+            if (is_system)
+                hy_repo_free(hrepo);
+            snapshot_rollback(pool, loaded);
+            return FALSE;
+        }
+        loaded.push_back(repo);
+
+        auto repoImpl = libdnf::repoGetImpl(hrepo);
+        repoImpl->attachLibsolvRepo(repo);
+        repoImpl->load_flags = load_flags & ~DNF_SACK_LOAD_FLAG_BUILD_CACHE;
+        repoImpl->state_main = _HY_LOADED_CACHE;
+        repoImpl->main_nsolvables = main_nsolvables;
+        repoImpl->main_nrepodata = repo->nrepodata;
+        repoImpl->main_end = repo->start + main_end;
+        for (auto which : {std::make_pair(SNAPSHOT_REPO_FILELISTS, _HY_REPODATA_FILENAMES),
+                           std::make_pair(SNAPSHOT_REPO_PRESTO, _HY_REPODATA_PRESTO),
+                           std::make_pair(SNAPSHOT_REPO_UPDATEINFO, _HY_REPODATA_UPDATEINFO),
+                           std::make_pair(SNAPSHOT_REPO_OTHER, _HY_REPODATA_OTHER)}) {
+            if (!(ext & which.first))
+                continue;
+            repo_update_state(hrepo, which.second, _HY_LOADED_CACHE);
+            repo_set_repodata(hrepo, which.second, repo->nrepodata - 1);
+        }
+        if (is_system) {
+            pool_set_installed(pool, repo);
+            hy_repo_free(hrepo);
+        }
+    }
+
+    g_debug("loaded snapshot %s", fn);
+    priv->provides_ready = 0;
+    priv->considered_uptodate = FALSE;
+    return TRUE;
+}
+
+/* checks the repo metadata and refreshes them when needed, sets skip when the repo
+ * must not be loaded */
+static gboolean
+check_repo(DnfRepo *repo, guint permissible_cache_age, DnfState *state,
+           gboolean *skip, GError **error)
+{
+    GError *error_local = NULL;
+    gboolean ret;
+
+    *skip = FALSE;
     ret = dnf_repo_check(repo,
                          permissible_cache_age,
-                         state_local,
+                         state,
                          &error_local);
     if (!ret) {
         g_debug("failed to check, attempting update: %s",
                 error_local->message);
         g_clear_error(&error_local);
-        dnf_state_reset(state_local);
+        dnf_state_reset(state);
         ret = dnf_repo_update(repo,
                               DNF_REPO_UPDATE_FLAG_FORCE,
-                              state_local,
+                              state,
                               &error_local);
         if (!ret) {
             if (!dnf_repo_get_required(repo) &&
@@ -2253,7 +3066,8 @@ dnf_sack_add_repo(DnfSack *sack,
                           dnf_repo_get_id(repo),
                           error_local->message);
                 g_error_free(error_local);
-                return dnf_state_finished(state, error);
+                *skip = TRUE;
+                return TRUE;
             }
             g_propagate_error(error, error_local);
             return FALSE;
@@ -2264,25 +3078,80 @@ dnf_sack_add_repo(DnfSack *sack,
     if (dnf_repo_get_enabled(repo) == DNF_REPO_ENABLED_NONE) {
         g_debug("Skipping %s as repo no longer enabled",
                 dnf_repo_get_id(repo));
-        return dnf_state_finished(state, error);
+        *skip = TRUE;
     }
+    return TRUE;
+}
 
-    /* done */
-    if (!dnf_state_done(state, error))
-        return FALSE;
+static int
+add_flags_to_load_flags(DnfSackAddFlags flags)
+{
+    int flags_hy = DNF_SACK_LOAD_FLAG_BUILD_CACHE;
 
-    /* only load what's required */
     if ((flags & DNF_SACK_ADD_FLAG_FILELISTS) > 0)
         flags_hy |= DNF_SACK_LOAD_FLAG_USE_FILELISTS;
     if ((flags & DNF_SACK_ADD_FLAG_OTHER) > 0)
         flags_hy |= DNF_SACK_LOAD_FLAG_USE_OTHER;
     if ((flags & DNF_SACK_ADD_FLAG_UPDATEINFO) > 0)
         flags_hy |= DNF_SACK_LOAD_FLAG_USE_UPDATEINFO;
+    if ((flags & DNF_SACK_ADD_FLAG_LAZY_EXTENSIONS) > 0)
+        flags_hy |= DNF_SACK_LOAD_FLAG_LAZY_EXTENSIONS;
+    return flags_hy;
+}
+
+/* whether dnf_sack_add_repos() loads the repo */
+static gboolean
+repo_is_to_add(DnfRepo *repo, DnfSackAddFlags flags)
+{
+    if (dnf_repo_get_enabled(repo) == DNF_REPO_ENABLED_NONE)
+        return FALSE;
+
+    /* only allow metadata-only repos if FLAG_UNAVAILABLE is set */
+    if (dnf_repo_get_enabled(repo) == DNF_REPO_ENABLED_METADATA) {
+        if ((flags & DNF_SACK_ADD_FLAG_UNAVAILABLE) == 0)
+            return FALSE;
+    }
+    return TRUE;
+}
+
+/**
+ * dnf_sack_add_repo:
+ */
+gboolean
+dnf_sack_add_repo(DnfSack *sack,
+                    DnfRepo *repo,
+                    guint permissible_cache_age,
+                    DnfSackAddFlags flags,
+                    DnfState *state,
+                    GError **error) try
+{
+    gboolean ret = TRUE;
+    gboolean skip;
+    DnfState *state_local;
+
+    /* set state */
+    ret = dnf_state_set_steps(state, error,
+                   5, /* check repo */
+                   95, /* load solv */
+                   -1);
+    if (!ret)
+        return FALSE;
+
+    /* check repo */
+    state_local = dnf_state_get_child(state);
+    if (!check_repo(repo, permissible_cache_age, state_local, &skip, error))
+        return FALSE;
+    if (skip)
+        return dnf_state_finished(state, error);
+
+    /* done */
+    if (!dnf_state_done(state, error))
+        return FALSE;
 
     /* load solv */
     g_debug("Loading repo %s", dnf_repo_get_id(repo));
     dnf_state_action_start(state, DNF_STATE_ACTION_LOADING_CACHE, NULL);
-    if (!dnf_sack_load_repo(sack, dnf_repo_get_repo(repo), flags_hy, error))
+    if (!dnf_sack_load_repo(sack, dnf_repo_get_repo(repo), add_flags_to_load_flags(flags), error))
         return FALSE;
 
     /* done */
@@ -2310,31 +3179,17 @@ dnf_sack_add_repos(DnfSack *sack,
     /* count the enabled repos */
     for (i = 0; i < repos->len; i++) {
         repo = static_cast<DnfRepo *>(g_ptr_array_index(repos, i));
-        if (dnf_repo_get_enabled(repo) == DNF_REPO_ENABLED_NONE)
-            continue;
-
-        /* only allow metadata-only repos if FLAG_UNAVAILABLE is set */
-        if (dnf_repo_get_enabled(repo) == DNF_REPO_ENABLED_METADATA) {
-            if ((flags & DNF_SACK_ADD_FLAG_UNAVAILABLE) == 0)
-                continue;
-        }
-
-        cnt++;
+        if (repo_is_to_add(repo, flags))
+            cnt++;
     }
 
     /* add each repo */
     dnf_state_set_number_steps(state, cnt);
     for (i = 0; i < repos->len; i++) {
         repo = static_cast<DnfRepo *>(g_ptr_array_index(repos, i));
-        if (dnf_repo_get_enabled(repo) == DNF_REPO_ENABLED_NONE)
+        if (!repo_is_to_add(repo, flags))
             continue;
 
-        /* only allow metadata-only repos if FLAG_UNAVAILABLE is set */
-        if (dnf_repo_get_enabled(repo) == DNF_REPO_ENABLED_METADATA) {
-            if ((flags & DNF_SACK_ADD_FLAG_UNAVAILABLE) == 0)
-                continue;
-        }
-
         state_local = dnf_state_get_child(state);
         ret = dnf_sack_add_repo(sack,
                                   repo,
@@ -2358,29 +3213,169 @@ dnf_sack_add_repos(DnfSack *sack,
     return TRUE;
 } CATCH_TO_GERROR(FALSE)
 
+/**
+ * dnf_sack_add_repos_snapshot:
+ *
+ * Loads the system repo when load_system_repo is set and adds the repos like
+ * dnf_sack_add_repos(). When the repos, the rpmdb and the flags did not change
+ * since the last call, all of them are restored from a single snapshot file,
+ * including the file provides. A new snapshot is written otherwise.
+ */
+gboolean
+dnf_sack_add_repos_snapshot(DnfSack *sack,
+                            GPtrArray *repos,
+                            guint permissible_cache_age,
+                            DnfSackAddFlags flags,
+                            gboolean load_system_repo,
+                            DnfState *state,
+                            GError **error) try
+{
+    g_autoptr(GPtrArray) enabled_repos = g_ptr_array_new();
+    std::vector<HyRepo> hrepos;
+    unsigned char key[CHKSUM_BYTES];
+    int flags_hy = add_flags_to_load_flags(flags);
+    guint cnt = 0;
+
+    /* set state */
+    if (!dnf_state_set_steps(state, error,
+                             10, /* check repos */
+                             90, /* load solv */
+                             -1))
+        return FALSE;
+
+    /* check each repo, this can refresh the metadata */
+    for (guint i = 0; i < repos->len; i++) {
+        if (repo_is_to_add(static_cast<DnfRepo *>(g_ptr_array_index(repos, i)), flags))
+            cnt++;
+    }
+    DnfState *state_local = dnf_state_get_child(state);
+    dnf_state_set_number_steps(state_local, cnt);
+    for (guint i = 0; i < repos->len; i++) {
+        auto repo = static_cast<DnfRepo *>(g_ptr_array_index(repos, i));
+        gboolean skip;
+        if (!repo_is_to_add(repo, flags))
+            continue;
+        if (!check_repo(repo, permissible_cache_age, dnf_state_get_child(state_local), &skip, error))
+            return FALSE;
+        if (!dnf_state_done(state_local, error))
+            return FALSE;
+        if (skip)
+            continue;
+        g_ptr_array_add(enabled_repos, repo);
+        hrepos.push_back(dnf_repo_get_repo(repo));
+    }
+    if (!dnf_state_done(state, error))
+        return FALSE;
+
+    /* load solv */
+    dnf_state_action_start(state, DNF_STATE_ACTION_LOADING_CACHE, NULL);
+    dnf_sack_snapshot_key(sack, hrepos, load_system_repo, flags_hy, key);
+    if (!dnf_sack_load_snapshot(sack, hrepos, load_system_repo, key)) {
+        g_autoptr(GError) error_local = NULL;
+        if (load_system_repo &&
+            !dnf_sack_load_system_repo(sack, NULL, DNF_SACK_LOAD_FLAG_NONE, error))
+            return FALSE;
+        for (auto hrepo : hrepos) {
+            g_debug("Loading repo %s", libdnf::repoGetImpl(hrepo)->id.c_str());
+            if (!dnf_sack_load_repo(sack, hrepo, flags_hy, error))
+                return FALSE;
+        }
+        dnf_sack_make_provides_ready(sack);
+        if (!dnf_sack_write_snapshot(sack, key, &error_local))
+            g_warning("Failed to write snapshot of the sack: %s", error_local->message);
+    }
+
+    process_excludes(sack, enabled_repos);
+    return dnf_state_done(state, error);
+} CATCH_TO_GERROR(FALSE)
+
 namespace {
+
+/// Measures the phases of module filtering, each phase ends where the next one starts
+class ModuleFilteringStats {
+public:
+    explicit ModuleFilteringStats(std::vector<libdnf::ModuleFilteringPhase> * phases)
+    : phases(phases)
+    {
+        if (phases) {
+            begin = std::chrono::steady_clock::now();
+        }
+    }
+
+    /// Nothing is measured without phases, callers skip computing the counts then
+    bool enabled() const { return phases != nullptr; }
+
+    /// Record the phase which just ended, logged at debug level as "key=value" pairs
+    void record(const char * phase, std::size_t count)
+    {
+        if (!phases) {
+            return;
+        }
+        auto end = std::chrono::steady_clock::now();
+        double seconds = std::chrono::duration<double>(end - begin).count();
+        begin = end;
+        auto logger(libdnf::Log::getLogger());
+        logger->debug(tfm::format("module filtering: phase=%s seconds=%.6f count=%u", phase, seconds,
+                                  count));
+        phases->push_back({phase, seconds, count});
+    }
+
+private:
+    std::vector<libdnf::ModuleFilteringPhase> * phases;
+    std::chrono::steady_clock::time_point begin;
+};
+
 void readModuleMetadataFromRepo(DnfSack * sack, libdnf::ModulePackageContainer * modulePackages,
-    const char * platformModule)
+    const char * platformModule, ModuleFilteringStats & stats)
 {
     modulePackages->add(sack);
     modulePackages->loadFailSafeData();
+    if (stats.enabled()) {
+        stats.record("load_metadata", modulePackages->getModulePackages().size());
+    }
+    std::size_t platformCount = 0;
     if (!modulePackages->empty()) {
         // TODO remove hard-coded path
         try {
             std::vector<std::string> paths{"/etc/os-release", "/usr/lib/os-release"};
-            modulePackages->addPlatformPackage(sack, paths, platformModule);
+            if (modulePackages->addPlatformPackage(sack, paths, platformModule)) {
+                platformCount = 1;
+            }
         } catch (const std::exception & except) {
             auto logger(libdnf::Log::getLogger());
             logger->critical("Detection of Platform Module failed: " + std::string(except.what()));
         }
     }
+    stats.record("add_platform", platformCount);
 }
 
-/// @return std::map<name:stream.arch, std::vector<std::string>>
-static std::map<std::string, std::vector<std::string>> getDemodularizedRpms(
-    libdnf::ModulePackageContainer & moduleContainer, const std::vector<libdnf::ModulePackage *> & allPackages)
+/// Artifact NEVRA as pool Ids, matched like HY_PKG_NEVRA_STRICT does
+struct ArtifactIds {
+    Id name;
+    Id evr;
+    Id arch;
+
+    bool operator==(const ArtifactIds & other) const noexcept
+    {
+        return name == other.name && evr == other.evr && arch == other.arch;
+    }
+};
+
+struct ArtifactIdsHash {
+    std::size_t operator()(const ArtifactIds & artifact) const noexcept
+    {
+        return (static_cast<std::size_t>(artifact.name) * 1000003u ^
+                static_cast<std::size_t>(artifact.evr)) * 1000003u ^ static_cast<std::size_t>(artifact.arch);
+    }
+};
+
+/// @return name Ids of the demodularized rpms of the latest modules by <name:stream.arch>
+static std::unordered_map<std::string, std::unordered_set<Id>> getDemodularizedRpms(
+    DnfSack * sack, libdnf::ModulePackageContainer & moduleContainer,
+    const std::vector<libdnf::ModulePackage *> & allPackages)
 {
-    std::map<std::string, std::vector<std::string>> ret;
+    Pool * pool = dnf_sack_get_pool(sack);
+    std::unordered_map<std::string, std::unordered_set<Id>> ret;
     auto latest = moduleContainer.getLatestModules(allPackages, true);
     for (auto modulePackage : latest) {
         auto demodularized = modulePackage->getDemodularizedRpms();
@@ -2391,104 +3386,113 @@ static std::map<std::string, std::vector<std::string>> getDemodularizedRpms(
         packageID.append(".");
         packageID.append(modulePackage->getArch());
         auto & data = ret[packageID];
-        data.insert(data.end(), demodularized.begin(), demodularized.end());
+        for (const auto & name : demodularized) {
+            // a name unknown to the pool cannot be the name of an artifact in the pool
+            if (Id nameId = pool_str2id(pool, name.c_str(), 0)) {
+                data.insert(nameId);
+            }
+        }
     }
     return ret;
 }
 
-/// Return <includeNEVRAs>, <excludeNEVRAs>, <names>, <srcNames>, <name dependency container>
-static std::tuple<std::vector<std::string>, std::vector<std::string>, std::vector<std::string>, std::vector<std::string>, libdnf::DependencyContainer>
+/// Artifacts of the modules in one pass, all kept as pool Ids
+struct ModularArtifacts {
+    explicit ModularArtifacts(DnfSack * sack) : nameDependencies(sack) {}
+
+    std::unordered_set<ArtifactIds, ArtifactIdsHash> include;
+    std::unordered_set<ArtifactIds, ArtifactIdsHash> exclude;
+    /// names of binary artifacts of active modules, their provides are in nameDependencies
+    std::unordered_set<Id> names;
+    std::unordered_set<Id> srcNames;
+    libdnf::DependencyContainer nameDependencies;
+};
+
+static ModularArtifacts
 collectNevraForInclusionExclusion(DnfSack *sack, libdnf::ModulePackageContainer &modulePackageContainer)
 {
+    Pool * pool = dnf_sack_get_pool(sack);
     auto allPackages = modulePackageContainer.getModulePackages();
-    auto demodularizedNames = getDemodularizedRpms(modulePackageContainer, allPackages);
+    auto demodularizedNames = getDemodularizedRpms(sack, modulePackageContainer, allPackages);
 
-    std::vector<std::string> includeNEVRAs;
-    std::vector<std::string> excludeNEVRAs;
-    std::vector<std::string> names;
-    std::vector<std::string> srcNames;
-    libdnf::DependencyContainer nameDependencies{sack};
+    ModularArtifacts result(sack);
+    // the NEVRAs are split as HY_PKG_NEVRA_STRICT does, the names are taken only from artifacts
+    // of the HY_FORM_NEVRA form
+    libdnf::NevraID nevraId;
     libdnf::Nevra nevra;
-    // TODO: turn into std::vector<const char *> to prevent unnecessary conversion?
     for (const auto & module : allPackages) {
         auto artifacts = module->getArtifacts();
         // TODO use Goal::listInstalls() to not requires filtering out Platform
-        if (modulePackageContainer.isModuleActive(module->getId())) {
-            std::string packageID{module->getNameStream()};
-            packageID.append(".");
-            packageID.append(module->getArch());
-            auto it = demodularizedNames.find(packageID);
-            if (it == demodularizedNames.end()) {
-                for (const auto &rpm : artifacts) {
-                    if (nevra.parse(rpm.c_str(), HY_FORM_NEVRA)) {
-                        auto arch = nevra.getArch();
-                        // source packages do not provide anything and must not cause excluding binary packages
-                        if (arch == "src" || arch == "nosrc") {
-                            srcNames.push_back(nevra.getName());
-                        } else {
-                            names.push_back(nevra.getName());
-                            nameDependencies.addReldep(nevra.getName().c_str());
-                        }
-                    }
-                }
-            } else {
-                for (const auto &rpm : artifacts) {
-                    if (nevra.parse(rpm.c_str(), HY_FORM_NEVRA)) {
-                        bool found = false;
-                        for ( auto & demodularized : it->second) {
-                            if (nevra.getName() == demodularized) {
-                                found = true;
-                                break;
-                            }
-                        }
-                        if (found) {
-                            continue;
-                        }
-                        auto arch = nevra.getArch();
-                        // source packages do not provide anything and must not cause excluding binary packages
-                        if (arch == "src" || arch == "nosrc") {
-                            srcNames.push_back(nevra.getName());
-                        } else {
-                            names.push_back(nevra.getName());
-                            nameDependencies.addReldep(nevra.getName().c_str());
-                        }
-                    }
+        if (!modulePackageContainer.isModuleActive(module->getId())) {
+            for (const auto & rpm : artifacts) {
+                if (nevraId.parse(pool, rpm.c_str(), true)) {
+                    result.exclude.insert({nevraId.name, nevraId.evr, nevraId.arch});
                 }
             }
-            copy(std::begin(artifacts), std::end(artifacts), std::back_inserter(includeNEVRAs));
-        } else {
-            copy(std::begin(artifacts), std::end(artifacts), std::back_inserter(excludeNEVRAs));
+            continue;
         }
-    }
 
-    return std::make_tuple(std::move(includeNEVRAs), std::move(excludeNEVRAs), std::move(names), std::move(srcNames),
-                           std::move(nameDependencies));
+        std::string packageID{module->getNameStream()};
+        packageID.append(".");
+        packageID.append(module->getArch());
+        auto it = demodularizedNames.find(packageID);
+        const std::unordered_set<Id> * demodularized = it == demodularizedNames.end() ? nullptr : &it->second;
+        for (const auto & rpm : artifacts) {
+            if (nevraId.parse(pool, rpm.c_str(), true)) {
+                result.include.insert({nevraId.name, nevraId.evr, nevraId.arch});
+            }
+            if (!nevra.parse(rpm.c_str(), HY_FORM_NEVRA)) {
+                continue;
+            }
+            // a name unknown to the pool neither names nor is provided by any package
+            Id name = pool_str2id(pool, nevra.getName().c_str(), 0);
+            if (!name || (demodularized && demodularized->count(name))) {
+                continue;
+            }
+            // source packages do not provide anything and must not cause excluding binary packages
+            const auto & arch = nevra.getArch();
+            if (arch == "src" || arch == "nosrc") {
+                result.srcNames.insert(name);
+            } else if (result.names.insert(name).second) {
+                result.nameDependencies.add(name);
+            }
+        }
+    }
+    return result;
 }
 
 void
-setModuleExcludes(DnfSack * sack, const char ** hotfixRepos, libdnf::ModulePackageContainer & modulePackageContainer)
+setModuleExcludes(DnfSack * sack, const char ** hotfixRepos, libdnf::ModulePackageContainer & modulePackageContainer,
+    ModuleFilteringStats & stats)
 {
     dnf_sack_set_module_excludes(sack, nullptr);
 
-    auto data = collectNevraForInclusionExclusion(sack, modulePackageContainer);
-
-    auto & includeNEVRAs = std::get<0>(data);
-    auto & excludeNEVRAs = std::get<1>(data);
-    auto & names = std::get<2>(data);
-    auto & srcNames = std::get<3>(data);
-    auto & nameDependencies = std::get<4>(data);
-
-    std::vector<const char *> namesCString(names.size() + 1);
-    std::vector<const char *> srcNamesCString(srcNames.size() + 1);
-    std::vector<const char *> excludeNEVRAsCString(excludeNEVRAs.size() + 1);
-    std::vector<const char *> includeNEVRAsCString(includeNEVRAs.size() + 1);
-
-    transform(names.begin(), names.end(), namesCString.begin(), std::mem_fn(&std::string::c_str));
-    transform(srcNames.begin(), srcNames.end(), srcNamesCString.begin(), std::mem_fn(&std::string::c_str));
-    transform(excludeNEVRAs.begin(), excludeNEVRAs.end(), excludeNEVRAsCString.begin(),
-              std::mem_fn(&std::string::c_str));
-    transform(includeNEVRAs.begin(), includeNEVRAs.end(), includeNEVRAsCString.begin(),
-              std::mem_fn(&std::string::c_str));
+    auto artifacts = collectNevraForInclusionExclusion(sack, modulePackageContainer);
+    stats.record("collect_artifacts", artifacts.include.size() + artifacts.exclude.size());
+
+    // a single pass over the pool classifies the packages by the artifact Ids
+    Pool * pool = dnf_sack_get_pool(sack);
+    libdnf::PackageSet includeNevras(sack);
+    libdnf::PackageSet excludeNevras(sack);
+    libdnf::PackageSet excludeNames(sack);
+    Id id;
+    Solvable * s;
+    FOR_POOL_SOLVABLES(id) {
+        s = pool_id2solvable(pool, id);
+        ArtifactIds ids{s->name, s->evr, s->arch};
+        if (artifacts.include.count(ids)) {
+            includeNevras.set(id);
+        }
+        if (artifacts.exclude.count(ids)) {
+            excludeNevras.set(id);
+        }
+        // Required to filtrate out source packages and packages with incompatible architectures,
+        // source packages only with the names of included source artifacts
+        if (artifacts.names.count(s->name) ||
+            ((s->arch == ARCH_SRC || s->arch == ARCH_NOSRC) && artifacts.srcNames.count(s->name))) {
+            excludeNames.set(id);
+        }
+    }
 
     libdnf::Query keepPackages{sack};
     const char *keepRepo[] = {HY_CMDLINE_REPO_NAME, HY_SYSTEM_REPO_NAME, nullptr};
@@ -2501,30 +3505,26 @@ setModuleExcludes(DnfSack * sack, const char ** hotfixRepos, libdnf::ModulePacka
     libdnf::Query excludeQuery{keepPackages};
     libdnf::Query excludeProvidesQuery{keepPackages};
     libdnf::Query excludeNamesQuery(keepPackages);
-    libdnf::Query excludeSrcNamesQuery(keepPackages);
-    includeQuery.addFilter(HY_PKG_NEVRA_STRICT, HY_EQ, includeNEVRAsCString.data());
+    includeQuery.addFilter(HY_PKG, HY_EQ, &includeNevras);
 
-    excludeQuery.addFilter(HY_PKG_NEVRA_STRICT, HY_EQ, excludeNEVRAsCString.data());
+    excludeQuery.addFilter(HY_PKG, HY_EQ, &excludeNevras);
     excludeQuery.queryDifference(includeQuery);
 
     // Exclude packages by their Provides
-    excludeProvidesQuery.addFilter(HY_PKG_PROVIDES, &nameDependencies);
+    excludeProvidesQuery.addFilter(HY_PKG_PROVIDES, &artifacts.nameDependencies);
     excludeProvidesQuery.queryDifference(includeQuery);
 
-    // Search for source packages with same names as included source artifacts
-    excludeSrcNamesQuery.addFilter(HY_PKG_NAME, HY_EQ, srcNamesCString.data());
-    const char * srcArchs[] = {"src", "nosrc", nullptr};
-    excludeSrcNamesQuery.addFilter(HY_PKG_ARCH, HY_EQ, srcArchs);
-
-    // Required to filtrate out source packages and packages with incompatible architectures
-    excludeNamesQuery.addFilter(HY_PKG_NAME, HY_EQ, namesCString.data());
-    excludeNamesQuery.queryUnion(excludeSrcNamesQuery);
+    excludeNamesQuery.addFilter(HY_PKG, HY_EQ, &excludeNames);
     excludeNamesQuery.queryDifference(includeQuery);
 
     dnf_sack_set_module_excludes(sack, excludeQuery.getResultPset());
     dnf_sack_add_module_excludes(sack, excludeProvidesQuery.getResultPset());
     dnf_sack_add_module_excludes(sack, excludeNamesQuery.getResultPset());
     dnf_sack_set_module_includes(sack, includeQuery.getResultPset());
+    if (stats.enabled()) {
+        stats.record("exclude_queries", excludeQuery.size() + excludeProvidesQuery.size() +
+                     excludeNamesQuery.size());
+    }
 }
 
 }
@@ -2565,8 +3565,10 @@ void dnf_sack_filter_modules(DnfSack *sack, GPtrArray *repos, const char *instal
 
 std::pair<std::vector<std::vector<std::string>>, libdnf::ModulePackageContainer::ModuleErrorType> dnf_sack_filter_modules_v2(
     DnfSack * sack, DnfModulePackageContainer * moduleContainer, const char ** hotfixRepos,
-    const char * install_root, const char * platformModule, bool updateOnly, bool debugSolver, bool applyObsoletes)
+    const char * install_root, const char * platformModule, bool updateOnly, bool debugSolver, bool applyObsoletes,
+    std::vector<libdnf::ModuleFilteringPhase> * phases)
 {
+    ModuleFilteringStats stats(phases);
     if (!updateOnly) {
         if (!install_root) {
             throw std::runtime_error("Installroot not provided");
@@ -2580,7 +3582,7 @@ std::pair<std::vector<std::vector<std::string>>, libdnf::ModulePackageContainer:
                 install_root, dnf_sack_get_arch(sack));
             moduleContainer = priv->moduleContainer;
         }
-        readModuleMetadataFromRepo(sack, moduleContainer, platformModule);
+        readModuleMetadataFromRepo(sack, moduleContainer, platformModule, stats);
         moduleContainer->addDefaultsFromDisk();
 
         try {
@@ -2589,6 +3591,7 @@ std::pair<std::vector<std::vector<std::string>>, libdnf::ModulePackageContainer:
             auto logger(libdnf::Log::getLogger());
             logger->debug(tfm::format(_("No module defaults found: %s"), exception.what()));
         }
+        stats.record("defaults", 0);
     }
 
     if (!moduleContainer) {
@@ -2597,9 +3600,19 @@ std::pair<std::vector<std::vector<std::string>>, libdnf::ModulePackageContainer:
 
     if (applyObsoletes) {
         moduleContainer->applyObsoletes();
+        stats.record("obsoletes", 0);
     }
     auto ret = moduleContainer->resolveActiveModulePackages(debugSolver);
+    if (stats.enabled()) {
+        std::size_t activeCount = 0;
+        for (auto module : moduleContainer->getModulePackages()) {
+            if (moduleContainer->isModuleActive(module)) {
+                ++activeCount;
+            }
+        }
+        stats.record("resolve", activeCount);
+    }
 
-    setModuleExcludes(sack, hotfixRepos, *moduleContainer);
+    setModuleExcludes(sack, hotfixRepos, *moduleContainer, stats);
     return ret;
 }
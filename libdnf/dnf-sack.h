@@ -72,6 +72,8 @@ typedef enum {
  * @DNF_SACK_LOAD_FLAG_USE_PRESTO:              Use presto deltas metadata
  * @DNF_SACK_LOAD_FLAG_USE_UPDATEINFO:          Use updateinfo metadata
  * @DNF_SACK_LOAD_FLAG_USE_OTHER:               Use other metadata
+ * @DNF_SACK_LOAD_FLAG_LAZY_EXTENSIONS:         Only register filelists, other and presto
+ *                                              metadata, load them when first needed
  *
  * Flags to use when loading from the sack.
  **/
@@ -82,10 +84,25 @@ typedef enum {
     DNF_SACK_LOAD_FLAG_USE_PRESTO           = 1 << 2,
     DNF_SACK_LOAD_FLAG_USE_UPDATEINFO       = 1 << 3,
     DNF_SACK_LOAD_FLAG_USE_OTHER            = 1 << 4,
+    DNF_SACK_LOAD_FLAG_LAZY_EXTENSIONS      = 1 << 5,
     /*< private >*/
     DNF_SACK_LOAD_FLAG_LAST
 } DnfSackLoadFlags;
 
+/**
+ * DnfSackCacheFsyncPolicy:
+ * @DNF_SACK_CACHE_FSYNC_NONE:                  Leave flushing of the solv caches to the kernel
+ * @DNF_SACK_CACHE_FSYNC_FILE:                  Sync every solv cache before renaming it in place
+ * @DNF_SACK_CACHE_FSYNC_FULL:                  Also sync the cache directory after the rename
+ *
+ * How the solv caches are made durable.
+ **/
+typedef enum {
+    DNF_SACK_CACHE_FSYNC_NONE,
+    DNF_SACK_CACHE_FSYNC_FILE,
+    DNF_SACK_CACHE_FSYNC_FULL
+} DnfSackCacheFsyncPolicy;
+
 DnfSack     *dnf_sack_new                   (void);
 
 void         dnf_sack_set_cachedir          (DnfSack        *sack,
@@ -101,6 +118,12 @@ void         dnf_sack_set_allow_vendor_change(DnfSack       *sack,
 gboolean     dnf_sack_get_allow_vendor_change(DnfSack       *sack);
 void         dnf_sack_set_rootdir           (DnfSack        *sack,
                                              const gchar    *value);
+void         dnf_sack_set_async_cache_writes(DnfSack        *sack,
+                                             gboolean        async_writes);
+void         dnf_sack_set_cache_fsync_policy(DnfSack        *sack,
+                                             DnfSackCacheFsyncPolicy policy);
+gboolean     dnf_sack_wait_for_cache_writes (DnfSack        *sack,
+                                             GError        **error);
 gboolean     dnf_sack_setup                 (DnfSack        *sack,
                                              int             flags,
                                              GError        **error);
@@ -183,6 +206,7 @@ void dnf_sack_filter_modules(DnfSack *sack, GPtrArray *repos, const char *instal
  * @DNF_SACK_ADD_FLAG_REMOTE:                   Use remote repos
  * @DNF_SACK_ADD_FLAG_UNAVAILABLE:              Add repos that are unavailable
  * @DNF_SACK_ADD_FLAG_OTHER:                    Add the other
+ * @DNF_SACK_ADD_FLAG_LAZY_EXTENSIONS:          Load filelists and other only when needed
  *
  * Flags to control repo loading into the sack.
  **/
@@ -193,6 +217,7 @@ typedef enum {
         DNF_SACK_ADD_FLAG_REMOTE                = 1 << 2,
         DNF_SACK_ADD_FLAG_UNAVAILABLE           = 1 << 3,
         DNF_SACK_ADD_FLAG_OTHER                 = 1 << 4,
+        DNF_SACK_ADD_FLAG_LAZY_EXTENSIONS       = 1 << 5,
         /*< private >*/
         DNF_SACK_ADD_FLAG_LAST
 } DnfSackAddFlags;
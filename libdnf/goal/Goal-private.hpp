@@ -25,6 +25,10 @@
 #include "IdQueue.hpp"
 #include "../sack/packageset.hpp"
 
+#include <map>
+#include <unordered_map>
+#include <vector>
+
 namespace libdnf {
 
 class Goal::Impl {
@@ -45,13 +49,48 @@ private:
     std::unique_ptr<PackageSet> protectedPkgs;
     bool protect_running_kernel{true};
     std::unique_ptr<PackageSet> removalOfProtected;
+    bool profiling{false};
+    std::vector<Goal::ProfilePhase> profile;
+
+    /// What the package rules of a solver depend on, a solver is reused for the same state
+    struct SolverState {
+        guint providesGeneration{0};
+        int nsolvables{0};
+        Id installedRepo{0};
+        int installedEnd{0};
+        int vendorChange{0};
+        int ignoreRecommended{0};
+        /// SOLVER_MULTIVERSION elements of the job
+        std::vector<Id> multiversion;
+        /// copy of pool->considered, empty without excludes
+        std::vector<unsigned char> considered;
+
+        bool operator==(const SolverState & other) const;
+    };
+    SolverState solverState;
+
+    /// Steps of the transaction classified in one pass, dropped with the transaction
+    struct TransactionSteps {
+        explicit TransactionSteps(DnfSack * sack) : obsoleted(sack) {}
+        /// by transaction_type() showing the active side of all changes
+        std::map<Id, PackageSet> byType;
+        /// by transaction_type() showing the obsoleted packages
+        PackageSet obsoleted;
+        /// transaction_all_obs_pkgs() of every step
+        std::unordered_map<Id, std::vector<Id>> obsoletedBy;
+    };
+    std::unique_ptr<TransactionSteps> transactionSteps;
 
+    const TransactionSteps & classifyTransaction();
     PackageSet listResults(Id type_filter1, Id type_filter2);
     void allowUninstallAllButProtected(Queue *job, DnfGoalActions flags);
     std::unique_ptr<IdQueue> constructJob(DnfGoalActions flags);
     bool solve(Queue *job, DnfGoalActions flags);
-    Solver * initSolver();
+    bool solvePrepared(Queue *job, DnfGoalActions flags);
+    Solver * initSolver(Queue *job, DnfGoalActions flags);
     int limitInstallonlyPackages(Solver *solv, Queue *job);
+    void recordSolverSizes(std::map<std::string, long> & sizes);
+    std::vector<Goal::ProblemRule> problemRules(unsigned i);
     std::unique_ptr<IdQueue> conflictPkgs(unsigned i);
     std::unique_ptr<IdQueue> brokenDependencyPkgs(unsigned i);
     Id protectedRunningKernel();
@@ -19,9 +19,16 @@
  */
 
 #include <assert.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <map>
+#include <set>
+#include <thread>
+#include <tuple>
 #include <vector>
 #include <numeric>
+#include <time.h>
 
 extern "C" {
 #include <solv/evr.h>
@@ -68,6 +75,35 @@ std::string moduleSolvid2str(Pool * pool, Id source)
     return ss.str();
 }
 
+/// Measures one phase of Goal::run(), the phase starts with the construction. The clocks are
+/// only read when the timer is enabled, record() may only be called then.
+class ProfileTimer {
+public:
+    explicit ProfileTimer(bool enabled)
+    : wall(enabled ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point())
+    , cpu(enabled ? threadCpuSeconds() : 0) {}
+
+    void record(std::vector<libdnf::Goal::ProfilePhase> & profile, const char * phase,
+                std::map<std::string, long> && sizes = {}) const
+    {
+        double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall).count();
+        profile.push_back({phase, wallSeconds, threadCpuSeconds() - cpu, std::move(sizes)});
+    }
+
+private:
+    // the goals of Goal::runBatch() are solved in several threads
+    static double threadCpuSeconds()
+    {
+        struct timespec ts;
+        if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+            return 0;
+        return ts.tv_sec + ts.tv_nsec / 1e9;
+    }
+
+    std::chrono::steady_clock::time_point wall;
+    double cpu;
+};
+
 }
 
 namespace libdnf {
@@ -140,85 +176,183 @@ static const std::map<int, const char *> MODULE_PROBLEMS_DICT = {
     {RULE_YUMOBS, M_("both module %s and %s obsolete %s")}
 };
 
-static std::string
-libdnf_problemruleinfo2str(libdnf::PackageSet * modularExclude, Solver *solv, SolverRuleinfo type, Id source, Id target,
-    Id dep, bool pkgs)
+namespace {
+
+/**
+* @brief Renders problem rules to strings.
+*
+* The pool strings of the solvables and dependencies are looked up once by prepare(), which
+* uses the pool temporary space and is not thread-safe. Prepared rules are then rendered by
+* format(), which only reads and may be called concurrently.
+*/
+class ProblemRuleFormatter {
+public:
+    ProblemRuleFormatter(Solver * solv, PackageSet * modularExclude, bool pkgs)
+    : solv(solv), pool(solv->pool), modularExclude(modularExclude), pkgs(pkgs) {}
+
+    void prepare(const Goal::ProblemRule & rule);
+    std::string format(const Goal::ProblemRule & rule) const;
+
+private:
+    const char * solvable(Id id) const { return solvables.at(id).c_str(); }
+    const char * dep(Id id) const { return deps.at(id).c_str(); }
+
+    Solver * solv;
+    Pool * pool;
+    PackageSet * modularExclude;
+    bool pkgs;
+    std::unordered_map<Id, std::string> solvables;
+    std::unordered_map<Id, std::string> deps;
+    /// rules of types without own message, rendered by libsolv
+    std::map<std::tuple<int, Id, Id, Id>, std::string> others;
+};
+
+void
+ProblemRuleFormatter::prepare(const Goal::ProblemRule & rule)
 {
-    const std::map<int, const char *> & problemDict = pkgs ? PKG_PROBLEMS_DICT : MODULE_PROBLEMS_DICT;
+    bool source = false;
+    bool target = false;
+    bool withDep = false;
+    switch (rule.type) {
+        case SOLVER_RULE_DISTUPGRADE:
+        case SOLVER_RULE_INFARCH:
+        case SOLVER_RULE_UPDATE:
+        case SOLVER_RULE_PKG_NOT_INSTALLABLE:
+            source = true;
+            break;
+        case SOLVER_RULE_JOB:
+        case SOLVER_RULE_JOB_UNSUPPORTED:
+        case SOLVER_RULE_PKG:
+            break;
+        case SOLVER_RULE_JOB_NOTHING_PROVIDES_DEP:
+        case SOLVER_RULE_JOB_UNKNOWN_PACKAGE:
+        case SOLVER_RULE_JOB_PROVIDED_BY_SYSTEM:
+            withDep = true;
+            break;
+        case SOLVER_RULE_BEST:
+            source = rule.source > 0;
+            break;
+        case SOLVER_RULE_PKG_SAME_NAME:
+            source = target = true;
+            break;
+        case SOLVER_RULE_PKG_NOTHING_PROVIDES_DEP:
+        case SOLVER_RULE_PKG_REQUIRES:
+        case SOLVER_RULE_PKG_SELF_CONFLICT:
+            source = withDep = true;
+            break;
+        case SOLVER_RULE_PKG_CONFLICTS:
+        case SOLVER_RULE_PKG_OBSOLETES:
+        case SOLVER_RULE_PKG_INSTALLED_OBSOLETES:
+        case SOLVER_RULE_PKG_IMPLICIT_OBSOLETES:
+        case SOLVER_RULE_YUMOBS:
+            source = target = withDep = true;
+            break;
+        default:
+            others.emplace(std::make_tuple(rule.type, rule.source, rule.target, rule.dep),
+                           solver_problemruleinfo2str(solv, static_cast<SolverRuleinfo>(rule.type),
+                                                      rule.source, rule.target, rule.dep));
+            return;
+    }
+
     const auto solvid2str = pkgs ? pkgSolvid2str : moduleSolvid2str;
+    if (source && solvables.find(rule.source) == solvables.end())
+        solvables.emplace(rule.source, solvid2str(pool, rule.source));
+    if (target && solvables.find(rule.target) == solvables.end())
+        solvables.emplace(rule.target, solvid2str(pool, rule.target));
+    if (withDep && deps.find(rule.dep) == deps.end())
+        deps.emplace(rule.dep, pool_dep2str(pool, rule.dep));
+}
 
-    Pool * const pool = solv->pool;
+std::string
+ProblemRuleFormatter::format(const Goal::ProblemRule & rule) const
+{
+    const std::map<int, const char *> & problemDict = pkgs ? PKG_PROBLEMS_DICT : MODULE_PROBLEMS_DICT;
+    Id source = rule.source;
+    Id target = rule.target;
     Solvable *ss;
-    switch (type) {
+    switch (rule.type) {
         case SOLVER_RULE_DISTUPGRADE:
-            return solvid2str(pool, source) + TM_(problemDict.at(RULE_DISTUPGRADE), 1);
+            return solvable(source) + std::string(TM_(problemDict.at(RULE_DISTUPGRADE), 1));
         case SOLVER_RULE_INFARCH:
-            return solvid2str(pool, source) + TM_(problemDict.at(RULE_INFARCH), 1);
+            return solvable(source) + std::string(TM_(problemDict.at(RULE_INFARCH), 1));
         case SOLVER_RULE_UPDATE:
-            return std::string(TM_(problemDict.at(RULE_UPDATE), 1)) + solvid2str(pool, source);
+            return std::string(TM_(problemDict.at(RULE_UPDATE), 1)) + solvable(source);
         case SOLVER_RULE_JOB:
             return std::string(TM_(problemDict.at(RULE_JOB), 1));
         case SOLVER_RULE_JOB_UNSUPPORTED:
             return std::string(TM_(problemDict.at(RULE_JOB_UNSUPPORTED), 1));
         case SOLVER_RULE_JOB_NOTHING_PROVIDES_DEP:
-            return std::string(TM_(problemDict.at(RULE_JOB_NOTHING_PROVIDES_DEP), 1)) + pool_dep2str(pool, dep);
+            return std::string(TM_(problemDict.at(RULE_JOB_NOTHING_PROVIDES_DEP), 1)) + dep(rule.dep);
         case SOLVER_RULE_JOB_UNKNOWN_PACKAGE:
-            return tfm::format(TM_(problemDict.at(RULE_JOB_UNKNOWN_PACKAGE), 1), pool_dep2str(pool, dep));
+            return tfm::format(TM_(problemDict.at(RULE_JOB_UNKNOWN_PACKAGE), 1), dep(rule.dep));
         case SOLVER_RULE_JOB_PROVIDED_BY_SYSTEM:
-            return std::string(pool_dep2str(pool, dep)) + TM_(problemDict.at(RULE_JOB_PROVIDED_BY_SYSTEM), 1);
+            return std::string(dep(rule.dep)) + TM_(problemDict.at(RULE_JOB_PROVIDED_BY_SYSTEM), 1);
         case SOLVER_RULE_PKG:
             return std::string(TM_(problemDict.at(RULE_PKG), 1));
         case SOLVER_RULE_BEST:
             if (source > 0)
-                return std::string(TM_(problemDict.at(RULE_BEST_1), 1)) + solvid2str(pool, source);
+                return std::string(TM_(problemDict.at(RULE_BEST_1), 1)) + solvable(source);
             return std::string(TM_(problemDict.at(RULE_BEST_2), 1));
         case SOLVER_RULE_PKG_NOT_INSTALLABLE:
             ss = pool->solvables + source;
             if (pool_disabled_solvable(pool, ss)) {
                 if (modularExclude && modularExclude->has(source)) {
-                    return tfm::format(TM_(problemDict.at(RULE_PKG_NOT_INSTALLABLE_1), 1), solvid2str(pool, source).c_str());
+                    return tfm::format(TM_(problemDict.at(RULE_PKG_NOT_INSTALLABLE_1), 1), solvable(source));
                 } else {
-                    return tfm::format(TM_(problemDict.at(RULE_PKG_NOT_INSTALLABLE_4), 1), solvid2str(pool, source).c_str());
+                    return tfm::format(TM_(problemDict.at(RULE_PKG_NOT_INSTALLABLE_4), 1), solvable(source));
                 }
             }
             if (ss->arch && ss->arch != ARCH_SRC && ss->arch != ARCH_NOSRC &&
                 pool->id2arch && (ss->arch > pool->lastarch || !pool->id2arch[ss->arch]))
-                return tfm::format(TM_(problemDict.at(RULE_PKG_NOT_INSTALLABLE_2), 1), solvid2str(pool, source).c_str());
-            return tfm::format(TM_(problemDict.at(RULE_PKG_NOT_INSTALLABLE_3), 1), solvid2str(pool, source).c_str());
+                return tfm::format(TM_(problemDict.at(RULE_PKG_NOT_INSTALLABLE_2), 1), solvable(source));
+            return tfm::format(TM_(problemDict.at(RULE_PKG_NOT_INSTALLABLE_3), 1), solvable(source));
         case SOLVER_RULE_PKG_NOTHING_PROVIDES_DEP:
-            return tfm::format(TM_(problemDict.at(RULE_PKG_NOTHING_PROVIDES_DEP), 1), pool_dep2str(pool, dep),
-                               solvid2str(pool, source).c_str());
+            return tfm::format(TM_(problemDict.at(RULE_PKG_NOTHING_PROVIDES_DEP), 1), dep(rule.dep),
+                               solvable(source));
         case SOLVER_RULE_PKG_SAME_NAME:
-            return tfm::format(TM_(problemDict.at(RULE_PKG_SAME_NAME), 1), solvid2str(pool, source).c_str(),
-                               solvid2str(pool, target).c_str());
+            return tfm::format(TM_(problemDict.at(RULE_PKG_SAME_NAME), 1), solvable(source),
+                               solvable(target));
         case SOLVER_RULE_PKG_CONFLICTS:
-            return tfm::format(TM_(problemDict.at(RULE_PKG_CONFLICTS), 1), solvid2str(pool, source).c_str(),
-                               pool_dep2str(pool, dep), solvid2str(pool, target).c_str());
+            return tfm::format(TM_(problemDict.at(RULE_PKG_CONFLICTS), 1), solvable(source),
+                               dep(rule.dep), solvable(target));
         case SOLVER_RULE_PKG_OBSOLETES:
-            return tfm::format(TM_(problemDict.at(RULE_PKG_OBSOLETES), 1), solvid2str(pool, source).c_str(),
-                               pool_dep2str(pool, dep), solvid2str(pool, target).c_str());
+            return tfm::format(TM_(problemDict.at(RULE_PKG_OBSOLETES), 1), solvable(source),
+                               dep(rule.dep), solvable(target));
         case SOLVER_RULE_PKG_INSTALLED_OBSOLETES:
             return tfm::format(TM_(problemDict.at(RULE_PKG_INSTALLED_OBSOLETES), 1),
-                               solvid2str(pool, source).c_str(), pool_dep2str(pool, dep),
-                               solvid2str(pool, target).c_str());
+                               solvable(source), dep(rule.dep), solvable(target));
         case SOLVER_RULE_PKG_IMPLICIT_OBSOLETES:
             return tfm::format(TM_(problemDict.at(RULE_PKG_IMPLICIT_OBSOLETES), 1),
-                               solvid2str(pool, source).c_str(), pool_dep2str(pool, dep),
-                               solvid2str(pool, target).c_str());
+                               solvable(source), dep(rule.dep), solvable(target));
         case SOLVER_RULE_PKG_REQUIRES:
-            return tfm::format(TM_(problemDict.at(RULE_PKG_REQUIRES), 1), solvid2str(pool, source).c_str(),
-                               pool_dep2str(pool, dep));
+            return tfm::format(TM_(problemDict.at(RULE_PKG_REQUIRES), 1), solvable(source),
+                               dep(rule.dep));
         case SOLVER_RULE_PKG_SELF_CONFLICT:
-            return tfm::format(TM_(problemDict.at(RULE_PKG_SELF_CONFLICT), 1), solvid2str(pool, source).c_str(),
-                               pool_dep2str(pool, dep));
+            return tfm::format(TM_(problemDict.at(RULE_PKG_SELF_CONFLICT), 1), solvable(source),
+                               dep(rule.dep));
         case SOLVER_RULE_YUMOBS:
-            return tfm::format(TM_(problemDict.at(RULE_YUMOBS), 1), solvid2str(pool, source).c_str(),
-                               solvid2str(pool, target).c_str(), pool_dep2str(pool, dep));
+            return tfm::format(TM_(problemDict.at(RULE_YUMOBS), 1), solvable(source),
+                               solvable(target), dep(rule.dep));
         default:
-            return solver_problemruleinfo2str(solv, type, source, target, dep);
+            return others.at(std::make_tuple(rule.type, rule.source, rule.target, rule.dep));
     }
 }
 
+/// Render the rules of a problem, equal messages are listed once
+std::vector<std::string>
+formatProblem(const ProblemRuleFormatter & formatter, const std::vector<Goal::ProblemRule> & rules)
+{
+    std::vector<std::string> output;
+    for (auto & rule : rules) {
+        auto problem_str = formatter.format(rule);
+        if (std::find(output.begin(), output.end(), problem_str) == output.end())
+            output.push_back(std::move(problem_str));
+    }
+    return output;
+}
+
+}
+
 static void
 packageToJob(DnfPackage * package, Queue * job, int solver_action)
 {
@@ -646,6 +780,7 @@ Goal::Impl::Impl(const Goal::Impl & goal_src)
     if (goal_src.removalOfProtected) {
         removalOfProtected.reset(new PackageSet(*goal_src.removalOfProtected.get()));
     }
+    profiling = goal_src.profiling;
 }
 
 Goal::Impl::Impl(DnfSack *sack)
@@ -722,6 +857,24 @@ Goal::set_protect_running_kernel(bool value)
     pImpl->protect_running_kernel = value;
 }
 
+bool
+Goal::getProfiling() const noexcept
+{
+    return pImpl->profiling;
+}
+
+void
+Goal::setProfiling(bool value)
+{
+    pImpl->profiling = value;
+}
+
+const std::vector<Goal::ProfilePhase> &
+Goal::getProfile() const noexcept
+{
+    return pImpl->profile;
+}
+
 void
 Goal::setProtected(const PackageSet & pset)
 {
@@ -970,12 +1123,81 @@ Goal::jobLength()
 bool
 Goal::run(DnfGoalActions flags)
 {
+    pImpl->profile.clear();
+    ProfileTimer timer(pImpl->profiling);
     auto job = pImpl->constructJob(flags);
+    if (pImpl->profiling)
+        timer.record(pImpl->profile, "construct_job", {{"job_size", job->size() / 2}});
     pImpl->actions = static_cast<DnfGoalActions>(pImpl->actions | flags);
     int ret = pImpl->solve(job->getQueue(), flags);
     return ret;
 }
 
+std::vector<bool>
+Goal::runBatch(const std::vector<Goal *> & goals, DnfGoalActions flags)
+{
+    if (goals.empty())
+        return {};
+    DnfSack * sack = goals[0]->pImpl->sack;
+    for (auto goal : goals) {
+        if (goal->pImpl->sack != sack)
+            throw Goal::Error(_("all goals of a batch must use the same sack"), DNF_ERROR_INTERNAL_ERROR);
+    }
+
+    // everything which modifies the sack is done here, the solvers only read it
+    dnf_sack_prepare_concurrent_solves(sack);
+    std::vector<std::unique_ptr<IdQueue>> jobs;
+    jobs.reserve(goals.size());
+    for (auto goal : goals) {
+        goal->pImpl->profile.clear();
+        ProfileTimer timer(goal->pImpl->profiling);
+        jobs.push_back(goal->pImpl->constructJob(flags));
+        if (goal->pImpl->profiling)
+            timer.record(goal->pImpl->profile, "construct_job", {{"job_size", jobs.back()->size() / 2}});
+        goal->pImpl->actions = static_cast<DnfGoalActions>(goal->pImpl->actions | flags);
+        auto job = jobs.back()->getQueue();
+        for (int i = 0; i < job->count; i += 2) {
+            auto select = job->elements[i] & SOLVER_SELECTMASK;
+            if (select == SOLVER_SOLVABLE_NAME || select == SOLVER_SOLVABLE_PROVIDES)
+                dnf_sack_prepare_whatprovides(sack, job->elements[i + 1]);
+        }
+    }
+
+    // the debug output uses the pool temporary space
+    Pool * pool = dnf_sack_get_pool(sack);
+    int debugmask = pool->debugmask;
+    pool_setdebugmask(pool, 0);
+
+    std::vector<char> results(goals.size());
+    std::vector<std::exception_ptr> failures(goals.size());
+    std::atomic<std::size_t> next{0};
+    auto worker = [&]() {
+        for (auto i = next++; i < goals.size(); i = next++) {
+            try {
+                results[i] = goals[i]->pImpl->solvePrepared(jobs[i]->getQueue(), flags);
+            } catch (...) {
+                failures[i] = std::current_exception();
+            }
+        }
+    };
+
+    std::size_t nthreads = std::min<std::size_t>(goals.size(),
+                                                 std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<std::thread> threads;
+    for (std::size_t i = 1; i < nthreads; ++i)
+        threads.emplace_back(worker);
+    worker();
+    for (auto & thread : threads)
+        thread.join();
+    pool_setdebugmask(pool, debugmask);
+
+    for (auto & failure : failures) {
+        if (failure)
+            std::rethrow_exception(failure);
+    }
+    return std::vector<bool>(results.begin(), results.end());
+}
+
 int
 Goal::countProblems()
 {
@@ -1037,36 +1259,62 @@ std::vector<std::vector<std::string>> Goal::describeAllProblemRules(bool pkgs)
 {
     std::vector<std::vector<std::string>> output;
     int count_problems = countProblems();
-    for (int i = 0; i < count_problems; i++) {
-        auto problemList = describeProblemRules(i, pkgs);
-        if (problemList.empty()) {
-            continue;
-        }
-        bool unique = true;
-        for (auto & problemsSaved: output) {
-            if (problemList.size() != problemsSaved.size()) {
-                continue;
-            }
-            bool presentElement = false;
-            for (auto & problem: problemList) {
-                presentElement = false;
-                for (auto & problemSaved: problemsSaved) {
-                    if (problemSaved == problem) {
-                        presentElement = true;
-                        break;
-                    }
-                }
-                if (!presentElement) {
-                    break;
-                }
-            }
-            if (presentElement) {
-                unique = false;
+    if (count_problems == 0)
+        return output;
+    // the removal of protected packages replaces the description of every problem
+    auto problem = pImpl->describeProtectedRemoval();
+    if (!problem.empty()) {
+        output.push_back({std::move(problem)});
+        return output;
+    }
+
+    // rules and pool strings are collected serially, only the rendering runs in parallel
+    auto solv = pImpl->solv;
+    std::unique_ptr<libdnf::PackageSet> modularExcludes(dnf_sack_get_module_excludes(pImpl->sack));
+    ProblemRuleFormatter formatter(solv, modularExcludes.get(), pkgs);
+    std::vector<std::vector<ProblemRule>> rules(solver_problem_count(solv));
+    for (unsigned i = 0; i < rules.size(); ++i) {
+        rules[i] = pImpl->problemRules(i);
+        for (auto & rule : rules[i])
+            formatter.prepare(rule);
+    }
+
+    std::vector<std::vector<std::string>> rendered(rules.size());
+    std::vector<std::exception_ptr> failures(rules.size());
+    std::atomic<std::size_t> next{0};
+    auto worker = [&]() {
+        for (auto i = next++; i < rules.size(); i = next++) {
+            try {
+                rendered[i] = formatProblem(formatter, rules[i]);
+            } catch (...) {
+                failures[i] = std::current_exception();
             }
         }
-        if (unique) {
-            output.push_back(problemList);
-        }
+    };
+    // threads pay off only for the long lists of a broken repository
+    constexpr std::size_t PROBLEMS_PER_THREAD = 64;
+    std::size_t nthreads = std::min<std::size_t>(rules.size() / PROBLEMS_PER_THREAD + 1,
+                                                 std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<std::thread> threads;
+    for (std::size_t i = 1; i < nthreads; ++i)
+        threads.emplace_back(worker);
+    worker();
+    for (auto & thread : threads)
+        thread.join();
+    for (auto & failure : failures) {
+        if (failure)
+            std::rethrow_exception(failure);
+    }
+
+    // problems with the same set of messages are listed once
+    std::set<std::vector<std::string>> seen;
+    for (auto & problemList : rendered) {
+        if (problemList.empty())
+            continue;
+        auto sorted = problemList;
+        std::sort(sorted.begin(), sorted.end());
+        if (seen.insert(std::move(sorted)).second)
+            output.push_back(std::move(problemList));
     }
     return output;
 }
@@ -1084,45 +1332,29 @@ Goal::describeProblemRules(unsigned i, bool pkgs)
         output.push_back(std::move(problem));
         return output;
     }
-    auto solv = pImpl->solv;
-
-    Id rid, source, target, dep;
-    SolverRuleinfo type;
-    int j;
-    bool unique;
+    auto rules = getProblemRules(i);
+    std::unique_ptr<libdnf::PackageSet> modularExcludes(dnf_sack_get_module_excludes(pImpl->sack));
+    ProblemRuleFormatter formatter(pImpl->solv, modularExcludes.get(), pkgs);
+    for (auto & rule : rules)
+        formatter.prepare(rule);
+    return formatProblem(formatter, rules);
+}
 
-    if (i >= solver_problem_count(solv))
-        return output;
+std::vector<Goal::ProblemRule>
+Goal::getProblemRules(unsigned i)
+{
+    if (!pImpl->solv || i >= solver_problem_count(pImpl->solv))
+        return {};
+    return pImpl->problemRules(i);
+}
 
-    IdQueue pq;
-    IdQueue rq;
-    // this libsolv interface indexes from 1 (we do from 0), so:
-    solver_findallproblemrules(solv, i+1, pq.getQueue());
+std::string
+Goal::describeProblemRule(const ProblemRule & rule, bool pkgs)
+{
     std::unique_ptr<libdnf::PackageSet> modularExcludes(dnf_sack_get_module_excludes(pImpl->sack));
-    for (j = 0; j < pq.size(); j++) {
-        rid = pq[j];
-        if (solver_allruleinfos(solv, rid, rq.getQueue())) {
-            for (int ir = 0; ir < rq.size(); ir+=4) {
-                type = static_cast<SolverRuleinfo>(rq[ir]);
-                source = rq[ir + 1];
-                target = rq[ir + 2];
-                dep = rq[ir + 3];
-                auto problem_str = libdnf_problemruleinfo2str(modularExcludes.get(), solv, type,
-                                                              source, target, dep, pkgs);
-                unique = true;
-                for (auto & item: output) {
-                    if (problem_str == item) {
-                        unique = false;
-                        break;
-                    }
-                }
-                if (unique) {
-                    output.push_back(problem_str);
-                }
-            }
-        }
-    }
-    return output;
+    ProblemRuleFormatter formatter(pImpl->solv, modularExcludes.get(), pkgs);
+    formatter.prepare(rule);
+    return formatter.format(rule);
 }
 
 /**
@@ -1172,6 +1404,47 @@ Goal::writeDebugdata(const char *dir)
     }
 }
 
+/**
+ * Classify the steps of the transaction.
+ *
+ * All list* methods are answered from one pass over the steps, it is done on the first call
+ * after the goal is solved.
+ */
+const Goal::Impl::TransactionSteps &
+Goal::Impl::classifyTransaction()
+{
+    if (transactionSteps)
+        return *transactionSteps;
+
+    std::unique_ptr<TransactionSteps> steps(new TransactionSteps(sack));
+    const int common_mode = SOLVER_TRANSACTION_SHOW_OBSOLETES |
+        SOLVER_TRANSACTION_CHANGE_IS_REINSTALL;
+    IdQueue obsoletes;
+
+    for (int i = 0; i < trans->steps.count; ++i) {
+        Id p = trans->steps.elements[i];
+
+        Id type = transaction_type(trans, p, common_mode |
+                                   SOLVER_TRANSACTION_SHOW_ACTIVE|
+                                   SOLVER_TRANSACTION_SHOW_ALL);
+        auto bucket = steps->byType.find(type);
+        if (bucket == steps->byType.end())
+            bucket = steps->byType.emplace(type, PackageSet(sack)).first;
+        bucket->second.set(p);
+
+        if (transaction_type(trans, p, common_mode) == SOLVER_TRANSACTION_OBSOLETED)
+            steps->obsoleted.set(p);
+
+        // for an installed package the packages obsoleting it
+        transaction_all_obs_pkgs(trans, p, obsoletes.getQueue());
+        if (obsoletes.size())
+            steps->obsoletedBy.emplace(p, std::vector<Id>(obsoletes.data(),
+                                                          obsoletes.data() + obsoletes.size()));
+    }
+    transactionSteps = std::move(steps);
+    return *transactionSteps;
+}
+
 PackageSet
 Goal::Impl::listResults(Id type_filter1, Id type_filter2)
 {
@@ -1186,27 +1459,17 @@ Goal::Impl::listResults(Id type_filter1, Id type_filter2)
         throw Goal::Error(_("no solution possible"), DNF_ERROR_NO_SOLUTION);
     }
 
-    PackageSet plist(sack);
-    const int common_mode = SOLVER_TRANSACTION_SHOW_OBSOLETES |
-        SOLVER_TRANSACTION_CHANGE_IS_REINSTALL;
-
-    for (int i = 0; i < trans->steps.count; ++i) {
-        Id p = trans->steps.elements[i];
-        Id type;
-
-        switch (type_filter1) {
-        case SOLVER_TRANSACTION_OBSOLETED:
-            type =  transaction_type(trans, p, common_mode);
-            break;
-        default:
-            type  = transaction_type(trans, p, common_mode |
-                                     SOLVER_TRANSACTION_SHOW_ACTIVE|
-                                     SOLVER_TRANSACTION_SHOW_ALL);
-            break;
-        }
+    auto & steps = classifyTransaction();
+    if (type_filter1 == SOLVER_TRANSACTION_OBSOLETED)
+        return steps.obsoleted;
 
-        if (type == type_filter1 || (type_filter2 && type == type_filter2))
-            plist.set(p);
+    PackageSet plist(sack);
+    for (Id type : {type_filter1, type_filter2}) {
+        if (!type)
+            continue;
+        auto bucket = steps.byType.find(type);
+        if (bucket != steps.byType.end())
+            plist += bucket->second;
     }
     return plist;
 }
@@ -1274,18 +1537,26 @@ Goal::listDowngrades()
 PackageSet
 Goal::listObsoletedByPackage(DnfPackage *pkg)
 {
-    auto trans = pImpl->trans;
-    IdQueue obsoletes;
     PackageSet pset(pImpl->sack);
 
-    assert(trans);
+    assert(pImpl->trans);
 
-    transaction_all_obs_pkgs(trans, dnf_package_get_id(pkg), obsoletes.getQueue());
-    queue2pset(obsoletes, &pset);
+    auto & obsoletedBy = pImpl->classifyTransaction().obsoletedBy;
+    auto obsoletes = obsoletedBy.find(dnf_package_get_id(pkg));
+    if (obsoletes != obsoletedBy.end()) {
+        for (Id id : obsoletes->second)
+            pset.set(id);
+    }
 
     return pset;
 }
 
+::Transaction *
+goalTransaction(Goal & goal)
+{
+    return goal.pImpl->trans;
+}
+
 static std::string string_join(const std::vector<std::string> & src, const std::string & delim)
 {
     if (src.empty()) {
@@ -1382,18 +1653,58 @@ Goal::Impl::constructJob(DnfGoalActions flags)
     return job;
 }
 
+bool
+Goal::Impl::SolverState::operator==(const SolverState & other) const
+{
+    return providesGeneration == other.providesGeneration && nsolvables == other.nsolvables &&
+        installedRepo == other.installedRepo && installedEnd == other.installedEnd &&
+        vendorChange == other.vendorChange && ignoreRecommended == other.ignoreRecommended &&
+        multiversion == other.multiversion && considered == other.considered;
+}
+
+/**
+ * Returns the solver for the job.
+ *
+ * Libsolv keeps the package rules of a solver between solver_solve() calls and only adds
+ * rules for packages not covered yet. The solver of the previous run is therefore reused
+ * when nothing the package rules depend on changed.
+ */
 Solver *
-Goal::Impl::initSolver()
+Goal::Impl::initSolver(Queue *job, DnfGoalActions flags)
 {
     Pool *pool = dnf_sack_get_pool(sack);
+
+    SolverState state;
+    state.providesGeneration = dnf_sack_get_provides_generation(sack);
+    state.nsolvables = pool->nsolvables;
+    if (pool->installed) {
+        state.installedRepo = pool->installed->repoid;
+        state.installedEnd = pool->installed->end;
+    }
+    state.vendorChange = dnf_sack_get_allow_vendor_change(sack) ? 1 : 0;
+    state.ignoreRecommended = (DNF_IGNORE_WEAK_DEPS & flags) ? 1 : 0;
+    for (int i = 0; i < job->count; i += 2) {
+        if ((job->elements[i] & SOLVER_JOBMASK) == SOLVER_MULTIVERSION) {
+            state.multiversion.push_back(job->elements[i]);
+            state.multiversion.push_back(job->elements[i + 1]);
+        }
+    }
+    if (pool->considered)
+        state.considered.assign(pool->considered->map,
+                                pool->considered->map + pool->considered->size);
+
+    if (solv && state == solverState)
+        return solv;
+
     Solver *solvNew = solver_create(pool);
 
     if (solv)
         solver_free(solv);
     solv = solvNew;
+    solverState = std::move(state);
 
     /* vendor locking */
-    int vendor = dnf_sack_get_allow_vendor_change(sack) ? 1 : 0;
+    int vendor = solverState.vendorChange;
     solver_set_flag(solv, SOLVER_FLAG_ALLOW_VENDORCHANGE, vendor);
     solver_set_flag(solv, SOLVER_FLAG_DUP_ALLOW_VENDORCHANGE, vendor);
 
@@ -1468,15 +1779,62 @@ bool
 Goal::Impl::solve(Queue *job, DnfGoalActions flags)
 {
     /* apply the excludes */
+    ProfileTimer considerTimer(profiling);
     dnf_sack_recompute_considered(sack);
+    if (profiling) {
+        Pool * pool = dnf_sack_get_pool(sack);
+        long considered = pool->nsolvables;
+        if (pool->considered) {
+            considered = 0;
+            for (Id id = 0; id < pool->nsolvables; ++id)
+                considered += MAPTST(pool->considered, id) ? 1 : 0;
+        }
+        considerTimer.record(profile, "recompute_considered", {{"considered", considered}});
+    }
 
+    ProfileTimer providesTimer(profiling);
+    auto generation = dnf_sack_get_provides_generation(sack);
     dnf_sack_make_provides_ready(sack);
+    if (profiling)
+        providesTimer.record(profile, "make_provides_ready",
+                             {{"rebuilt", dnf_sack_get_provides_generation(sack) != generation ? 1 : 0}});
+    return solvePrepared(job, flags);
+}
+
+/// Add the sizes of the last solver_solve() to the profile phase
+void
+Goal::Impl::recordSolverSizes(std::map<std::string, long> & sizes)
+{
+    // the rule classes are ordered, the learnt rules are the last ones
+    long rules = 0;
+    long learntRules = 0;
+    for (Id rid = 1;; ++rid) {
+        auto ruleClass = solver_ruleclass(solv, rid);
+        if (ruleClass == SOLVER_RULE_UNKNOWN)
+            break;
+        ++rules;
+        if (ruleClass == SOLVER_RULE_LEARNT)
+            ++learntRules;
+    }
+    IdQueue decisions;
+    solver_get_decisionqueue(solv, decisions.getQueue());
+    sizes["rules"] = rules;
+    sizes["learnt_rules"] = learntRules;
+    sizes["decisions"] = decisions.size();
+    sizes["problems"] = solver_problem_count(solv);
+}
+
+/// Solve the job, the sack must be ready for depsolving
+bool
+Goal::Impl::solvePrepared(Queue *job, DnfGoalActions flags)
+{
+    transactionSteps.reset();
     if (trans) {
         transaction_free(trans);
         trans = NULL;
     }
 
-    Solver *solv = initSolver();
+    Solver *solv = initSolver(job, flags);
 
     /* Removal of SOLVER_WEAK to allow report errors*/
     if (DNF_IGNORE_WEAK & flags) {
@@ -1485,29 +1843,71 @@ Goal::Impl::solve(Queue *job, DnfGoalActions flags)
         }
     }
 
-    if (DNF_IGNORE_WEAK_DEPS & flags)
-        solver_set_flag(solv, SOLVER_FLAG_IGNORE_RECOMMENDED, 1);
+    /* set in every run, the solver may come from a previous one */
+    solver_set_flag(solv, SOLVER_FLAG_IGNORE_RECOMMENDED, solverState.ignoreRecommended);
+    solver_set_flag(solv, SOLVER_FLAG_ALLOW_DOWNGRADE, (DNF_ALLOW_DOWNGRADE & actions) ? 1 : 0);
 
-    if (DNF_ALLOW_DOWNGRADE & actions)
-        solver_set_flag(solv, SOLVER_FLAG_ALLOW_DOWNGRADE, 1);
-
-    if (solver_solve(solv, job))
+    ProfileTimer solveTimer(profiling);
+    int problems = solver_solve(solv, job);
+    if (profiling) {
+        std::map<std::string, long> sizes;
+        recordSolverSizes(sizes);
+        solveTimer.record(profile, "solver_solve", std::move(sizes));
+    }
+    if (problems)
         return true;
     // either allow solutions callback or installonlies, both at the same time
     // are not supported
+    ProfileTimer installonlyTimer(profiling);
     if (limitInstallonlyPackages(solv, job)) {
         // allow erasing non-installonly packages that depend on a kernel about
         // to be erased
         allowUninstallAllButProtected(job, DNF_ALLOW_UNINSTALL);
-        if (solver_solve(solv, job))
+        problems = solver_solve(solv, job);
+        if (profiling) {
+            std::map<std::string, long> sizes{{"resolved", 1}};
+            recordSolverSizes(sizes);
+            installonlyTimer.record(profile, "limit_installonly", std::move(sizes));
+        }
+        if (problems)
             return true;
+    } else if (profiling) {
+        installonlyTimer.record(profile, "limit_installonly", {{"resolved", 0}});
     }
-    trans = solver_create_transaction(solv);
 
-    if (protectedInRemovals())
-        return true;
+    ProfileTimer transactionTimer(profiling);
+    trans = solver_create_transaction(solv);
+    if (profiling)
+        transactionTimer.record(profile, "create_transaction", {{"steps", trans->steps.count}});
+
+    ProfileTimer protectedTimer(profiling);
+    bool removesProtected = protectedInRemovals();
+    if (profiling) {
+        long removals = removesProtected ? removalOfProtected->size() : 0;
+        protectedTimer.record(profile, "protected_in_removals", {{"removals", removals}});
+    }
+    return removesProtected;
+}
 
-    return false;
+/// Rule infos of all rules of the libsolv problem 'i', each distinct one once
+std::vector<Goal::ProblemRule>
+Goal::Impl::problemRules(unsigned i)
+{
+    std::vector<Goal::ProblemRule> rules;
+    IdQueue pq;
+    IdQueue rq;
+    // this libsolv interface indexes from 1 (we do from 0), so:
+    solver_findallproblemrules(solv, i+1, pq.getQueue());
+    for (int j = 0; j < pq.size(); j++) {
+        if (!solver_allruleinfos(solv, pq[j], rq.getQueue()))
+            continue;
+        for (int ir = 0; ir < rq.size(); ir += 4) {
+            Goal::ProblemRule rule{rq[ir], rq[ir + 1], rq[ir + 2], rq[ir + 3]};
+            if (std::find(rules.begin(), rules.end(), rule) == rules.end())
+                rules.push_back(rule);
+        }
+    }
+    return rules;
 }
 
 /**
@@ -21,10 +21,15 @@
 #ifndef __GOAL_HPP
 #define __GOAL_HPP
 
+#include <map>
 #include <memory>
 #include <stdexcept>
+#include <string>
 #include <vector>
 
+#include <solv/pooltypes.h>
+#include <solv/transaction.h>
+
 #include "../dnf-types.h"
 #include "../error.hpp"
 #include "../hy-goal.h"
@@ -42,6 +47,33 @@ public:
         int errCode;
     };
 
+    /// Time and sizes of one phase of run(), recorded when profiling is enabled
+    struct ProfilePhase {
+        /// construct_job, recompute_considered, make_provides_ready, solver_solve,
+        /// limit_installonly, create_transaction or protected_in_removals
+        std::string name;
+        double wallSeconds;
+        /// CPU time of the thread running the phase
+        double cpuSeconds;
+        /// e.g. job_size of construct_job or rules, learnt_rules and decisions of solver_solve
+        std::map<std::string, long> sizes;
+    };
+
+    /// Rule of a problem as reported by libsolv, see getProblemRules()
+    struct ProblemRule {
+        /// SolverRuleinfo
+        int type;
+        Id source;
+        Id target;
+        Id dep;
+
+        bool operator==(const ProblemRule & other) const noexcept
+        {
+            return type == other.type && source == other.source && target == other.target &&
+                dep == other.dep;
+        }
+    };
+
     Goal(DnfSack *sack);
     Goal(const Goal & goal_src);
     Goal(Goal && goal_src) = delete;
@@ -57,6 +89,12 @@ public:
     bool get_protect_running_kernel() const noexcept;
     void set_protect_running_kernel(bool value);
 
+    bool getProfiling() const noexcept;
+    /// Record the phases of every following run() or runBatch(), disabled by default
+    void setProfiling(bool value);
+    /// @return phases of the last run() which reached them, empty without profiling
+    const std::vector<ProfilePhase> & getProfile() const noexcept;
+
     void distupgrade();
     void distupgrade(DnfPackage *new_pkg);
 
@@ -116,6 +154,18 @@ public:
     /* resolving the goal */
     bool run(DnfGoalActions flags);
 
+    /**
+    * @brief Resolve independent goals of one sack concurrently, each goal with its own solver.
+    *
+    * The sack is prepared for depsolving once and must not be modified until the call returns.
+    * The transaction and the problems of every goal are then read from the goal as after run().
+    *
+    * @param goals goals using the same sack, otherwise Goal::Error is thrown
+    * @param flags flags passed to every goal
+    * @return for every goal the result of its run()
+    */
+    static std::vector<bool> runBatch(const std::vector<Goal *> & goals, DnfGoalActions flags);
+
     /* problems */
     int countProblems();
 
@@ -133,6 +183,19 @@ public:
     * @return char**
     */
     std::vector<std::string> describeProblemRules(unsigned i, bool pkgs);
+
+    /**
+    * @brief Rules of the problem 'i' without rendering them to strings, each distinct rule once.
+    *
+    * The removal of protected packages is not a libsolv problem and has no rules, it is only
+    * described by describeProblemRules().
+    *
+    * @param i index of problem
+    */
+    std::vector<ProblemRule> getProblemRules(unsigned i);
+
+    /// Render a rule of getProblemRules() as describeProblemRules() does
+    std::string describeProblemRule(const ProblemRule & rule, bool pkgs);
     int logDecisions();
     void writeDebugdata(const char *dir);
 
@@ -151,6 +214,7 @@ public:
     static std::string formatAllProblemRules(const std::vector<std::vector<std::string>> & problems);
 private:
     friend Query;
+    friend ::Transaction * goalTransaction(Goal & goal);
     class Impl;
     std::unique_ptr<Impl> pImpl;
 };
@@ -43,6 +43,9 @@ namespace libdnf {
 
 void sltrToJob(const HySelector sltr, Queue *job, int solver_action);
 
+/// @return transaction of the last successful run() of the goal, nullptr before
+::Transaction * goalTransaction(Goal & goal);
+
 }
 
 #endif // HY_GOAL_INTERNAL_H
@@ -25,7 +25,9 @@
 #include "hy-types.h"
 #include "sack/packageset.hpp"
 #include <array>
+#include <string>
 #include <utility>
+#include <vector>
 
 // Use 8 bytes for libsolv version (API: solv_toolversion)
 // to be future proof even though it currently is "1.2"
@@ -53,6 +55,7 @@ int solv_userdata_verify(const SolvUserdata *solv_userdata, const unsigned char
 int checksum_cmp(const unsigned char *cs1, const unsigned char *cs2);
 int checksum_fp(unsigned char *out, FILE *fp);
 int checksum_stat(unsigned char *out, FILE *fp);
+int checksum_strings(unsigned char *out, const std::vector<std::string> & strings);
 int checksumt_l2h(int type);
 const char *pool_checksum_str(Pool *pool, const unsigned char *chksum);
 
@@ -68,9 +71,11 @@ gboolean dnf_copy_file(const std::string & srcPath, const std::string & dstPath,
 gboolean dnf_copy_recursive(const std::string & srcPath, const std::string & dstPath, GError ** error);
 gboolean dnf_move_recursive(const gchar *src_dir, const gchar *dst_dir, GError **error);
 char *this_username(void);
+mode_t get_umask(void);
 
 /* misc utils */
 char *read_whole_file(const char *path);
+int is_primary_file(const char *fn);
 Id running_kernel(DnfSack *sack);
 
 /* libsolv utils */
@@ -85,6 +90,7 @@ int is_package(const Pool *pool, const Solvable *s);
 /* package version utils */
 unsigned long pool_get_epoch(Pool *pool, const char *evr);
 void pool_split_evr(Pool *pool, const char *evr, char **epoch, char **version, char **release);
+char *pool_solvable_epoch_optional_2str(Pool *pool, const Solvable *s, gboolean with_epoch);
 
 /* reldep utils */
 int parse_reldep_str(const char *nevra, char **name, char **evr, int *cmp_type);
@@ -74,7 +74,7 @@ extern "C" {
 #define CHKSUM_IDENT "H000"
 #define CACHEDIR_PERMISSIONS 0700
 
-static mode_t
+mode_t
 get_umask(void)
 {
     mode_t mask = umask(0);
@@ -142,6 +142,19 @@ checksum_fp(unsigned char *out, FILE *fp)
     return 0;
 }
 
+/* each string is hashed including its terminating zero to keep the boundaries */
+int
+checksum_strings(unsigned char *out, const std::vector<std::string> & strings)
+{
+    auto h = solv_chksum_create(CHKSUM_TYPE);
+
+    solv_chksum_add(h, CHKSUM_IDENT, strlen(CHKSUM_IDENT));
+    for (const auto & str : strings)
+        solv_chksum_add(h, str.c_str(), str.size() + 1);
+    solv_chksum_free(h, out);
+    return 0;
+}
+
 /* does not move the fp position */
 int
 checksum_stat(unsigned char *out, FILE *fp)
@@ -538,6 +551,17 @@ read_whole_file(const char *path)
   return contents;
 }
 
+/* Files that createrepo stores in primary.xml, everything else is only in filelists.xml */
+int
+is_primary_file(const char *fn)
+{
+    if (strncmp(fn, "/etc/", 5) == 0)
+        return 1;
+    if (strcmp(fn, "/usr/lib/sendmail") == 0)
+        return 1;
+    return strstr(fn, "bin/") != NULL;
+}
+
 static char *
 pool_tmpdup(Pool *pool, const char *s)
 {
@@ -566,6 +590,99 @@ running_kernel_check_path(DnfSack *sack, const char *fn)
     return id;
 }
 
+// The cache holds the key line and "name evr arch" of the kernel, "-" when none matched
+#define RUNNING_KERNEL_CACHE_FN "running-kernel.cache"
+
+// Number and checksum of the installed NEVRAs, the installed repo need not come from the
+// rpmdb the stamp covers
+static std::string
+running_kernel_installed_fingerprint(Pool *pool)
+{
+    std::vector<std::string> nevras;
+    Id p;
+    Solvable *s;
+    FOR_REPO_SOLVABLES(pool->installed, p, s) {
+        nevras.push_back(pool_solvable2str(pool, s));
+    }
+    unsigned char chksum[CHKSUM_BYTES];
+    checksum_strings(chksum, nevras);
+    return std::to_string(nevras.size()) + ":" + pool_bin2hex(pool, chksum, CHKSUM_BYTES);
+}
+
+static std::string
+running_kernel_cache_key(DnfSack *sack, const char *release)
+{
+    Pool *pool = dnf_sack_get_pool(sack);
+    if (!pool->installed || !dnf_sack_get_cache_dir(sack))
+        return {};
+    auto stamp = dnf_sack_rpmdb_stamp(sack);
+    // without an rpmdb to stat the result cannot be validated
+    if (stamp.empty())
+        return {};
+    const char *root = pool_get_rootdir(pool);
+    return std::string(release) + "|" + (root ? root : "") + "|" + stamp + "|" +
+        running_kernel_installed_fingerprint(pool);
+}
+
+static bool
+running_kernel_cache_read(DnfSack *sack, const std::string & key, Id *kernel_id)
+{
+    Pool *pool = dnf_sack_get_pool(sack);
+    g_autofree gchar *fn = g_build_filename(dnf_sack_get_cache_dir(sack), RUNNING_KERNEL_CACHE_FN, NULL);
+    g_autofree gchar *content = NULL;
+    if (!g_file_get_contents(fn, &content, NULL, NULL))
+        return false;
+    g_auto(GStrv) lines = g_strsplit(content, "\n", 3);
+    if (!lines[0] || key != lines[0] || !lines[1])
+        return false;
+    if (strcmp(lines[1], "-") == 0) {
+        *kernel_id = -1;
+        return true;
+    }
+    g_auto(GStrv) nevra = g_strsplit(lines[1], " ", 3);
+    if (g_strv_length(nevra) != 3)
+        return false;
+    Id name = pool_str2id(pool, nevra[0], 0);
+    Id evr = pool_str2id(pool, nevra[1], 0);
+    Id arch = pool_str2id(pool, nevra[2], 0);
+    if (!name || !evr || !arch)
+        return false;
+    Id p;
+    Solvable *s;
+    FOR_REPO_SOLVABLES(pool->installed, p, s) {
+        if (s->name == name && s->evr == evr && s->arch == arch) {
+            *kernel_id = p;
+            return true;
+        }
+    }
+    return false;
+}
+
+static void
+running_kernel_cache_write(DnfSack *sack, const std::string & key, Id kernel_id)
+{
+    Pool *pool = dnf_sack_get_pool(sack);
+    std::string content = key + "\n";
+    if (kernel_id >= 0) {
+        Solvable *s = pool_id2solvable(pool, kernel_id);
+        content += std::string(pool_id2str(pool, s->name)) + " " + pool_id2str(pool, s->evr) + " " +
+            pool_id2str(pool, s->arch);
+    } else {
+        content += "-";
+    }
+    content += "\n";
+    g_autofree gchar *fn = g_build_filename(dnf_sack_get_cache_dir(sack), RUNNING_KERNEL_CACHE_FN, NULL);
+    g_autoptr(GError) error = NULL;
+    if (!g_file_set_contents(fn, content.data(), content.size(), &error))
+        g_debug("running_kernel(): cannot write %s: %s", fn, error->message);
+}
+
+/**
+ * Finds the installed package of the running kernel by the files it owns.
+ *
+ * Walking the filelists is slow, the result is cached in the cache directory of
+ * the sack for the kernel release, the rpmdb and the installed packages it was found in.
+ */
 Id
 running_kernel(DnfSack *sack)
 {
@@ -577,8 +694,18 @@ running_kernel(DnfSack *sack)
         return -1;
     }
 
+    Id kernel_id = -1;
+    auto cacheKey = running_kernel_cache_key(sack, un.release);
+    if (!cacheKey.empty() && running_kernel_cache_read(sack, cacheKey, &kernel_id)) {
+        if (kernel_id >= 0)
+            g_debug("running_kernel(): %s (cached).", id2nevra(pool, kernel_id));
+        else
+            g_debug("running_kernel(): running kernel not matched to a package (cached).");
+        return kernel_id;
+    }
+
     char *fn = pool_tmpjoin(pool, "/boot/vmlinuz-", un.release, NULL);
-    Id kernel_id = running_kernel_check_path(sack, fn);
+    kernel_id = running_kernel_check_path(sack, fn);
 
     if (kernel_id < 0) {
         fn = pool_tmpjoin(pool, "/lib/modules/", un.release, NULL);
@@ -589,6 +716,8 @@ running_kernel(DnfSack *sack)
         g_debug("running_kernel(): %s.", id2nevra(pool, kernel_id));
     else
         g_debug("running_kernel(): running kernel not matched to a package.");
+    if (!cacheKey.empty())
+        running_kernel_cache_write(sack, cacheKey, kernel_id);
     return kernel_id;
 }
 
@@ -779,6 +908,64 @@ pool_split_evr(Pool *pool, const char *evr_c, char **epoch, char **version,
     *release = r;
 }
 
+char *
+pool_solvable_epoch_optional_2str(Pool *pool, const Solvable *s, gboolean with_epoch)
+{
+    const char *e;
+    const char *name = pool_id2str(pool, s->name);
+    const char *evr = pool_id2str(pool, s->evr);
+    const char *arch = pool_id2str(pool, s->arch);
+    bool present_epoch = false;
+
+    for (e = evr + 1; *e != '-' && *e != '\0'; ++e) {
+        if (*e == ':') {
+            present_epoch = true;
+            break;
+        }
+    }
+    char *output_string;
+    int evr_length, arch_length;
+    int extra_epoch_length = 0;
+    int name_length = strlen(name);
+    evr_length = strlen(evr);
+    arch_length = strlen(arch);
+    if (!present_epoch && with_epoch) {
+        extra_epoch_length = 2;
+    } else if (present_epoch && !with_epoch) {
+        extra_epoch_length = evr - e - 1;
+    }
+
+    output_string = pool_alloctmpspace(
+        pool, name_length + evr_length + extra_epoch_length + arch_length + 3);
+
+    strcpy(output_string, name);
+
+    if (evr_length || extra_epoch_length > 0) {
+        output_string[name_length++] = '-';
+
+        if (extra_epoch_length > 0) {
+            output_string[name_length++] = '0';
+            output_string[name_length++] = ':';
+            output_string[name_length] = '\0';
+        }
+    }
+
+    if (evr_length) {
+        if (extra_epoch_length >= 0) {
+            strcpy(output_string + name_length, evr);
+        } else {
+            strcpy(output_string + name_length, evr - extra_epoch_length);
+            evr_length = evr_length + extra_epoch_length;
+        }
+    }
+
+    if (arch_length) {
+        output_string[name_length + evr_length] = '.';
+        strcpy(output_string + name_length + evr_length + 1, arch);
+    }
+    return output_string;
+}
+
 const char *
 id2nevra(Pool *pool, Id id)
 {
@@ -984,6 +984,10 @@ dnf_package_get_files(DnfPackage *pkg)
     Dataiterator di;
     GPtrArray *ret = g_ptr_array_new();
 
+    g_autoptr(GError) error = NULL;
+    if (!dnf_sack_load_lazy_extensions(priv->sack, DNF_SACK_LOAD_FLAG_USE_FILELISTS, s->repo,
+                                       &error))
+        g_warning("File list of %s is incomplete: %s", dnf_package_get_nevra(pkg), error->message);
     repo_internalize_trigger(s->repo);
     dataiterator_init(&di, pool, s->repo, priv->id, SOLVABLE_FILELIST, NULL,
                       SEARCH_FILES | SEARCH_COMPLETE_FILELIST);
@@ -1014,6 +1018,9 @@ dnf_package_get_changelogs(DnfPackage *pkg)
     Dataiterator di;
     std::vector<libdnf::Changelog> changelogslist;
 
+    g_autoptr(GError) error = NULL;
+    if (!dnf_sack_load_lazy_extensions(priv->sack, DNF_SACK_LOAD_FLAG_USE_OTHER, s->repo, &error))
+        g_warning("Changelogs of %s are incomplete: %s", dnf_package_get_nevra(pkg), error->message);
     dataiterator_init(&di, pool, s->repo, priv->id, SOLVABLE_CHANGELOG_AUTHOR, NULL, 0);
     dataiterator_prepend_keyname(&di, SOLVABLE_CHANGELOG);
     while (dataiterator_step(&di)) {
@@ -1126,6 +1133,10 @@ dnf_package_get_delta_from_evr(DnfPackage *pkg, const char *from_evr)
     Dataiterator di;
     const char *name = dnf_package_get_name(pkg);
 
+    g_autoptr(GError) error = NULL;
+    if (!dnf_sack_load_lazy_extensions(dnf_package_get_sack(pkg), DNF_SACK_LOAD_FLAG_USE_PRESTO,
+                                       s->repo, &error))
+        g_warning("Deltas of %s are incomplete: %s", name, error->message);
     dataiterator_init(&di, pool, s->repo, SOLVID_META, DELTA_PACKAGE_NAME, name,
                       SEARCH_STRING);
     dataiterator_prepend_keyname(&di, REPOSITORY_DELTAINFO);
@@ -21,8 +21,11 @@
 #ifndef HY_QUERY_INTERNAL_H
 #define HY_QUERY_INTERNAL_H
 
+#include <string>
+
 // libsolv
 #include <solv/bitmap.h>
+#include <solv/pool.h>
 
 // hawkey
 #include "hy-query.h"
@@ -40,6 +43,30 @@ enum _match_type {
 };
 
 namespace libdnf {
+
+struct NevraID {
+public:
+    NevraID() : name(0), arch(0), evr(0) {};
+    NevraID(const NevraID & src) = default;
+    NevraID(NevraID && src) noexcept = default;
+    NevraID & operator=(const NevraID & src) = default;
+    NevraID & operator=(NevraID && src) = default;
+    Id name;
+    Id arch;
+    Id evr;
+    std::string evr_str;
+    /**
+    * @brief Parsing function for nevra string into name, evr, arch and transforming it into libsolv
+    * Id
+    *
+    * int createNewEVR - `1` will create new id for evr when it is unknown, `0` will exit with false when evr is unknown
+    *
+    * @return bool Returns true if parsing succesful and all elements is known to pool
+    */
+
+    bool parse(Pool * pool, const char * nevraPattern, bool createEVRId);
+};
+
 void hy_query_to_name_ordered_queue(HyQuery query, libdnf::IdQueue * samename);
 void hy_query_to_name_arch_ordered_queue(HyQuery query, libdnf::IdQueue * samename);
 }
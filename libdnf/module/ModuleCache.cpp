@@ -0,0 +1,268 @@
+/*
+ * Copyright (C) 2022 Red Hat, Inc.
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "ModuleCache.hpp"
+#include "libdnf/utils/utils.hpp"
+#include "../log.hpp"
+#include "bgettext/bgettext-lib.h"
+#include "tinyformat/tinyformat.hpp"
+
+#include <glib.h>
+
+#include <algorithm>
+#include <stdint.h>
+#include <string.h>
+
+namespace libdnf {
+
+namespace {
+
+// bump when the stored data change
+constexpr std::array<char, 8> MODULE_CACHE_MAGIC{'\0', 'd', 'n', 'f', 'm', 'o', 'd', '1'};
+
+class Writer {
+public:
+    void putInt(uint64_t value)
+    {
+        for (int i = 0; i < 8; ++i)
+            buffer.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+    void putString(const std::string & value)
+    {
+        putInt(value.size());
+        buffer.append(value);
+    }
+    void putStrings(const std::vector<std::string> & values)
+    {
+        putInt(values.size());
+        for (const auto & value : values)
+            putString(value);
+    }
+    void putRaw(const void * data, std::size_t size)
+    {
+        buffer.append(static_cast<const char *>(data), size);
+    }
+    const std::string & getBuffer() const noexcept { return buffer; }
+
+private:
+    std::string buffer;
+};
+
+/// Reads the cache, every getter returns false when the data end prematurely
+class Reader {
+public:
+    Reader(const char * data, std::size_t size) : data(data), size(size) {}
+    bool getInt(uint64_t & value)
+    {
+        if (size - pos < 8)
+            return false;
+        value = 0;
+        for (int i = 0; i < 8; ++i)
+            value |= static_cast<uint64_t>(static_cast<unsigned char>(data[pos + i])) << (8 * i);
+        pos += 8;
+        return true;
+    }
+    bool getString(std::string & value)
+    {
+        uint64_t length;
+        if (!getInt(length) || size - pos < length)
+            return false;
+        value.assign(data + pos, length);
+        pos += length;
+        return true;
+    }
+    bool getStrings(std::vector<std::string> & values)
+    {
+        uint64_t count;
+        if (!getInt(count) || count > size - pos)
+            return false;
+        values.resize(count);
+        for (auto & value : values) {
+            if (!getString(value))
+                return false;
+        }
+        return true;
+    }
+    bool getRaw(void * out, std::size_t length)
+    {
+        if (size - pos < length)
+            return false;
+        memcpy(out, data + pos, length);
+        pos += length;
+        return true;
+    }
+    bool atEnd() const noexcept { return pos == size; }
+
+private:
+    const char * data;
+    std::size_t size;
+    std::size_t pos{0};
+};
+
+void
+writeStream(Writer & writer, const ModuleStreamData & data)
+{
+    writer.putString(data.name);
+    writer.putString(data.stream);
+    writer.putInt(data.version);
+    writer.putString(data.context);
+    writer.putString(data.arch);
+    writer.putInt(data.staticContext);
+    writer.putInt(data.runtimeRequires.size());
+    for (const auto & requires : data.runtimeRequires) {
+        writer.putString(requires.first);
+        writer.putStrings(requires.second);
+    }
+    writer.putStrings(data.artifacts);
+    writer.putStrings(data.demodularizedRpms);
+}
+
+bool
+readStream(Reader & reader, ModuleStreamData & data)
+{
+    uint64_t version, staticContext, count;
+    if (!reader.getString(data.name) || !reader.getString(data.stream) ||
+        !reader.getInt(version) || !reader.getString(data.context) ||
+        !reader.getString(data.arch) || !reader.getInt(staticContext) || !reader.getInt(count))
+        return false;
+    data.version = version;
+    data.staticContext = staticContext != 0;
+    for (uint64_t i = 0; i < count; ++i) {
+        std::string name;
+        std::vector<std::string> streams;
+        if (!reader.getString(name) || !reader.getStrings(streams))
+            return false;
+        data.runtimeRequires.emplace_back(std::move(name), std::move(streams));
+    }
+    return reader.getStrings(data.artifacts) && reader.getStrings(data.demodularizedRpms);
+}
+
+}
+
+void
+ModuleCache::computeKey(const std::vector<std::array<std::string, 3>> & repos,
+                        const std::string & defaultsDir, unsigned char * key)
+{
+    std::vector<std::string> parts{std::string(MODULE_CACHE_MAGIC.data() + 1,
+                                               MODULE_CACHE_MAGIC.size() - 1)};
+    for (const auto & repo : repos)
+        parts.insert(parts.end(), repo.begin(), repo.end());
+
+    // the defaults are small, their content is part of the key
+    auto files = filesystem::getDirContent(defaultsDir);
+    std::sort(files.begin(), files.end());
+    for (const auto & file : files) {
+        gchar * content = nullptr;
+        gsize length = 0;
+        parts.push_back(file);
+        if (g_file_get_contents(file.c_str(), &content, &length, nullptr)) {
+            parts.emplace_back(content, length);
+            g_free(content);
+        }
+    }
+    checksum_strings(key, parts);
+}
+
+bool
+ModuleCache::read(const std::string & path, const unsigned char * key)
+{
+    gchar * content = nullptr;
+    gsize length = 0;
+    if (!g_file_get_contents(path.c_str(), &content, &length, nullptr))
+        return false;
+    std::unique_ptr<gchar, decltype(&g_free)> contentGuard(content, g_free);
+
+    Reader reader(content, length);
+    std::array<char, MODULE_CACHE_MAGIC.size()> magic;
+    unsigned char storedKey[CHKSUM_BYTES];
+    if (!reader.getRaw(magic.data(), magic.size()) || magic != MODULE_CACHE_MAGIC ||
+        !reader.getRaw(storedKey, CHKSUM_BYTES) || checksum_cmp(storedKey, key) != 0)
+        return false;
+
+    ModuleCache loaded;
+    uint64_t flag, nrepos;
+    if (!reader.getInt(flag) || !reader.getInt(nrepos))
+        return false;
+    loaded.withDiskDefaults = flag != 0;
+    for (uint64_t i = 0; i < nrepos; ++i) {
+        Repo repo;
+        uint64_t nstreams;
+        if (!reader.getString(repo.repoID) || !reader.getString(repo.modulesPath) ||
+            !reader.getInt(nstreams))
+            return false;
+        auto source = std::make_shared<ModuleStreamSource>(repo.modulesPath);
+        for (uint64_t j = 0; j < nstreams; ++j) {
+            std::shared_ptr<ModuleStreamData> data(new ModuleStreamData);
+            if (!readStream(reader, *data))
+                return false;
+            data->source = source;
+            repo.streams.push_back(std::move(data));
+        }
+        loaded.repos.push_back(std::move(repo));
+    }
+    uint64_t ndefaults;
+    if (!reader.getInt(ndefaults))
+        return false;
+    for (uint64_t i = 0; i < ndefaults; ++i) {
+        std::string name, stream;
+        if (!reader.getString(name) || !reader.getString(stream))
+            return false;
+        loaded.defaults.emplace(std::move(name), std::move(stream));
+    }
+    if (!reader.atEnd())
+        return false;
+
+    *this = std::move(loaded);
+    return true;
+}
+
+bool
+ModuleCache::write(const std::string & path, const unsigned char * key) const
+{
+    Writer writer;
+    writer.putRaw(MODULE_CACHE_MAGIC.data(), MODULE_CACHE_MAGIC.size());
+    writer.putRaw(key, CHKSUM_BYTES);
+    writer.putInt(withDiskDefaults);
+    writer.putInt(repos.size());
+    for (const auto & repo : repos) {
+        writer.putString(repo.repoID);
+        writer.putString(repo.modulesPath);
+        writer.putInt(repo.streams.size());
+        for (const auto & data : repo.streams)
+            writeStream(writer, *data);
+    }
+    writer.putInt(defaults.size());
+    for (const auto & item : defaults) {
+        writer.putString(item.first);
+        writer.putString(item.second);
+    }
+
+    // written to a temporary file and renamed, readers never see a partial cache
+    g_autoptr(GError) error = nullptr;
+    const auto & buffer = writer.getBuffer();
+    if (!g_file_set_contents(path.c_str(), buffer.data(), buffer.size(), &error)) {
+        auto logger(Log::getLogger());
+        logger->debug(tfm::format(_("Failed to write module cache %s: %s"), path, error->message));
+        return false;
+    }
+    return true;
+}
+
+}
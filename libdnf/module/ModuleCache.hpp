@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2022 Red Hat, Inc.
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef LIBDNF_MODULECACHE_HPP
+#define LIBDNF_MODULECACHE_HPP
+
+#include "ModulePackage-private.hpp"
+#include "../hy-iutil-private.hpp"
+
+#include <array>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace libdnf {
+
+/**
+* @brief Compiled modular metadata of the repos, the module cache.
+*
+* Like the .solv caches of the repos it lets a warm start skip the YAML. It stores the module
+* streams of every repo with all the data needed to create the module solvables, their
+* dependencies and artifacts, and the resolved default streams. The key covers the modular
+* metadata of every repo and the modules.defaults.d directory, the cache is valid only as a
+* whole.
+*/
+struct ModuleCache {
+    struct Repo {
+        std::string repoID;
+        /// modules metadata of the repo, the documents are loaded from it on demand
+        std::string modulesPath;
+        std::vector<std::shared_ptr<ModuleStreamData>> streams;
+    };
+
+    /**
+    * @brief Compute the key of the cache.
+    *
+    * @param repos id, modules metadata path and its checksum string of every modular repo
+    * @param defaultsDir directory with the modules.defaults.d files
+    */
+    static void computeKey(const std::vector<std::array<std::string, 3>> & repos,
+                           const std::string & defaultsDir, unsigned char * key);
+
+    /// @return false if the file does not exist, is damaged or has another key
+    bool read(const std::string & path, const unsigned char * key);
+    /// @return false and logs the reason if the cache cannot be written
+    bool write(const std::string & path, const unsigned char * key) const;
+
+    std::vector<Repo> repos;
+    /// Whether the defaults include the files of modules.defaults.d
+    bool withDiskDefaults{false};
+    std::map<std::string, std::string> defaults;
+};
+
+}
+
+#endif // LIBDNF_MODULECACHE_HPP
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2022 Red Hat, Inc.
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef LIBDNF_MODULEPACKAGE_PRIVATE_HPP
+#define LIBDNF_MODULEPACKAGE_PRIVATE_HPP
+
+#include "ModulePackage.hpp"
+#include "modulemd/ModuleMetadata.hpp"
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace libdnf {
+
+/**
+* @brief Loads the modulemd documents of a repo on demand.
+*
+* Used for module streams restored from the module cache, the file is parsed the first time
+* a document of one of its streams is needed.
+*/
+class ModuleStreamSource {
+public:
+    explicit ModuleStreamSource(std::string path) : path(std::move(path)) {}
+    const std::string & getPath() const noexcept { return path; }
+    /// @return borrowed stream, nullptr if the metadata do not contain it any more
+    ModulemdModuleStream * getStream(const ModuleStreamData & data);
+
+private:
+    std::string path;
+    std::unique_ptr<ModuleMetadata> metadata;
+};
+
+/**
+* @brief Data of a module stream used to build and solve the module packages.
+*
+* It holds everything module filtering needs, so it can be stored in the module cache. The
+* modulemd document itself is only needed for the remaining details (profiles, summary, ...),
+* it is either set on creation or loaded from the source on demand.
+*/
+struct ModuleStreamData {
+    ~ModuleStreamData();
+
+    /// Copy the data out of the document, the stream is referenced
+    static std::shared_ptr<ModuleStreamData> fromStream(ModulemdModuleStream * mdStream);
+
+    std::string name;
+    std::string stream;
+    unsigned long long version{0};
+    std::string context;
+    std::string arch;
+    bool staticContext{false};
+    /// Runtime requires of all dependency blocks in order: module name and its streams
+    std::vector<std::pair<std::string, std::vector<std::string>>> runtimeRequires;
+    std::vector<std::string> artifacts;
+    std::vector<std::string> demodularizedRpms;
+
+    ModulemdModuleStream * mdStream{nullptr};
+    std::shared_ptr<ModuleStreamSource> source;
+};
+
+}
+
+#endif // LIBDNF_MODULEPACKAGE_PRIVATE_HPP
@@ -29,6 +29,8 @@ extern "C" {
 }
 
 #include "ModulePackage.hpp"
+#include "ModulePackage-private.hpp"
+#include "ModulePackageContainer.hpp"
 #include "modulemd/ModuleProfile.hpp"
 #include "libdnf/utils/File.hpp"
 #include "libdnf/dnf-sack-private.hpp"
@@ -97,15 +99,91 @@ static std::pair<std::string, std::string> parsePlatform(const std::string & pla
     return make_pair(platform.substr(0,index), platform.substr(index+1));
 }
 
+ModulemdModuleStream * ModuleStreamSource::getStream(const ModuleStreamData & data)
+{
+    if (!metadata) {
+        g_autoptr(ModulemdModuleIndex) index = ModuleMetadata::parseFile(path);
+        metadata.reset(new ModuleMetadata);
+        metadata->addMetadataFromIndex(index, 0);
+        metadata->resolveAddedMetadata();
+    }
+    return metadata->getModuleStream(data.name, data.stream, data.version, data.context, data.arch);
+}
+
+ModuleStreamData::~ModuleStreamData()
+{
+    if (mdStream != nullptr) {
+        g_object_unref(mdStream);
+    }
+}
+
+std::shared_ptr<ModuleStreamData> ModuleStreamData::fromStream(ModulemdModuleStream * mdStream)
+{
+    std::shared_ptr<ModuleStreamData> data(new ModuleStreamData);
+    if (mdStream == nullptr) {
+        return data;
+    }
+    g_object_ref(mdStream);
+    data->mdStream = mdStream;
+
+    auto name = modulemd_module_stream_get_module_name(mdStream);
+    data->name = name ? name : "";
+    auto stream = modulemd_module_stream_get_stream_name(mdStream);
+    data->stream = stream ? stream : "";
+    data->version = modulemd_module_stream_get_version(mdStream);
+    auto context = modulemd_module_stream_get_context(mdStream);
+    data->context = context ? context : "";
+    auto arch = modulemd_module_stream_get_arch(mdStream);
+    data->arch = arch ? arch : "";
+
+    auto streamV2 = reinterpret_cast<ModulemdModuleStreamV2 *>(mdStream);
+    data->staticContext = modulemd_module_stream_v2_is_static_context(streamV2);
+
+    GPtrArray * cDependencies = modulemd_module_stream_v2_get_dependencies(streamV2);
+    for (unsigned int i = 0; i < cDependencies->len; i++) {
+        auto dependencies = static_cast<ModulemdDependencies *>(g_ptr_array_index(cDependencies, i));
+        if (!dependencies) {
+            continue;
+        }
+        char ** runtimeReqModules = modulemd_dependencies_get_runtime_modules_as_strv(dependencies);
+        for (char ** iterModule = runtimeReqModules; iterModule && *iterModule; iterModule++) {
+            std::vector<std::string> streams;
+            char ** runtimeReqStreams =
+                modulemd_dependencies_get_runtime_streams_as_strv(dependencies, *iterModule);
+            for (char ** iterStream = runtimeReqStreams; iterStream && *iterStream; iterStream++) {
+                streams.emplace_back(*iterStream);
+            }
+            g_strfreev(runtimeReqStreams);
+            data->runtimeRequires.emplace_back(*iterModule, std::move(streams));
+        }
+        g_strfreev(runtimeReqModules);
+    }
+
+    char ** rpms = modulemd_module_stream_v2_get_rpm_artifacts_as_strv(streamV2);
+    for (char ** iter = rpms; iter && *iter; iter++) {
+        data->artifacts.emplace_back(*iter);
+    }
+    g_strfreev(rpms);
+
+    rpms = modulemd_module_stream_v2_get_demodularized_rpms(streamV2);
+    for (char ** iter = rpms; iter && *iter; iter++) {
+        data->demodularizedRpms.emplace_back(*iter);
+    }
+    g_strfreev(rpms);
+    return data;
+}
+
 ModulePackage::ModulePackage(DnfSack * moduleSack, LibsolvRepo * repo,
     ModulemdModuleStream * mdStream, const std::string & repoID, const std::string & context)
-        : mdStream(mdStream)
+        : ModulePackage(moduleSack, repo, ModuleStreamData::fromStream(mdStream), repoID, context)
+{}
+
+ModulePackage::ModulePackage(DnfSack * moduleSack, LibsolvRepo * repo,
+    std::shared_ptr<ModuleStreamData> data, const std::string & repoID, const std::string & context)
+        : data(std::move(data))
         , moduleSack(moduleSack)
         , repoID(repoID)
 {
-    if (mdStream != nullptr) {
-        g_object_ref(mdStream);
-    }
     Pool * pool = dnf_sack_get_pool(moduleSack);
     id = repo_add_solvable(repo);
     Solvable *solvable = pool_id2solvable(pool, id);
@@ -119,39 +197,36 @@ ModulePackage::ModulePackage(DnfSack * moduleSack, LibsolvRepo * repo,
     dnf_sack_set_considered_to_update(moduleSack);
 }
 
-ModulePackage::ModulePackage(const ModulePackage & mpkg)
-        : mdStream(mpkg.mdStream)
-        , moduleSack(mpkg.moduleSack)
-        , repoID(mpkg.repoID)
-        , id(mpkg.id)
-{
-    if (mdStream != nullptr) {
-        g_object_ref(mdStream);
-    }
-}
+ModulePackage::ModulePackage(const ModulePackage & mpkg) = default;
 
-ModulePackage & ModulePackage::operator=(const ModulePackage & mpkg)
-{
-    if (this != &mpkg) {
-        if (mdStream != nullptr) {
-            g_object_unref(mdStream);
-        }
-        mdStream = mpkg.mdStream;
-        if (mdStream != nullptr) {
-            g_object_ref(mdStream);
-        }
-        moduleSack = mpkg.moduleSack;
-        repoID = mpkg.repoID;
-        id = mpkg.id;
-    }
-    return *this;
-}
+ModulePackage & ModulePackage::operator=(const ModulePackage & mpkg) = default;
 
-ModulePackage::~ModulePackage()
-{
-    if (mdStream != nullptr) {
-        g_object_unref(mdStream);
+ModulePackage::~ModulePackage() = default;
+
+/**
+ * @brief Return the modulemd document of the package.
+ *
+ * The method is const, but it fills in the document of the shared ModuleStreamData on the first
+ * call for packages restored from the module cache. All copies of the package see the loaded
+ * document.
+ *
+ * @throws File::OpenError if the modules file of the repo cannot be opened and
+ *         ModulePackageContainer::ResolveException if it cannot be parsed or does not contain
+ *         the module, as when the metadata are added to the container.
+ */
+ModulemdModuleStream * ModulePackage::getMdStream() const
+{
+    if (!data->mdStream && data->source) {
+        auto mdStream = data->source->getStream(*data);
+        if (!mdStream) {
+            throw ModulePackageContainer::ResolveException(tfm::format(
+                _("Failed to update from file %s: module %s not found"),
+                data->source->getPath(), getFullIdentifier()));
+        }
+        g_object_ref(mdStream);
+        data->mdStream = mdStream;
     }
+    return data->mdStream;
 }
 
 /**
@@ -162,97 +237,81 @@ void ModulePackage::createDependencies(Solvable *solvable) const
     Id depId;
     Pool * pool = dnf_sack_get_pool(moduleSack);
 
-    for (const auto &dependency : getModuleDependencies()) {
-        for (const auto &requires : dependency.getRequires()) {
-            for (const auto &singleRequires : requires) {
-                auto moduleName = singleRequires.first;
-                std::vector<std::string> requiresStream;
-                for (const auto &moduleStream : singleRequires.second) {
-                    if (moduleStream.find('-', 0) != std::string::npos) {
-                        std::ostringstream ss;
-                        ss << "module(" << moduleName << ":" << moduleStream.substr(1) << ")";
-                        depId = pool_str2id(pool, ss.str().c_str(), 1);
-                        solvable_add_deparray(solvable, SOLVABLE_CONFLICTS, depId, 0);
-                    } else {
-                        std::string reqFormated = "module(" + moduleName + ":" + moduleStream + ")";
-                        requiresStream.push_back(std::move(reqFormated));
-                    }
-                }
-                if (requiresStream.empty()) {
-                    std::ostringstream ss;
-                    ss << "module(" << moduleName << ")";
-                    depId = pool_str2id(pool, ss.str().c_str(), 1);
-                    solvable_add_deparray(solvable, SOLVABLE_REQUIRES, depId, -1);
-                } else if (requiresStream.size() == 1) {
-                    auto & requireFormated = requiresStream[0];
-                    depId = pool_str2id(pool, requireFormated.c_str(), 1);
-                    solvable_add_deparray(solvable, SOLVABLE_REQUIRES, depId, -1);
-                } else {
-                    std::ostringstream ss;
-                    ss << "(";
-                    ss << std::accumulate(std::next(requiresStream.begin()),
-                                            requiresStream.end(), requiresStream[0],
-                                            [](std::string & a, std::string & b)
-                                            { return a + " or " + b; });
-                    ss << ")";
-                    depId = pool_parserpmrichdep(pool, ss.str().c_str());
-                    if (!depId)
-                        throw std::runtime_error("Cannot parse module requires");
-                    solvable_add_deparray(solvable, SOLVABLE_REQUIRES, depId, -1);
-                }
+    for (const auto &singleRequires : data->runtimeRequires) {
+        auto moduleName = singleRequires.first;
+        std::vector<std::string> requiresStream;
+        for (const auto &moduleStream : singleRequires.second) {
+            if (moduleStream.find('-', 0) != std::string::npos) {
+                std::ostringstream ss;
+                ss << "module(" << moduleName << ":" << moduleStream.substr(1) << ")";
+                depId = pool_str2id(pool, ss.str().c_str(), 1);
+                solvable_add_deparray(solvable, SOLVABLE_CONFLICTS, depId, 0);
+            } else {
+                std::string reqFormated = "module(" + moduleName + ":" + moduleStream + ")";
+                requiresStream.push_back(std::move(reqFormated));
             }
         }
+        if (requiresStream.empty()) {
+            std::ostringstream ss;
+            ss << "module(" << moduleName << ")";
+            depId = pool_str2id(pool, ss.str().c_str(), 1);
+            solvable_add_deparray(solvable, SOLVABLE_REQUIRES, depId, -1);
+        } else if (requiresStream.size() == 1) {
+            auto & requireFormated = requiresStream[0];
+            depId = pool_str2id(pool, requireFormated.c_str(), 1);
+            solvable_add_deparray(solvable, SOLVABLE_REQUIRES, depId, -1);
+        } else {
+            std::ostringstream ss;
+            ss << "(";
+            ss << std::accumulate(std::next(requiresStream.begin()),
+                                    requiresStream.end(), requiresStream[0],
+                                    [](std::string & a, std::string & b)
+                                    { return a + " or " + b; });
+            ss << ")";
+            depId = pool_parserpmrichdep(pool, ss.str().c_str());
+            if (!depId)
+                throw std::runtime_error("Cannot parse module requires");
+            solvable_add_deparray(solvable, SOLVABLE_REQUIRES, depId, -1);
+        }
     }
 }
 
-std::vector<std::string> ModulePackage::getRequires(ModulemdModuleStream * mdStream, bool removePlatform)
+std::vector<std::string> ModulePackage::getRequires(const ModuleStreamData & data, bool removePlatform)
 {
     std::vector<std::string> dependencies_result;
 
-    GPtrArray * cDependencies = modulemd_module_stream_v2_get_dependencies((ModulemdModuleStreamV2 *) mdStream);
-
-    for (unsigned int i = 0; i < cDependencies->len; i++) {
-        auto dependencies = static_cast<ModulemdDependencies *>(g_ptr_array_index(cDependencies, i));
-        if (!dependencies) {
+    for (const auto & singleRequires : data.runtimeRequires) {
+        auto & moduleName = singleRequires.first;
+        if (removePlatform && moduleName == "platform") {
             continue;
         }
-        char** runtimeReqModules = modulemd_dependencies_get_runtime_modules_as_strv(dependencies);
-
-        for (char **iterModule = runtimeReqModules; iterModule && *iterModule; iterModule++) {
-            char ** runtimeReqStreams = modulemd_dependencies_get_runtime_streams_as_strv(dependencies, *iterModule);
-            auto moduleName = static_cast<char *>(*iterModule);
-            if (removePlatform && strcmp(moduleName, "platform") == 0) {
-                g_strfreev(runtimeReqStreams);
-                continue;
-            }
+        std::vector<std::string> requiredStreams(singleRequires.second);
+        if (requiredStreams.empty()) {
+            dependencies_result.emplace_back(moduleName);
+        } else {
             std::ostringstream ss;
-            std::vector<std::string> requiredStreams;
-            for (char **iterStream = runtimeReqStreams; iterStream && *iterStream; iterStream++) {
-                requiredStreams.push_back(*iterStream);
-            }
-            if (requiredStreams.empty()) {
-                dependencies_result.emplace_back(moduleName);
-            } else {
-                std::sort(requiredStreams.begin(), requiredStreams.end());
-                ss << moduleName << ":" << "[" << *requiredStreams.begin();
-                for (auto iter = std::next(requiredStreams.begin()); iter != requiredStreams.end(); ++iter) {
-                    ss << "," << *iter;
-                }
-                ss << "]";
-                dependencies_result.emplace_back(std::move(ss.str()));
+            std::sort(requiredStreams.begin(), requiredStreams.end());
+            ss << moduleName << ":" << "[" << *requiredStreams.begin();
+            for (auto iter = std::next(requiredStreams.begin()); iter != requiredStreams.end(); ++iter) {
+                ss << "," << *iter;
             }
-            g_strfreev(runtimeReqStreams);
+            ss << "]";
+            dependencies_result.emplace_back(std::move(ss.str()));
         }
-        g_strfreev(runtimeReqModules);
     }
 
     return dependencies_result;
 }
 
+std::vector<std::string> ModulePackage::getRequires(bool removePlatform)
+{
+    return getRequires(*data, removePlatform);
+}
+
 std::string ModulePackage::getYaml() const
 {
     ModulemdModuleIndex * i = modulemd_module_index_new();
-    modulemd_module_index_add_module_stream(i, mdStream, NULL);
+    modulemd_module_index_add_module_stream(i, getMdStream(), NULL);
     gchar *cStrYaml = modulemd_module_index_dump_to_string(i, NULL);
     std::string yaml = std::string(cStrYaml);
     g_free(cStrYaml);
@@ -262,7 +321,7 @@ std::string ModulePackage::getYaml() const
 
 bool ModulePackage::getStaticContext() const
 {
-    return modulemd_module_stream_v2_is_static_context((ModulemdModuleStreamV2 *) mdStream);
+    return data->staticContext;
 }
 
 /**
@@ -272,13 +331,12 @@ bool ModulePackage::getStaticContext() const
  */
 const char * ModulePackage::getNameCStr() const
 {
-    return modulemd_module_stream_get_module_name(mdStream);
+    return data->name.c_str();
 }
 
 std::string ModulePackage::getName() const
 {
-    auto name = modulemd_module_stream_get_module_name(mdStream);
-    return name ? name : "";
+    return data->name;
 }
 
 /**
@@ -305,13 +363,12 @@ const std::string & ModulePackage::getRepoID() const
  */
 const char * ModulePackage::getStreamCStr() const
 {
-    return modulemd_module_stream_get_stream_name(mdStream);
+    return data->stream.c_str();
 }
 
 std::string ModulePackage::getStream() const
 {
-    auto stream = modulemd_module_stream_get_stream_name(mdStream);
-    return stream ? stream : "";
+    return data->stream;
 }
 
 /**
@@ -321,7 +378,7 @@ std::string ModulePackage::getStream() const
  */
 std::string ModulePackage::getVersion() const
 {
-    return std::to_string(modulemd_module_stream_get_version(mdStream));
+    return std::to_string(data->version);
 }
 
 /**
@@ -331,7 +388,7 @@ std::string ModulePackage::getVersion() const
  */
 long long ModulePackage::getVersionNum() const
 {
-    return modulemd_module_stream_get_version(mdStream);
+    return data->version;
 }
 
 /**
@@ -341,13 +398,12 @@ long long ModulePackage::getVersionNum() const
  */
 const char * ModulePackage::getContextCStr() const
 {
-    return modulemd_module_stream_get_context(mdStream);
+    return data->context.empty() ? nullptr : data->context.c_str();
 }
 
 std::string ModulePackage::getContext() const
 {
-    auto context = modulemd_module_stream_get_context(mdStream);
-    return context ? context : "";
+    return data->context;
 }
 
 
@@ -358,13 +414,12 @@ std::string ModulePackage::getContext() const
  */
 const char * ModulePackage::getArchCStr() const
 {
-    return modulemd_module_stream_get_arch(mdStream);
+    return data->arch.empty() ? nullptr : data->arch.c_str();
 }
 
 std::string ModulePackage::getArch() const
 {
-    auto arch = modulemd_module_stream_get_arch(mdStream);
-    return arch ? arch : "";
+    return data->arch;
 }
 
 /**
@@ -387,7 +442,7 @@ std::string ModulePackage::getFullIdentifier() const
  */
 std::string ModulePackage::getSummary() const
 {
-    return modulemd_module_stream_v2_get_summary((ModulemdModuleStreamV2 *) mdStream, NULL);
+    return modulemd_module_stream_v2_get_summary((ModulemdModuleStreamV2 *) getMdStream(), NULL);
 }
 
 /**
@@ -397,7 +452,7 @@ std::string ModulePackage::getSummary() const
  */
 std::string ModulePackage::getDescription() const
 {
-    return modulemd_module_stream_v2_get_description((ModulemdModuleStreamV2 *) mdStream, NULL);
+    return modulemd_module_stream_v2_get_description((ModulemdModuleStreamV2 *) getMdStream(), NULL);
 }
 
 /**
@@ -407,15 +462,7 @@ std::string ModulePackage::getDescription() const
  */
 std::vector<std::string> ModulePackage::getArtifacts() const
 {
-    std::vector<std::string> result_rpms;
-    char ** rpms = modulemd_module_stream_v2_get_rpm_artifacts_as_strv((ModulemdModuleStreamV2 *) mdStream);
-
-    for (char **iter = rpms; iter && *iter; iter++) {
-        result_rpms.emplace_back(std::string(*iter));
-    }
-
-    g_strfreev(rpms);
-    return result_rpms;
+    return data->artifacts;
 }
 
 /**
@@ -425,20 +472,13 @@ std::vector<std::string> ModulePackage::getArtifacts() const
  */
 std::vector<std::string> ModulePackage::getDemodularizedRpms() const
 {
-    std::vector<std::string> result_rpms;
-    char ** rpms = modulemd_module_stream_v2_get_demodularized_rpms((ModulemdModuleStreamV2 *) mdStream);
-
-    for (char **iter = rpms; iter && *iter; iter++) {
-        result_rpms.emplace_back(std::string(*iter));
-    }
-
-    g_strfreev(rpms);
-    return result_rpms;
+    return data->demodularizedRpms;
 }
 
 std::vector<ModuleProfile>
 ModulePackage::getProfiles(const std::string &name) const
 {
+    auto mdStream = getMdStream();
     std::vector<ModuleProfile> result_profiles;
 
     //TODO(amatej): replace with
@@ -476,6 +516,7 @@ ModulePackage::getProfiles(const std::string &name) const
 ModuleProfile
 ModulePackage::getDefaultProfile() const
 {
+    auto mdStream = getMdStream();
     //TODO(amatej): replace with
     //char ** profiles = modulemd_module_stream_v2_search_profiles((ModulemdModuleStreamV2 *) mdStream, profileNameCStr);
     char ** profiles = modulemd_module_stream_v2_get_profile_names_as_strv((ModulemdModuleStreamV2 *) mdStream);
@@ -500,6 +541,7 @@ ModulePackage::getDefaultProfile() const
  */
 std::vector<ModuleProfile> ModulePackage::getProfiles() const
 {
+    auto mdStream = getMdStream();
     std::vector<ModuleProfile> result_profiles;
     char ** profiles = modulemd_module_stream_v2_get_profile_names_as_strv((ModulemdModuleStreamV2 *) mdStream);
 
@@ -518,6 +560,7 @@ std::vector<ModuleProfile> ModulePackage::getProfiles() const
  */
 std::vector<ModuleDependencies> ModulePackage::getModuleDependencies() const
 {
+    auto mdStream = getMdStream();
     std::vector<ModuleDependencies> dependencies;
 
     GPtrArray * cDependencies = modulemd_module_stream_v2_get_dependencies((ModulemdModuleStreamV2 *) mdStream);
@@ -692,13 +735,19 @@ ModulePackage::createPlatformSolvable(DnfSack * sack, DnfSack * moduleSack,
     return id;
 }
 
-std::string ModulePackage::getNameStream(ModulemdModuleStream * mdStream)
+std::string ModulePackage::getNameStream(const ModuleStreamData & data)
 {
-    std::ostringstream ss;
-    auto name = modulemd_module_stream_get_module_name(mdStream);
-    auto stream = modulemd_module_stream_get_stream_name(mdStream);
-    ss << (name ? name : "") << ":" << (stream ? stream : "");
-    return ss.str();
+    return data.name + ":" + data.stream;
+}
+
+/**
+ * @brief Return module $name:$stream.
+ *
+ * @return std::string
+ */
+std::string ModulePackage::getNameStream() const
+{
+    return getNameStream(*data);
 }
 
 }
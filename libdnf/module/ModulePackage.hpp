@@ -32,6 +32,8 @@
 
 namespace libdnf {
 
+struct ModuleStreamData;
+
 class ModulePackage // TODO inherit in future; : public Package
 {
 public:
@@ -55,6 +57,8 @@ public:
     std::string getArch() const;
     std::string getFullIdentifier() const;
 
+    /// The summary, description, profiles and yaml load the modulemd document on demand and throw
+    /// what getMdStream() throws
     std::string getSummary() const;
     std::string getDescription() const;
 
@@ -101,6 +105,8 @@ private:
 
     ModulePackage(DnfSack * moduleSack, LibsolvRepo * repo,
         ModulemdModuleStream * mdStream, const std::string & repoID, const std::string & context = {});
+    ModulePackage(DnfSack * moduleSack, LibsolvRepo * repo,
+        std::shared_ptr<ModuleStreamData> data, const std::string & repoID, const std::string & context = {});
 
     ModulePackage(const ModulePackage & mpkg);
     ModulePackage & operator=(const ModulePackage & mpkg);
@@ -112,10 +118,13 @@ private:
         const char *  platformModule);
     void createDependencies(Solvable *solvable) const;
     /// return vector with string requires like "nodejs:11", "nodejs", or "nodejs:-11"
-    static std::vector<std::string> getRequires(ModulemdModuleStream * mdStream, bool removePlatform);
-    static std::string getNameStream(ModulemdModuleStream * mdStream);
+    static std::vector<std::string> getRequires(const ModuleStreamData & data, bool removePlatform);
+    static std::string getNameStream(const ModuleStreamData & data);
+    /// The modulemd document, loaded on demand for packages restored from the module cache.
+    /// Loading it modifies the shared data, which is why the method is not thread safe.
+    ModulemdModuleStream * getMdStream() const;
 
-    ModulemdModuleStream * mdStream;
+    std::shared_ptr<ModuleStreamData> data;
 
     // TODO: remove after inheriting from Package
     DnfSack * moduleSack;
@@ -128,21 +137,6 @@ inline bool ModulePackage::operator==(const ModulePackage &r) const
     return id == r.id && moduleSack == r.moduleSack;
 }
 
-inline std::vector<std::string> ModulePackage::getRequires(bool removePlatform)
-{
-    return getRequires(mdStream, removePlatform);
-}
-
-/**
- * @brief Return module $name:$stream.
- *
- * @return std::string
- */
-inline std::string ModulePackage::getNameStream() const
-{
-    return getNameStream(mdStream);
-}
-
 }
 
 #endif //LIBDNF_MODULEPACKAGE_HPP
@@ -19,10 +19,15 @@
  */
 
 #include <algorithm>
+#include <fnmatch.h>
 #include <set>
 #include <sstream>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
 
 extern "C" {
+#include <solv/pool.h>
 #include <solv/poolarch.h>
 #include <solv/solver.h>
 }
@@ -34,6 +39,7 @@ extern "C" {
 #include "libdnf/dnf-sack-private.hpp"
 #include "libdnf/hy-query.h"
 #include "libdnf/hy-types.h"
+#include "libdnf/hy-util-private.hpp"
 #include <functional>
 #include <../sack/query.hpp>
 #include "../log.hpp"
@@ -46,6 +52,8 @@ extern "C" {
 
 #include "bgettext/bgettext-lib.h"
 #include "tinyformat/tinyformat.hpp"
+#include "ModuleCache.hpp"
+#include "ModulePackage-private.hpp"
 #include "modulemd/ModuleMetadata.hpp"
 #include "modulemd/ModuleProfile.hpp"
 
@@ -102,18 +110,13 @@ namespace libdnf {
 static constexpr auto EMPTY_STREAM = "";
 static constexpr auto EMPTY_PROFILES = "";
 static constexpr auto DEFAULT_STATE = "";
+static constexpr auto MODULE_CACHE_FN = "@modules-cache";
 
 static const char * ENABLE_MULTIPLE_STREAM_EXCEPTION =
 _("Cannot enable multiple streams for module '%s'");
 
 static const std::string EMPTY_RESULT;
 
-static std::string
-stringFormater(std::string imput)
-{
-    return imput.empty() ? "*" : imput;
-}
-
 static ModulePackageContainer::ModuleState
 fromString(const std::string &str) {
     if (str == "1" || str == "true" || str == "enabled")
@@ -187,16 +190,32 @@ public:
     ~Impl();
     std::pair<std::vector<std::vector<std::string>>, ModulePackageContainer::ModuleErrorType> moduleSolve(
         const std::vector<ModulePackage *> & modules, bool debugSolver);
+    std::pair<std::vector<std::vector<std::string>>, ModulePackageContainer::ModuleErrorType> runModuleSolve(
+        const std::vector<ModulePackage *> & modules, bool debugSolver,
+        std::unique_ptr<PackageSet> & conflictExcludes);
     bool insert(const std::string &moduleName, const char *path);
     std::vector<ModulePackage *> getLatestActiveEnabledModules();
     /// Required to call after all modules v3 are in metadata
     void addVersion2Modules();
+    /// Create module packages of the repo from resolved metadata
+    void addModulePackages(ModuleMetadata & md, const std::string & repoID);
+    void addModuleStreams(const std::vector<std::shared_ptr<ModuleStreamData>> & streams,
+                          const std::string & repoID);
+    /// Load the modular metadata skipped because the module packages came from the module cache
+    void ensureMetadata();
+    void addDefaultsFromDisk();
+    /// Store the module package and add it to the lookup index
+    void insertModule(std::unique_ptr<ModulePackage> modulePackage);
+    std::vector<ModulePackage *> lookup(const std::string & name, const std::string & stream,
+        const std::string & version, const std::string & context, const std::string & arch);
 
 private:
     friend struct ModulePackageContainer;
     class ModulePersistor;
     std::unique_ptr<ModulePersistor> persistor;
     std::map<Id, std::unique_ptr<ModulePackage>> modules;
+    /// Index of modules: name -> stream -> original context -> ids
+    std::map<std::string, std::map<std::string, std::map<std::string, std::vector<Id>>>> modulesIndex;
     /// Internal sack with module solvables
     /// resolveContext = <moduleContext> if moduleMdVersion > 2, else generated from requires
     /// solvable.name = <moduleName>:<moduleStream>:<resolveContext>
@@ -207,12 +226,38 @@ private:
     /// solvable.conflicts = module(<moduleName>)
     DnfSack * moduleSack;
     std::unique_ptr<PackageSet> activatedModules;
+
+    /// Result of the last moduleSolve() and the input it was computed for
+    struct SolveMemo {
+        /// number of solvables, excluded modules, then the requested modules and their optionality
+        std::vector<Id> key;
+        std::vector<std::vector<std::string>> problems;
+        ModulePackageContainer::ModuleErrorType problemType;
+        std::unique_ptr<PackageSet> activatedModules;
+        /// excludes of conflicting modules added by the weak solve
+        std::unique_ptr<PackageSet> conflictExcludes;
+    };
+    std::unique_ptr<SolveMemo> solveMemo;
+    std::vector<Id> getSolveKey(const std::vector<ModulePackage *> & modules);
+    bool parallelFallbackSolves{false};
+
     std::string installRoot;
     std::string persistDir;
     ModuleMetadata moduleMetadata;
 
     std::map<std::string, std::string> moduleDefaults;
-    std::vector<std::tuple<LibsolvRepo *, ModulemdModuleStream *, std::string>> modulesV2;
+    std::vector<std::tuple<LibsolvRepo *, std::shared_ptr<ModuleStreamData>, std::string>> modulesV2;
+
+    enum class CacheState { NONE, LOADED, TO_WRITE };
+    /// LOADED: packages come from the module cache, moduleMetadata is empty until ensureMetadata()
+    /// TO_WRITE: the cache is written once the defaults are resolved
+    CacheState cacheState{CacheState::NONE};
+    ModuleCache moduleCache;
+    std::string moduleCachePath;
+    unsigned char moduleCacheKey[CHKSUM_BYTES];
+    /// modules metadata of the repos, used to load moduleMetadata on demand
+    std::vector<std::string> modulesPaths;
+    bool withDiskDefaults{false};
 
     bool isEnabled(const std::string &name, const std::string &stream);
 };
@@ -244,6 +289,8 @@ public:
     bool removeProfile(const std::string &name, const std::string &profile);
     bool changeState(const std::string &name, ModuleState state);
 
+    /// Load the state of all modules stored in the directory with a single directory scan
+    void load(const char *path);
     bool insert(const std::string &moduleName, const char *path);
     void rollback();
     void save(const std::string &installRoot, const std::string &modulesPath);
@@ -259,10 +306,14 @@ private:
         int streamChangesNum;
     };
     std::pair<ConfigParser, struct Config> & getEntry(const std::string & moduleName);
-    bool update(const std::string &name);
+    /// Write the state of the module to its parser, a given previous receives a copy of the
+    /// parser made just before the first change
+    bool update(const std::string &name, std::unique_ptr<ConfigParser> * previous = nullptr);
     void reset(const std::string &name);
 
     std::map<std::string, std::pair<ConfigParser, struct Config>> configs;
+    /// Directory scanned by load(), modules without a file there are inserted without reading it
+    std::string loadedPath;
 };
 
 ModulePackageContainer::EnableMultipleStreamsException::EnableMultipleStreamsException(
@@ -296,21 +347,7 @@ ModulePackageContainer::ModulePackageContainer(bool allArch, std::string install
     pImpl->installRoot = installRoot;
     g_autofree gchar * path = g_build_filename(pImpl->installRoot.c_str(),
                                               "/etc/dnf/modules.d", NULL);
-    std::unique_ptr<DIR> dir(opendir(path));
-    if (dir) {
-        struct dirent * ent;
-        /* Load "*.module" files into module persistor */
-        DIR * dirPtr = dir.get();
-        while ((ent = readdir(dirPtr)) != NULL) {
-            auto filename = ent->d_name;
-            auto fileNameLen = strlen(filename);
-            if (fileNameLen < 8 || strcmp(filename + fileNameLen - 7, ".module")) {
-                continue;
-            }
-            std::string name(filename, fileNameLen - 7);
-            pImpl->persistor->insert(name, path);
-        }
-    }
+    pImpl->persistor->load(path);
 }
 
 ModulePackageContainer::~ModulePackageContainer() = default;
@@ -328,6 +365,9 @@ ModulePackageContainer::add(DnfSack * sack)
     Pool * pool = dnf_sack_get_pool(sack);
     LibsolvRepo * r;
     Id id;
+    std::vector<std::string> repoIDs;
+    std::vector<std::string> paths;
+    std::vector<std::array<std::string, 3>> cacheRepos;
 
     FOR_REPOS(id, r) {
         HyRepo hyRepo = static_cast<HyRepo>(r->appdata);
@@ -335,58 +375,154 @@ ModulePackageContainer::add(DnfSack * sack)
         if (modules_fn.empty()) {
             continue;
         }
-        std::string yamlContent = getFileContent(modules_fn);
-        auto repoName = hyRepo->getId();
-        add(yamlContent, repoName);
-        // update defaults from repo
-        try {
-            pImpl->moduleMetadata.addMetadataFromString(yamlContent, 0);
-        } catch (const ModulePackageContainer::ResolveException & exception) {
-            throw ModulePackageContainer::ConflictException(
-                tfm::format(_("Conflicting defaults with repo '%s': %s"), repoName,
-                            exception.what()));
+        repoIDs.push_back(hyRepo->getId());
+        paths.push_back(modules_fn);
+
+        // the checksum from repomd.xml, size and mtime for repos without it
+        auto & checksums = libdnf::repoGetImpl(hyRepo)->metadataChecksums;
+        auto it = checksums.find(MD_TYPE_MODULES);
+        std::string checksum;
+        struct stat st;
+        if (it != checksums.end()) {
+            checksum = it->second;
+        } else if (stat(modules_fn.c_str(), &st) == 0) {
+            checksum = tfm::format("stat:%lld:%lld", static_cast<long long>(st.st_size),
+                                   static_cast<long long>(st.st_mtime));
+        }
+        cacheRepos.push_back({hyRepo->getId(), modules_fn, checksum});
+    }
+
+    auto cacheDir = dnf_sack_get_cache_dir(sack);
+    if (cacheDir && !paths.empty() && pImpl->cacheState == Impl::CacheState::NONE) {
+        g_autofree gchar * defaultsDir = g_build_filename(
+            pImpl->installRoot.c_str(), "/etc/dnf/modules.defaults.d/", NULL);
+        g_autofree gchar * cachePath = g_build_filename(cacheDir, MODULE_CACHE_FN, NULL);
+        ModuleCache::computeKey(cacheRepos, defaultsDir, pImpl->moduleCacheKey);
+        pImpl->moduleCachePath = cachePath;
+        if (pImpl->moduleCache.read(pImpl->moduleCachePath, pImpl->moduleCacheKey)) {
+            // warm start, the YAML is parsed only if the documents are needed later
+            for (const auto & repo : pImpl->moduleCache.repos) {
+                pImpl->addModuleStreams(repo.streams, repo.repoID);
+            }
+            pImpl->moduleCache.repos.clear();
+            pImpl->modulesPaths = std::move(paths);
+            pImpl->cacheState = Impl::CacheState::LOADED;
+            return;
         }
+        pImpl->cacheState = Impl::CacheState::TO_WRITE;
+    }
+
+    // The YAML parsing is independent per repo and runs in parallel. Module packages are created
+    // in the moduleSack pool, which is not thread safe, so the merge stays in the repo order.
+    auto indexes = ModuleMetadata::parseFiles(paths);
+    for (std::size_t i = 0; i < indexes.size(); ++i) {
+        // the same index provides the module packages and the defaults of the repo
+        ModuleMetadata md;
+        md.addMetadataFromIndex(indexes[i].get(), 0);
+        md.resolveAddedMetadata();
+        auto streams = md.getAllModuleStreams();
+        pImpl->addModuleStreams(streams, repoIDs[i]);
+        if (pImpl->cacheState == Impl::CacheState::TO_WRITE) {
+            pImpl->moduleCache.repos.push_back({repoIDs[i], paths[i], std::move(streams)});
+        }
+        // update defaults from repo
+        pImpl->moduleMetadata.addMetadataFromIndex(indexes[i].get(), 0);
     }
 }
 
-void ModulePackageContainer::addDefaultsFromDisk()
+void ModulePackageContainer::Impl::addDefaultsFromDisk()
 {
     g_autofree gchar * dirPath = g_build_filename(
-            pImpl->installRoot.c_str(), "/etc/dnf/modules.defaults.d/", NULL);
+            installRoot.c_str(), "/etc/dnf/modules.defaults.d/", NULL);
 
     for (const auto &file : filesystem::getDirContent(dirPath)) {
         std::string yamlContent = getFileContent(file);
-        pImpl->moduleMetadata.addMetadataFromString(yamlContent, 1000);
+        moduleMetadata.addMetadataFromString(yamlContent, 1000);
     }
 }
 
+void ModulePackageContainer::addDefaultsFromDisk()
+{
+    pImpl->withDiskDefaults = true;
+    // the cached defaults already cover the files, they are read again only with the metadata
+    if (pImpl->cacheState == Impl::CacheState::LOADED) {
+        return;
+    }
+    pImpl->addDefaultsFromDisk();
+}
+
 void ModulePackageContainer::moduleDefaultsResolve()
 {
+    if (pImpl->cacheState == Impl::CacheState::LOADED &&
+        pImpl->moduleCache.withDiskDefaults == pImpl->withDiskDefaults) {
+        pImpl->moduleDefaults = pImpl->moduleCache.defaults;
+        return;
+    }
+    pImpl->ensureMetadata();
     pImpl->moduleMetadata.resolveAddedMetadata();
     pImpl->moduleDefaults = pImpl->moduleMetadata.getDefaultStreams();
+
+    if (pImpl->cacheState == Impl::CacheState::TO_WRITE) {
+        pImpl->moduleCache.withDiskDefaults = pImpl->withDiskDefaults;
+        pImpl->moduleCache.defaults = pImpl->moduleDefaults;
+        pImpl->moduleCache.write(pImpl->moduleCachePath, pImpl->moduleCacheKey);
+        pImpl->moduleCache = ModuleCache();
+        pImpl->cacheState = Impl::CacheState::NONE;
+    }
+}
+
+void ModulePackageContainer::Impl::ensureMetadata()
+{
+    if (cacheState != CacheState::LOADED) {
+        return;
+    }
+    cacheState = CacheState::NONE;
+    for (auto & index : ModuleMetadata::parseFiles(modulesPaths)) {
+        moduleMetadata.addMetadataFromIndex(index.get(), 0);
+    }
+    modulesPaths.clear();
+    if (withDiskDefaults) {
+        addDefaultsFromDisk();
+    }
+    moduleMetadata.resolveAddedMetadata();
 }
 
 void
 ModulePackageContainer::add(const std::string &fileContent, const std::string & repoID)
 {
-    Pool * pool = dnf_sack_get_pool(pImpl->moduleSack);
-
     ModuleMetadata md;
     md.addMetadataFromString(fileContent, 0);
     md.resolveAddedMetadata();
+    pImpl->addModulePackages(md, repoID);
+}
 
+void
+ModulePackageContainer::Impl::addModulePackages(ModuleMetadata & md, const std::string & repoID)
+{
+    addModuleStreams(md.getAllModuleStreams(), repoID);
+}
+
+void
+ModulePackageContainer::Impl::addModuleStreams(
+    const std::vector<std::shared_ptr<ModuleStreamData>> & streams, const std::string & repoID)
+{
+    Pool * pool = dnf_sack_get_pool(moduleSack);
     LibsolvRepo * r;
     Id id;
 
     FOR_REPOS(id, r) {
         if (strcmp(r->name, "available") == 0) {
-            g_autofree gchar * path = g_build_filename(pImpl->installRoot.c_str(),
+            g_autofree gchar * path = g_build_filename(installRoot.c_str(),
                                                       "/etc/dnf/modules.d", NULL);
-            auto packages = md.getAllModulePackages(pImpl->moduleSack, r, repoID, pImpl->modulesV2);
-            for(auto const& modulePackagePtr: packages) {
-                std::unique_ptr<ModulePackage> modulePackage(modulePackagePtr);
-                pImpl->modules.insert(std::make_pair(modulePackage->getId(), std::move(modulePackage)));
-                pImpl->persistor->insert(modulePackagePtr->getName(), path);
+            for (auto const & data : streams) {
+                // streams without static context get theirs once all modules are known
+                if (!data->staticContext) {
+                    modulesV2.push_back(std::make_tuple(r, data, repoID));
+                    continue;
+                }
+                std::unique_ptr<ModulePackage> modulePackage(new ModulePackage(moduleSack, r, data, repoID));
+                persistor->insert(modulePackage->getName(), path);
+                insertModule(std::move(modulePackage));
             }
 
             return;
@@ -523,6 +659,7 @@ std::vector<std::string> ModulePackageContainer::getDefaultProfiles(std::string
     std::string moduleStream)
 {
     pImpl->addVersion2Modules();
+    pImpl->ensureMetadata();
     return pImpl->moduleMetadata.getDefaultProfiles(moduleName, moduleStream);
 }
 
@@ -672,6 +809,27 @@ void ModulePackageContainer::uninstall(const ModulePackage * module, const std::
         pImpl->persistor->removeProfile(module->getName(), profile);
 }
 
+std::vector<Id>
+ModulePackageContainer::Impl::getSolveKey(const std::vector<ModulePackage *> & modules)
+{
+    // modules are only ever added to the module sack, the number of solvables identifies its content
+    Pool * pool = dnf_sack_get_pool(moduleSack);
+    std::vector<Id> key{pool->nsolvables};
+    std::unique_ptr<PackageSet> excludes(dnf_sack_get_excludes(moduleSack));
+    if (excludes) {
+        Id id = -1;
+        while ((id = excludes->next(id)) != -1) {
+            key.push_back(id);
+        }
+    }
+    key.push_back(0);
+    for (const auto & module : modules) {
+        key.push_back(module->getId());
+        key.push_back(persistor->getState(module->getName()) == ModuleState::DEFAULT);
+    }
+    return key;
+}
+
 std::pair<std::vector<std::vector<std::string>>, ModulePackageContainer::ModuleErrorType>
 ModulePackageContainer::Impl::moduleSolve(const std::vector<ModulePackage *> & modules,
     bool debugSolver)
@@ -681,6 +839,35 @@ ModulePackageContainer::Impl::moduleSolve(const std::vector<ModulePackage *> & m
         return std::make_pair(std::vector<std::vector<std::string>>(),
                               ModulePackageContainer::ModuleErrorType::NO_ERROR);
     }
+
+    // Module filtering is repeated with unchanged module states (e.g. when recomputing the
+    // modular filtering), the same input always gives the same result
+    auto key = getSolveKey(modules);
+    if (!debugSolver && solveMemo && solveMemo->key == key) {
+        if (solveMemo->conflictExcludes) {
+            dnf_sack_add_excludes(moduleSack, solveMemo->conflictExcludes.get());
+        }
+        activatedModules.reset(
+            solveMemo->activatedModules ? new PackageSet(*solveMemo->activatedModules) : nullptr);
+        return std::make_pair(solveMemo->problems, solveMemo->problemType);
+    }
+
+    std::unique_ptr<SolveMemo> memo(new SolveMemo);
+    memo->key = std::move(key);
+    auto result = runModuleSolve(modules, debugSolver, memo->conflictExcludes);
+    memo->problems = result.first;
+    memo->problemType = result.second;
+    if (activatedModules) {
+        memo->activatedModules.reset(new PackageSet(*activatedModules));
+    }
+    solveMemo = std::move(memo);
+    return result;
+}
+
+std::pair<std::vector<std::vector<std::string>>, ModulePackageContainer::ModuleErrorType>
+ModulePackageContainer::Impl::runModuleSolve(const std::vector<ModulePackage *> & modules,
+    bool debugSolver, std::unique_ptr<PackageSet> & conflictExcludes)
+{
     dnf_sack_recompute_considered(moduleSack);
     dnf_sack_make_provides_ready(moduleSack);
     Goal goal(moduleSack);
@@ -701,18 +888,50 @@ ModulePackageContainer::Impl::moduleSolve(const std::vector<ModulePackage *> & m
     }
     std::vector<std::vector<std::string>> problems;
     auto problemType = ModulePackageContainer::ModuleErrorType::NO_ERROR;
+    // the fallback solves differ only in their flags, each runs on its own copy of the goal
+    Goal goalLatest(goal);
+    Goal * resolvedGoal = &goal;
     if (ret) {
         // Goal run ignor problem in defaults
         problems = goal.describeAllProblemRules(false);
-        ret = goal.run(DNF_FORCE_BEST);
+        int retLatest = 1;
+        if (parallelFallbackSolves) {
+            Pool * pool = dnf_sack_get_pool(moduleSack);
+            dnf_sack_prepare_concurrent_solves(moduleSack);
+            // printing the results uses the pool temporary space
+            int debugmask = pool->debugmask;
+            pool_setdebugmask(pool, 0);
+            std::exception_ptr failure;
+            std::thread latestThread([&]() {
+                try {
+                    // Goal run ignor problem in defaults and in latest
+                    retLatest = goalLatest.run(DNF_NONE);
+                } catch (...) {
+                    failure = std::current_exception();
+                }
+            });
+            ret = goal.run(DNF_FORCE_BEST);
+            latestThread.join();
+            pool_setdebugmask(pool, debugmask);
+            if (failure) {
+                std::rethrow_exception(failure);
+            }
+        } else {
+            ret = goal.run(DNF_FORCE_BEST);
+            if (ret) {
+                // Goal run ignor problem in defaults and in latest
+                retLatest = goalLatest.run(DNF_NONE);
+            }
+        }
         if (ret) {
-            // Goal run ignor problem in defaults and in latest
-            ret = goal.run(DNF_NONE);
+            resolvedGoal = &goalLatest;
+            ret = retLatest;
             if (ret) {
                 // Conflicting modules has to be removed otherwice it could result than one of them will
                 // be active
-                auto conflictingPkgs = goal.listConflictPkgs(DNF_PACKAGE_STATE_AVAILABLE);
+                auto conflictingPkgs = goalLatest.listConflictPkgs(DNF_PACKAGE_STATE_AVAILABLE);
                 dnf_sack_add_excludes(moduleSack, conflictingPkgs.get());
+                conflictExcludes = std::move(conflictingPkgs);
                 ret = goalWeak.run(DNF_NONE);
                 if (ret) {
                     auto logger(Log::getLogger());
@@ -733,7 +952,7 @@ ModulePackageContainer::Impl::moduleSolve(const std::vector<ModulePackage *> & m
         }
     }
     Query query(moduleSack, Query::ExcludeFlags::IGNORE_EXCLUDES);
-    goal2name_query(goal, query);
+    goal2name_query(*resolvedGoal, query);
     activatedModules.reset(new PackageSet(*query.runSet()));
     return make_pair(problems, problemType);
 }
@@ -770,29 +989,79 @@ ModulePackageContainer::query(std::string name, std::string stream, std::string
     std::string context, std::string arch)
 {
     pImpl->addVersion2Modules();
-    // Alternatively a search using module provides could be performed
-    std::vector<ModulePackage *> result;
-    Query query(pImpl->moduleSack, Query::ExcludeFlags::IGNORE_EXCLUDES);
-    // platform modules are installed and not in modules std::Map.
-    query.available();
-    if (!name.empty() || !stream.empty()) {
-        std::ostringstream ss;
-        ss << stringFormater(name) << ":" << stringFormater(stream);
-        query.addFilter(HY_PKG_DESCRIPTION, HY_GLOB, ss.str().c_str());
-    }
-    if (!context.empty()) {
-        query.addFilter(HY_PKG_SUMMARY, HY_GLOB, context.c_str());
-    }
-    if (!arch.empty()) {
-        query.addFilter(HY_PKG_ARCH, HY_GLOB, arch.c_str());
-    }
-    if (!version.empty()) {
-        query.addFilter(HY_PKG_VERSION, HY_GLOB, version.c_str());
+    return pImpl->lookup(name, stream, version, context, arch);
+}
+
+void ModulePackageContainer::Impl::insertModule(std::unique_ptr<ModulePackage> modulePackage)
+{
+    auto id = modulePackage->getId();
+    modulesIndex[modulePackage->getName()][modulePackage->getStream()][modulePackage->getContext()]
+        .push_back(id);
+    modules.insert(std::make_pair(id, std::move(modulePackage)));
+}
+
+/// Call callback for the values of the index matching the key, the key is a glob or an exact
+/// value, an empty key matches all.
+template<typename Map, typename Callback>
+static void forMatching(Map & index, const std::string & key, Callback callback)
+{
+    if (key.empty()) {
+        for (auto & item : index) {
+            callback(item.second);
+        }
+    } else if (hy_is_glob_pattern(key.c_str())) {
+        for (auto & item : index) {
+            if (fnmatch(key.c_str(), item.first.c_str(), 0) == 0) {
+                callback(item.second);
+            }
+        }
+    } else {
+        auto it = index.find(key);
+        if (it != index.end()) {
+            callback(it->second);
+        }
     }
-    auto pset = query.runSet();
-    Id moduleId = -1;
-    while ((moduleId = pset->next(moduleId)) != -1) {
-        result.push_back(pImpl->modules.at(moduleId).get());
+}
+
+static bool
+matchesGlob(const std::string & pattern, const std::string & value)
+{
+    return pattern.empty() || fnmatch(pattern.c_str(), value.c_str(), 0) == 0;
+}
+
+/**
+ * @brief Same result as the glob filters of the module sack query: on name:stream stored
+ * in the description, the original context in the summary, the arch and the version. Modules
+ * are returned in the order of their ids.
+ */
+std::vector<ModulePackage *> ModulePackageContainer::Impl::lookup(const std::string & name,
+    const std::string & stream, const std::string & version, const std::string & context,
+    const std::string & arch)
+{
+    std::vector<Id> ids;
+    forMatching(modulesIndex, name, [&](std::map<std::string, std::map<std::string, std::vector<Id>>> & streams) {
+        forMatching(streams, stream, [&](std::map<std::string, std::vector<Id>> & contexts) {
+            forMatching(contexts, context, [&](std::vector<Id> & contextIds) {
+                ids.insert(ids.end(), contextIds.begin(), contextIds.end());
+            });
+        });
+    });
+    std::sort(ids.begin(), ids.end());
+
+    std::vector<ModulePackage *> result;
+    for (auto id : ids) {
+        auto modulePackage = modules.at(id).get();
+        if (!matchesGlob(version, modulePackage->getVersion())) {
+            continue;
+        }
+        // packages without arch have the "noarch" solvable arch
+        if (!arch.empty()) {
+            auto moduleArch = modulePackage->getArch();
+            if (!matchesGlob(arch, moduleArch.empty() ? "noarch" : moduleArch)) {
+                continue;
+            }
+        }
+        result.push_back(modulePackage);
     }
     return result;
 }
@@ -1167,6 +1436,11 @@ ModulePackageContainer::resolveActiveModulePackages(bool debugSolver)
     return problems;
 }
 
+void ModulePackageContainer::setParallelFallbackSolves(bool enable)
+{
+    pImpl->parallelFallbackSolves = enable;
+}
+
 bool ModulePackageContainer::isModuleActive(Id id)
 {
     if (pImpl->activatedModules) {
@@ -1394,6 +1668,29 @@ parseConfig(ConfigParser &parser, const std::string &name, const char *path)
     }
 }
 
+void ModulePackageContainer::Impl::ModulePersistor::load(const char *path)
+{
+    std::unique_ptr<DIR> dir(opendir(path));
+    if (!dir) {
+        loadedPath = path;
+        return;
+    }
+    struct dirent * ent;
+    /* Load "*.module" files into module persistor */
+    DIR * dirPtr = dir.get();
+    while ((ent = readdir(dirPtr)) != NULL) {
+        auto filename = ent->d_name;
+        auto fileNameLen = strlen(filename);
+        if (fileNameLen < 8 || strcmp(filename + fileNameLen - 7, ".module")) {
+            continue;
+        }
+        std::string name(filename, fileNameLen - 7);
+        insert(name, path);
+    }
+    // every file of the directory is loaded now, insert() of other modules skips the filesystem
+    loadedPath = path;
+}
+
 bool ModulePackageContainer::Impl::ModulePersistor::insert(
     const std::string &moduleName, const char *path)
 {
@@ -1406,7 +1703,11 @@ bool ModulePackageContainer::Impl::ModulePersistor::insert(
     auto & parser = newEntry.first->second.first;
     auto & newConfig = newEntry.first->second.second;
 
-    parseConfig(parser, moduleName, path);
+    if (!loadedPath.empty() && loadedPath == path) {
+        initConfig(parser, moduleName);
+    } else {
+        parseConfig(parser, moduleName, path);
+    }
 
     OptionStringList slist{std::vector<std::string>()};
     const auto &plist = parser.getValue(moduleName, "profiles");
@@ -1419,28 +1720,33 @@ bool ModulePackageContainer::Impl::ModulePersistor::insert(
     return true;
 }
 
-bool ModulePackageContainer::Impl::ModulePersistor::update(const std::string & name)
+bool ModulePackageContainer::Impl::ModulePersistor::update(
+    const std::string & name, std::unique_ptr<ConfigParser> * previous)
 {
     bool changed = false;
     auto & parser = getEntry(name).first;
+    auto setValue = [&](const char * option, const std::string & value) {
+        if (previous && !changed) {
+            previous->reset(new ConfigParser(parser));
+        }
+        parser.setValue(name, option, value);
+        changed = true;
+    };
 
     const auto & state = toString(getState(name));
     if (!parser.hasOption(name, "state") || parser.getValue(name, "state") != state) {
-        parser.setValue(name, "state", state);
-        changed = true;
+        setValue("state", state);
     }
 
     const auto & stream = getStream(name);
     if (!parser.hasOption(name, "stream") || parser.getValue(name, "stream") != stream) {
-        parser.setValue(name, "stream", stream);
-        changed = true;
+        setValue("stream", stream);
     }
 
     OptionStringList profiles{getProfiles(name)};
     if (!parser.hasOption(name, "profiles") ||
         OptionStringList(parser.getValue(name, "profiles")).getValue() != profiles.getValue()) {
-        parser.setValue(name, "profiles", profiles.getValueString());
-        changed = true;
+        setValue("profiles", profiles.getValueString());
     }
 
     return changed;
@@ -1460,17 +1766,59 @@ void ModulePackageContainer::Impl::ModulePersistor::reset(const std::string & na
 void ModulePackageContainer::Impl::ModulePersistor::save(
     const std::string &installRoot, const std::string &modulesPath)
 {
-    g_autofree gchar * dirname = g_build_filename(
-        installRoot.c_str(), modulesPath.c_str(), "/", NULL);
-    makeDirPath(std::string(dirname));
+    // a module counts as saved only once its file is renamed, until then the parser can be restored
+    struct PendingFile {
+        std::string path;
+        std::string tmpPath;
+        ConfigParser * parser;
+        ConfigParser previous;
+    };
+    std::vector<PendingFile> changed;
+    auto restore = [&changed](std::vector<PendingFile>::iterator from) {
+        for (auto it = from; it != changed.end(); ++it) {
+            *it->parser = std::move(it->previous);
+            unlink(it->tmpPath.c_str());
+        }
+    };
 
     for (auto &iter : configs) {
         const auto &name = iter.first;
+        auto & parser = iter.second.first;
+        // only the parsers of changed modules are copied
+        std::unique_ptr<ConfigParser> previous;
 
-        if (update(name)) {
+        if (update(name, &previous)) {
             g_autofree gchar * fname = g_build_filename(installRoot.c_str(),
                     modulesPath.c_str(), (name + ".module").c_str(), NULL);
-            iter.second.first.write(std::string(fname), false);
+            changed.push_back({fname, std::string(fname) + ".tmp", &parser, std::move(*previous)});
+            // the temporary files are renamed at once, readers never see a partial file
+            try {
+                if (changed.size() == 1) {
+                    g_autofree gchar * dirname = g_build_filename(
+                        installRoot.c_str(), modulesPath.c_str(), "/", NULL);
+                    makeDirPath(std::string(dirname));
+                }
+                auto & file = changed.back();
+                parser.write(file.tmpPath, false);
+                // keep the permissions of the replaced file
+                struct stat st;
+                if (stat(file.path.c_str(), &st) == 0) {
+                    chmod(file.tmpPath.c_str(), st.st_mode & 07777);
+                }
+            } catch (...) {
+                restore(changed.begin());
+                throw;
+            }
+        }
+    }
+
+    for (auto it = changed.begin(); it != changed.end(); ++it) {
+        if (rename(it->tmpPath.c_str(), it->path.c_str()) == -1) {
+            const char * errTxt = strerror(errno);
+            auto path = it->path;
+            restore(it);
+            throw Exception(tfm::format(_("Cannot save module state to \"%s\": %s"),
+                                        path, errTxt));
         }
     }
 }
@@ -1746,33 +2094,31 @@ void ModulePackageContainer::Impl::addVersion2Modules()
         v3_context_map[module->getNameStream()][concentratedRequires].push_back(module);
     }
     libdnf::LibsolvRepo * repo;
-    ModulemdModuleStream * mdStream;
+    std::shared_ptr<ModuleStreamData> data;
     std::string repoID;
     g_autofree gchar * path = g_build_filename(installRoot.c_str(), "/etc/dnf/modules.d", NULL);
     for (auto & module_tuple : modulesV2) {
-        std::tie(repo, mdStream, repoID) = module_tuple;
-        auto nameStream = ModulePackage::getNameStream(mdStream);
-        auto requires = ModulePackage::getRequires(mdStream, true);
+        std::tie(repo, data, repoID) = module_tuple;
+        auto nameStream = ModulePackage::getNameStream(*data);
+        auto requires = ModulePackage::getRequires(*data, true);
         auto concentratedRequires = concentrateVectorString(requires);
         auto streamIterator = v3_context_map.find(nameStream);
         if (streamIterator != v3_context_map.end()) {
             auto contextIterator = streamIterator->second.find(concentratedRequires);
             if (contextIterator != streamIterator->second.end()) {
                 auto v3_context = contextIterator->second[0]->getContext();
-                std::unique_ptr<ModulePackage> modulePackage(new ModulePackage(moduleSack, repo, mdStream, repoID, v3_context));
+                std::unique_ptr<ModulePackage> modulePackage(new ModulePackage(moduleSack, repo, data, repoID, v3_context));
                 persistor->insert(modulePackage->getName(), path);
-                modules.insert(std::make_pair(modulePackage->getId(), std::move(modulePackage)));
-                g_object_unref(mdStream);
+                insertModule(std::move(modulePackage));
                 continue;
             }
         }
         if (concentratedRequires.empty()) {
             concentratedRequires.append("NoRequires");
         }
-        std::unique_ptr<ModulePackage> modulePackage(new ModulePackage(moduleSack, repo, mdStream, repoID, concentratedRequires));
+        std::unique_ptr<ModulePackage> modulePackage(new ModulePackage(moduleSack, repo, data, repoID, concentratedRequires));
         persistor->insert(modulePackage->getName(), path);
-        modules.insert(std::make_pair(modulePackage->getId(), std::move(modulePackage)));
-        g_object_unref(mdStream);
+        insertModule(std::move(modulePackage));
     }
     modulesV2.clear();
 }
@@ -1834,6 +2180,7 @@ void ModulePackageContainer::updateFailSafeData()
 }
 
 void ModulePackageContainer::applyObsoletes(){
+    pImpl->ensureMetadata();
     for (const auto &iter : pImpl->modules) {
         auto modulePkg = iter.second.get();
         if (!isEnabled(modulePkg)) {
@@ -294,6 +294,14 @@ public:
         std::string version, std::string context, std::string arch);
     void enableDependencyTree(std::vector<ModulePackage *> & modulePackages);
     std::pair<std::vector<std::vector<std::string>>, ModulePackageContainer::ModuleErrorType> resolveActiveModulePackages(bool debugSolver);
+    /**
+    * @brief Run the fallback solves of resolveActiveModulePackages() in parallel.
+    *
+    * When the modules cannot be resolved strictly, the solves ignoring problems in defaults and
+    * in latest are started at once, each on its own solver. The result is the same as when they
+    * run one after another. Disabled by default.
+    */
+    void setParallelFallbackSolves(bool enable);
     bool isModuleActive(Id id);
     bool isModuleActive(const ModulePackage * modulePackage);
     void loadFailSafeData();
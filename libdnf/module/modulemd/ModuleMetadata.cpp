@@ -21,11 +21,22 @@
 #include "ModuleMetadata.hpp"
 
 #include "../ModulePackageContainer.hpp"
+#include "../ModulePackage-private.hpp"
+#include "../../utils/File.hpp"
 
 #include "bgettext/bgettext-lib.h"
 #include "tinyformat/tinyformat.hpp"
 #include "../../log.hpp"
 
+extern "C" {
+#   include <solv/solv_xfopen.h>
+}
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <thread>
+
 namespace libdnf {
 
 ModuleMetadata::ModuleMetadata(): resultingModuleIndex(NULL), moduleMerger(NULL) {}
@@ -82,9 +93,75 @@ void ModuleMetadata::addMetadataFromString(const std::string & yaml, int priorit
     if(!success){
         ModuleMetadata::reportFailures(failures);
     }
-    if (error)
+    if (error) {
+        g_object_unref(mi);
         throw ModulePackageContainer::ResolveException( tfm::format(_("Failed to update from string: %s"), error->message));
+    }
+
+    addMetadataFromIndex(mi, priority);
+    g_object_unref(mi);
+}
+
+ModulemdModuleIndex * ModuleMetadata::parseFile(const std::string & path)
+{
+    GError *error = NULL;
+    g_autoptr(GPtrArray) failures = NULL;
+
+    FILE * stream = solv_xfopen(path.c_str(), "r");
+    if (!stream)
+        throw File::OpenError(path);
+
+    ModulemdModuleIndex * mi = modulemd_module_index_new();
+    gboolean success = modulemd_module_index_update_from_stream(mi, stream, FALSE, &failures, &error);
+    fclose(stream);
+    if(!success){
+        ModuleMetadata::reportFailures(failures);
+    }
+    if (error) {
+        g_object_unref(mi);
+        throw ModulePackageContainer::ResolveException(tfm::format(_("Failed to update from file %s: %s"),
+                                                                   path, error->message));
+    }
+    return mi;
+}
+
+std::vector<ModuleMetadata::IndexPtr> ModuleMetadata::parseFiles(const std::vector<std::string> & paths)
+{
+    std::vector<IndexPtr> indexes;
+    indexes.reserve(paths.size());
+    for (std::size_t i = 0; i < paths.size(); ++i)
+        indexes.emplace_back(nullptr, g_object_unref);
+    std::vector<std::exception_ptr> failures(paths.size());
+
+    std::atomic<std::size_t> next{0};
+    auto worker = [&]() {
+        for (auto i = next++; i < paths.size(); i = next++) {
+            try {
+                indexes[i].reset(parseFile(paths[i]));
+            } catch (...) {
+                failures[i] = std::current_exception();
+            }
+        }
+    };
+
+    std::size_t nthreads = std::min<std::size_t>(paths.size(),
+                                                 std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<std::thread> threads;
+    for (std::size_t i = 1; i < nthreads; ++i)
+        threads.emplace_back(worker);
+    worker();
+    for (auto & thread : threads)
+        thread.join();
+
+    for (auto & failure : failures) {
+        if (failure)
+            std::rethrow_exception(failure);
+    }
+    return indexes;
+}
 
+void ModuleMetadata::addMetadataFromIndex(ModulemdModuleIndex * index, int priority)
+{
     if (!moduleMerger){
         moduleMerger = modulemd_module_index_merger_new();
         if (resultingModuleIndex){
@@ -94,8 +171,8 @@ void ModuleMetadata::addMetadataFromString(const std::string & yaml, int priorit
         }
     }
 
-    modulemd_module_index_merger_associate_index(moduleMerger, mi, priority);
-    g_object_unref(mi);
+    // the merger takes its own reference, the index itself is not modified by resolving
+    modulemd_module_index_merger_associate_index(moduleMerger, index, priority);
 }
 
 void ModuleMetadata::resolveAddedMetadata()
@@ -124,12 +201,9 @@ void ModuleMetadata::resolveAddedMetadata()
     g_clear_pointer(&moduleMerger, g_object_unref);
 }
 
-std::vector<ModulePackage *> ModuleMetadata::getAllModulePackages(DnfSack * moduleSack,
-                                                                  LibsolvRepo * repo,
-                                                                  const std::string & repoID,
-                                                                  std::vector<std::tuple<LibsolvRepo *, ModulemdModuleStream *, std::string>> & modulesV2)
+std::vector<std::shared_ptr<ModuleStreamData>> ModuleMetadata::getAllModuleStreams()
 {
-    std::vector<ModulePackage *> result;
+    std::vector<std::shared_ptr<ModuleStreamData>> result;
     if (!resultingModuleIndex)
         return result;
 
@@ -142,12 +216,7 @@ std::vector<ModulePackage *> ModuleMetadata::getAllModulePackages(DnfSack * modu
         //GPtrArray * streams = modulemd_module_index_search_streams_by_nsvca_glob(resultingModuleIndex, NULL);
         for (unsigned int i = 0; i < streams->len; i++){
             ModulemdModuleStream * moduleMdStream = static_cast<ModulemdModuleStream *>(g_ptr_array_index(streams, i));
-            if (modulemd_module_stream_v2_is_static_context((ModulemdModuleStreamV2 *) moduleMdStream)) {
-                result.push_back(new ModulePackage(moduleSack, repo, moduleMdStream, repoID));
-            } else {
-                g_object_ref(moduleMdStream);
-                modulesV2.push_back(std::make_tuple(repo, moduleMdStream, repoID));
-            }
+            result.push_back(ModuleStreamData::fromStream(moduleMdStream));
         }
     }
 
@@ -155,6 +224,21 @@ std::vector<ModulePackage *> ModuleMetadata::getAllModulePackages(DnfSack * modu
     return result;
 }
 
+ModulemdModuleStream * ModuleMetadata::getModuleStream(const std::string & name, const std::string & stream,
+                                                       unsigned long long version, const std::string & context,
+                                                       const std::string & arch)
+{
+    if (!resultingModuleIndex)
+        return nullptr;
+
+    ModulemdModule * m = modulemd_module_index_get_module(resultingModuleIndex, name.c_str());
+    if (!m)
+        return nullptr;
+    return modulemd_module_get_stream_by_NSVCA(m, stream.c_str(), version,
+                                               context.empty() ? NULL : context.c_str(),
+                                               arch.empty() ? NULL : arch.c_str(), NULL);
+}
+
 std::map<std::string, std::string> ModuleMetadata::getDefaultStreams()
 {
     std::map<std::string, std::string> moduleDefaults;
@@ -25,18 +25,39 @@
 
 #include "../ModulePackage.hpp"
 
+#include <memory>
+
 namespace libdnf {
 
+struct ModuleStreamData;
+
 class ModuleMetadata
 {
 public:
+    using IndexPtr = std::unique_ptr<ModulemdModuleIndex, void (*)(gpointer)>;
+
     ModuleMetadata();
     ModuleMetadata(const ModuleMetadata & m);
     ModuleMetadata & operator=(const ModuleMetadata & m);
     ~ModuleMetadata();
     void addMetadataFromString(const std::string & yaml, int priority);
+    /// Associate an already parsed index, it can be shared by several ModuleMetadata objects
+    void addMetadataFromIndex(ModulemdModuleIndex * index, int priority);
+    /// Parse the (possibly compressed) file without reading it into memory first
+    static ModulemdModuleIndex * parseFile(const std::string & path);
+    /**
+    * @brief Parse the files on a pool of threads. The files are independent, the result is
+    * in the order of paths. If any parse fails, the exception of the first failing path is
+    * rethrown after all threads finished.
+    */
+    static std::vector<IndexPtr> parseFiles(const std::vector<std::string> & paths);
     void resolveAddedMetadata();
-    std::vector<ModulePackage *> getAllModulePackages(DnfSack * moduleSack, LibsolvRepo * repo, const std::string & repoID, std::vector<std::tuple<LibsolvRepo *, ModulemdModuleStream *, std::string>> & modulesV2);
+    /// Data of all module streams, in the order the module packages are created in
+    std::vector<std::shared_ptr<ModuleStreamData>> getAllModuleStreams();
+    /// @return borrowed stream matching NSVCA, nullptr if there is none
+    ModulemdModuleStream * getModuleStream(const std::string & name, const std::string & stream,
+                                           unsigned long long version, const std::string & context,
+                                           const std::string & arch);
     std::map<std::string, std::string> getDefaultStreams();
     std::vector<std::string> getDefaultProfiles(std::string moduleName, std::string moduleStream);
     ModulemdObsoletes * getNewestActiveObsolete(ModulePackage *p);
@@ -22,38 +22,115 @@
 #include "hy-nevra.h"
 #include "dnf-sack.h"
 
-#include "regex/regex.hpp"
+#include <cstring>
 
 namespace libdnf {
 
-#define PKG_NAME "([^:(/=<> ]+)"
-#define PKG_EPOCH "(([0-9]+):)?"
-#define PKG_VERSION "([^-:(/=<> ]+)"
-#define PKG_RELEASE PKG_VERSION
-#define PKG_ARCH "([^-:.(/=<> ]+)"
-
-static const Regex NEVRA_FORM_REGEX[]{
-    Regex("^" PKG_NAME "-" PKG_EPOCH PKG_VERSION "-" PKG_RELEASE "\\." PKG_ARCH "$", REG_EXTENDED),
-    Regex("^" PKG_NAME "-" PKG_EPOCH PKG_VERSION "-" PKG_RELEASE          "()"  "$", REG_EXTENDED),
-    Regex("^" PKG_NAME "-" PKG_EPOCH PKG_VERSION        "()"              "()"  "$", REG_EXTENDED),
-    Regex("^" PKG_NAME      "()()"      "()"            "()"     "\\." PKG_ARCH "$", REG_EXTENDED),
-    Regex("^" PKG_NAME      "()()"      "()"            "()"              "()"  "$", REG_EXTENDED)
+namespace {
+
+/// Which parts the form has after the name, indexed by HyForm - 1
+struct NevraForm {
+    bool evr;
+    bool release;
+    bool arch;
+};
+
+constexpr NevraForm NEVRA_FORMS[]{
+    {true,  true,  true},   // HY_FORM_NEVRA
+    {true,  true,  false},  // HY_FORM_NEVR
+    {true,  false, false},  // HY_FORM_NEV
+    {false, false, true},   // HY_FORM_NA
+    {false, false, false}   // HY_FORM_NAME
 };
 
+/// Characters that are not allowed anywhere in NEVRA, ':' is only allowed after the epoch
+inline bool isForbidden(char c) noexcept
+{
+    switch (c) {
+        case '(': case '/': case '=': case '<': case '>': case ' ':
+            return true;
+        default:
+            return false;
+    }
+}
+
+/// Last occurrence of c in [begin, end) or nullptr
+inline const char * findLast(const char * begin, const char * end, char c) noexcept
+{
+    while (end != begin) {
+        if (*--end == c)
+            return end;
+    }
+    return nullptr;
+}
+
+inline bool containsColon(const char * begin, const char * end) noexcept
+{
+    return std::memchr(begin, ':', end - begin) != nullptr;
+}
+
+}
+
 bool Nevra::parse(const char * nevraStr, HyForm form)
 {
-    enum { NAME = 1, EPOCH = 3, VERSION = 4, RELEASE = 5, ARCH = 6, _LAST_ };
-    auto matchResult = NEVRA_FORM_REGEX[form - 1].match(nevraStr, false, _LAST_);
-    if (!matchResult.isMatched() || matchResult.getMatchedLen(NAME) == 0)
+    // Parts are split from the right, the name may contain '-' and '.' but no other part can.
+    const auto & nevraForm = NEVRA_FORMS[form - 1];
+    const char * end = nevraStr;
+    for (; *end; ++end) {
+        if (isForbidden(*end))
+            return false;
+    }
+
+    const char * strEnd = end;
+    const char * archBegin = end;
+    if (nevraForm.arch) {
+        auto dot = findLast(nevraStr, end, '.');
+        if (!dot || dot + 1 == end || containsColon(dot + 1, end) ||
+            std::memchr(dot + 1, '-', end - dot - 1))
+            return false;
+        archBegin = dot + 1;
+        end = dot;
+    }
+    const char * releaseBegin = end;
+    const char * releaseEnd = end;
+    if (nevraForm.release) {
+        auto dash = findLast(nevraStr, end, '-');
+        if (!dash || dash + 1 == end || containsColon(dash + 1, end))
+            return false;
+        releaseBegin = dash + 1;
+        end = dash;
+    }
+    const char * epochBegin = nullptr;
+    const char * versionBegin = end;
+    const char * versionEnd = end;
+    if (nevraForm.evr) {
+        auto dash = findLast(nevraStr, end, '-');
+        if (!dash)
+            return false;
+        versionBegin = dash + 1;
+        auto colon = static_cast<const char *>(std::memchr(versionBegin, ':', end - versionBegin));
+        if (colon) {
+            if (colon == versionBegin)
+                return false;
+            for (auto digit = versionBegin; digit != colon; ++digit) {
+                if (*digit < '0' || *digit > '9')
+                    return false;
+            }
+            epochBegin = versionBegin;
+            versionBegin = colon + 1;
+        }
+        if (versionBegin == end || containsColon(versionBegin, end))
+            return false;
+        end = dash;
+    }
+    if (end == nevraStr || containsColon(nevraStr, end))
         return false;
-    name = matchResult.getMatchedString(NAME);
-    if (matchResult.getMatchedLen(EPOCH) > 0)
-        epoch = atoi(matchResult.getMatchedString(EPOCH).c_str());
-    else
-        epoch = EPOCH_NOT_SET;
-    version = matchResult.getMatchedString(VERSION);
-    release = matchResult.getMatchedString(RELEASE);
-    arch = matchResult.getMatchedString(ARCH);
+
+    name.assign(nevraStr, end);
+    epoch = epochBegin ? atoi(epochBegin) : EPOCH_NOT_SET;
+    version.assign(versionBegin, versionEnd);
+    release.assign(releaseBegin, releaseEnd);
+    arch.assign(archBegin, strEnd);
     return true;
 }
 
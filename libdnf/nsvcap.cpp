@@ -26,48 +26,146 @@
 
 #include "libdnf/utils/utils.hpp"
 
-#include <regex/regex.hpp>
+#include <cstring>
 
 namespace libdnf {
 
-#define MODULE_NAME "([" GLOB ASCII_LETTERS DIGITS MODULE_SPECIAL "]+)"
-#define MODULE_STREAM MODULE_NAME
-#define MODULE_VERSION "([" GLOB DIGITS "-]+)"
-#define MODULE_CONTEXT MODULE_NAME
-#define MODULE_ARCH MODULE_NAME
-#define MODULE_PROFILE MODULE_NAME
-
-static const Regex NSVCAP_FORM_REGEX[]{
-    Regex("^" MODULE_NAME ":" MODULE_STREAM ":" MODULE_VERSION ":" MODULE_CONTEXT "::?" MODULE_ARCH "\\/"  MODULE_PROFILE "$", REG_EXTENDED),
-    Regex("^" MODULE_NAME ":" MODULE_STREAM ":" MODULE_VERSION ":" MODULE_CONTEXT "::?" MODULE_ARCH "\\/?" "()"           "$", REG_EXTENDED),
-    Regex("^" MODULE_NAME ":" MODULE_STREAM ":" MODULE_VERSION     "()"           "::"  MODULE_ARCH "\\/"  MODULE_PROFILE "$", REG_EXTENDED),
-    Regex("^" MODULE_NAME ":" MODULE_STREAM ":" MODULE_VERSION     "()"           "::"  MODULE_ARCH "\\/?" "()"           "$", REG_EXTENDED),
-    Regex("^" MODULE_NAME ":" MODULE_STREAM     "()"               "()"           "::"  MODULE_ARCH "\\/"  MODULE_PROFILE "$", REG_EXTENDED),
-    Regex("^" MODULE_NAME ":" MODULE_STREAM     "()"               "()"           "::"  MODULE_ARCH "\\/?" "()"           "$", REG_EXTENDED),
-    Regex("^" MODULE_NAME ":" MODULE_STREAM ":" MODULE_VERSION ":" MODULE_CONTEXT       "()"        "\\/"  MODULE_PROFILE "$", REG_EXTENDED),
-    Regex("^" MODULE_NAME ":" MODULE_STREAM ":" MODULE_VERSION     "()"                 "()"        "\\/"  MODULE_PROFILE "$", REG_EXTENDED),
-    Regex("^" MODULE_NAME ":" MODULE_STREAM ":" MODULE_VERSION ":" MODULE_CONTEXT       "()"        "\\/?" "()"           "$", REG_EXTENDED),
-    Regex("^" MODULE_NAME ":" MODULE_STREAM ":" MODULE_VERSION     "()"                 "()"        "\\/?" "()"           "$", REG_EXTENDED),
-    Regex("^" MODULE_NAME ":" MODULE_STREAM     "()"               "()"                 "()"        "\\/"  MODULE_PROFILE "$", REG_EXTENDED),
-    Regex("^" MODULE_NAME ":" MODULE_STREAM     "()"               "()"                 "()"        "\\/?" "()"           "$", REG_EXTENDED),
-    Regex("^" MODULE_NAME     "()"              "()"               "()"           "::"  MODULE_ARCH "\\/"  MODULE_PROFILE "$", REG_EXTENDED),
-    Regex("^" MODULE_NAME     "()"              "()"               "()"           "::"  MODULE_ARCH "\\/?" "()"           "$", REG_EXTENDED),
-    Regex("^" MODULE_NAME     "()"              "()"               "()"                 "()"        "\\/"  MODULE_PROFILE "$", REG_EXTENDED),
-    Regex("^" MODULE_NAME     "()"              "()"               "()"                 "()"        "\\/?" "()"           "$", REG_EXTENDED)
+namespace {
+
+class CharSet {
+public:
+    explicit CharSet(const char * chars)
+    {
+        for (; *chars; ++chars)
+            table[static_cast<unsigned char>(*chars)] = true;
+    }
+    bool contains(const char * begin, const char * end) const noexcept
+    {
+        for (; begin != end; ++begin) {
+            if (!table[static_cast<unsigned char>(*begin)])
+                return false;
+        }
+        return true;
+    }
+
+private:
+    bool table[256]{};
+};
+
+const CharSet MODULE_CHARS(GLOB ASCII_LETTERS DIGITS MODULE_SPECIAL);
+const CharSet MODULE_VERSION_CHARS(GLOB DIGITS "-");
+
+/**
+* ':' separated parts of the forms indexed by HyModuleForm - 1. Letters are the fields, '_' is
+* a part that must be empty and '?' an empty part that may be omitted ("::?" in the pattern).
+*/
+struct NsvcapForm {
+    const char * parts;
+    bool profile;
 };
 
+constexpr NsvcapForm NSVCAP_FORMS[]{
+    {"NSVC?A", true},   // HY_MODULE_FORM_NSVCAP
+    {"NSVC?A", false},  // HY_MODULE_FORM_NSVCA
+    {"NSV_A",  true},   // HY_MODULE_FORM_NSVAP
+    {"NSV_A",  false},  // HY_MODULE_FORM_NSVA
+    {"NS_A",   true},   // HY_MODULE_FORM_NSAP
+    {"NS_A",   false},  // HY_MODULE_FORM_NSA
+    {"NSVC",   true},   // HY_MODULE_FORM_NSVCP
+    {"NSV",    true},   // HY_MODULE_FORM_NSVP
+    {"NSVC",   false},  // HY_MODULE_FORM_NSVC
+    {"NSV",    false},  // HY_MODULE_FORM_NSV
+    {"NS",     true},   // HY_MODULE_FORM_NSP
+    {"NS",     false},  // HY_MODULE_FORM_NS
+    {"N_A",    true},   // HY_MODULE_FORM_NAP
+    {"N_A",    false},  // HY_MODULE_FORM_NA
+    {"N",      true},   // HY_MODULE_FORM_NP
+    {"N",      false}   // HY_MODULE_FORM_N
+};
+
+struct Span {
+    Span() : begin(nullptr), end(nullptr) {}
+    Span(const char * begin, const char * end) : begin(begin), end(end) {}
+    bool empty() const noexcept { return begin == end; }
+
+    const char * begin;
+    const char * end;
+};
+
+}
+
 bool Nsvcap::parse(const char *nsvcapStr, HyModuleForm form)
 {
-    enum { NAME = 1, STREAM = 2, VERSION = 3, CONTEXT = 4, ARCH = 5, PROFILE = 6, _LAST_ };
-    auto matchResult = NSVCAP_FORM_REGEX[form - 1].match(nsvcapStr, false, _LAST_);
-    if (!matchResult.isMatched() || matchResult.getMatchedLen(NAME) == 0)
+    const auto & nsvcapForm = NSVCAP_FORMS[form - 1];
+    const char * end = nsvcapStr + strlen(nsvcapStr);
+
+    // the profile follows the only '/', forms without it still accept a trailing '/'
+    Span profileSpan;
+    auto slash = static_cast<const char *>(std::memchr(nsvcapStr, '/', end - nsvcapStr));
+    if (slash) {
+        profileSpan = Span(slash + 1, end);
+        end = slash;
+        if (nsvcapForm.profile) {
+            if (profileSpan.empty() || !MODULE_CHARS.contains(profileSpan.begin, profileSpan.end))
+                return false;
+        } else if (!profileSpan.empty()) {
+            return false;
+        }
+    } else if (nsvcapForm.profile) {
         return false;
-    name = matchResult.getMatchedString(NAME);
-    version = matchResult.getMatchedString(VERSION);
-    stream = matchResult.getMatchedString(STREAM);
-    context = matchResult.getMatchedString(CONTEXT);
-    arch = matchResult.getMatchedString(ARCH);
-    profile = matchResult.getMatchedString(PROFILE);
+    }
+
+    std::size_t partsCount = 1;
+    for (auto c = nsvcapStr; c != end; ++c) {
+        if (*c == ':')
+            ++partsCount;
+    }
+    auto formLen = strlen(nsvcapForm.parts);
+    auto optional = std::strchr(nsvcapForm.parts, '?') != nullptr;
+    bool withOptional;
+    if (partsCount == formLen - optional)
+        withOptional = false;
+    else if (optional && partsCount == formLen)
+        withOptional = true;
+    else
+        return false;
+
+    Span nameSpan, streamSpan, versionSpan, contextSpan, archSpan;
+    auto partBegin = nsvcapStr;
+    for (auto field = nsvcapForm.parts; *field; ++field) {
+        if (*field == '?' && !withOptional)
+            continue;
+        auto partEnd = static_cast<const char *>(std::memchr(partBegin, ':', end - partBegin));
+        Span part(partBegin, partEnd ? partEnd : end);
+        partBegin = part.end + 1;
+        if (*field == '_' || *field == '?') {
+            if (!part.empty())
+                return false;
+            continue;
+        }
+        if (part.empty())
+            return false;
+        if (*field == 'V') {
+            if (!MODULE_VERSION_CHARS.contains(part.begin, part.end))
+                return false;
+        } else if (!MODULE_CHARS.contains(part.begin, part.end)) {
+            return false;
+        }
+        switch (*field) {
+            case 'N': nameSpan = part; break;
+            case 'S': streamSpan = part; break;
+            case 'V': versionSpan = part; break;
+            case 'C': contextSpan = part; break;
+            case 'A': archSpan = part; break;
+        }
+    }
+
+    name.assign(nameSpan.begin, nameSpan.end);
+    stream.assign(streamSpan.begin, streamSpan.end);
+    version.assign(versionSpan.begin, versionSpan.end);
+    context.assign(contextSpan.begin, contextSpan.end);
+    arch.assign(archSpan.begin, archSpan.end);
+    profile.assign(profileSpan.begin, profileSpan.end);
     return true;
 }
 
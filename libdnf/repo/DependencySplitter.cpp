@@ -21,22 +21,58 @@
 #include "DependencySplitter.hpp"
 #include "../dnf-sack.h"
 #include "../log.hpp"
-#include "../utils/regex/regex.hpp"
 
 #include "bgettext/bgettext-lib.h"
 #include "tinyformat/tinyformat.hpp"
 
+#include <cstring>
+
 namespace libdnf {
 
-static const Regex RELDEP_REGEX = 
-    Regex("^(\\S*)\\s*(<=|>=|<|>|=|==)?\\s*(\\S*)$", REG_EXTENDED);
+namespace {
+
+/// \s of the C locale
+inline bool isSpace(char c) noexcept
+{
+    switch (c) {
+        case ' ': case '\t': case '\n': case '\v': case '\f': case '\r':
+            return true;
+        default:
+            return false;
+    }
+}
+
+inline const char * skipSpaces(const char * str) noexcept
+{
+    while (isSpace(*str))
+        ++str;
+    return str;
+}
+
+inline const char * skipNonSpaces(const char * str) noexcept
+{
+    while (*str && !isSpace(*str))
+        ++str;
+    return str;
+}
+
+/// Length of the longest comparison operator the string starts with, 0 if none
+inline std::size_t cmpTypeLen(const char * str) noexcept
+{
+    switch (str[0]) {
+        case '<': case '>': case '=':
+            return str[1] == '=' ? 2 : 1;
+        default:
+            return 0;
+    }
+}
+
+}
 
 static bool
-getCmpFlags(int *cmp_type, std::string matchCmpType)
+getCmpFlags(int *cmp_type, const char * match_start, std::size_t subexpr_len)
 {
     auto logger(Log::getLogger());
-    int subexpr_len = matchCmpType.size();
-    auto match_start = matchCmpType.c_str();
     if (subexpr_len == 2) {
         if (strncmp(match_start, "<=", 2) == 0) {
             *cmp_type |= HY_LT;
@@ -72,28 +108,54 @@ getCmpFlags(int *cmp_type, std::string matchCmpType)
 bool
 DependencySplitter::parse(const char * reldepStr)
 {
-    enum { NAME = 1, CMP_TYPE = 2, EVR = 3, _LAST_ };
-    auto matchResult = RELDEP_REGEX.match(reldepStr, false, _LAST_);
-    if (!matchResult.isMatched() || matchResult.getMatchedLen(NAME) == 0) {
+    // "NAME", "NAME OP EVR" or "NAME OPEVR", a single token without the operator after the name
+    // means that the name contains the space char
+    auto nameEnd = skipNonSpaces(reldepStr);
+    if (nameEnd == reldepStr)
         return false;
+    const char * cmpTypeStart = nullptr;
+    std::size_t cmpTypeLength = 0;
+    const char * evrStart = nameEnd;
+    const char * evrEnd = nameEnd;
+    auto token = skipSpaces(nameEnd);
+    if (*token) {
+        auto tokenEnd = skipNonSpaces(token);
+        auto opLen = cmpTypeLen(token);
+        cmpTypeStart = token;
+        cmpTypeLength = opLen;
+        if (!*tokenEnd) {
+            // the last token, the operator may be glued to the EVR, glued "==" was always taken
+            // as '=' followed by the EVR
+            if (opLen == 2 && *token == '=')
+                cmpTypeLength = opLen = 1;
+            evrStart = token + opLen;
+            evrEnd = tokenEnd;
+        } else {
+            // the token is followed by spaces, it must be just the operator
+            if (opLen == 0 || token + opLen != tokenEnd)
+                return false;
+            evrStart = skipSpaces(tokenEnd);
+            evrEnd = skipNonSpaces(evrStart);
+            if (*evrEnd)
+                return false;
+        }
     }
-    name = matchResult.getMatchedString(NAME);
-    evr = matchResult.getMatchedString(EVR);
+
+    name.assign(reldepStr, nameEnd);
+    evr.assign(evrStart, evrEnd);
     cmpType = 0;
-    int evrLen = matchResult.getMatchedLen(EVR);
-    int cmpTypeLen = matchResult.getMatchedLen(CMP_TYPE);
-    if (cmpTypeLen < 1) {
-        if (evrLen > 0) {
-            // name contains the space char, e.g. filename like "hello world.jpg"
+    if (cmpTypeLength < 1) {
+        if (!evr.empty()) {
+            // name contains the space char
             evr.clear();
             name = reldepStr;
         }
         return true;
     }
-    if (evrLen < 1)
+    if (evr.empty())
         return false;
 
-    return getCmpFlags(&cmpType, matchResult.getMatchedString(CMP_TYPE));
+    return getCmpFlags(&cmpType, cmpTypeStart, cmpTypeLength);
 }
 
 }
@@ -165,6 +165,8 @@ public:
 
     SyncStrategy syncStrategy;
     std::map<std::string, std::string> metadataPaths;
+    /* "<checksum type>:<checksum>" of the repomd records, used to validate solv caches */
+    std::map<std::string, std::string> metadataChecksums;
 
     LibsolvRepo * libsolvRepo{nullptr};
     bool needs_internalizing{false};
@@ -180,6 +182,10 @@ public:
     Id updateinfo_repodata{0};
     Id other_repodata{0};
     int load_flags{0};
+    /* extensions registered with DNF_SACK_LOAD_FLAG_LAZY_EXTENSIONS and not loaded yet */
+    int lazy_load_flags{0};
+    /* lazily loaded extensions that failed to load, the data of the repo are incomplete */
+    int lazy_load_failed{0};
     /* the following three elements are needed for repo rewriting */
     int main_nsolvables{0};
     int main_nrepodata{0};
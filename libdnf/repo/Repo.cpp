@@ -2032,6 +2032,25 @@ repo_update_state(HyRepo repo, enum _hy_repo_repodata which,
     return;
 }
 
+enum _hy_repo_state
+repo_get_state(HyRepo repo, enum _hy_repo_repodata which)
+{
+    auto repoImpl = libdnf::repoGetImpl(repo);
+    switch (which) {
+    case _HY_REPODATA_FILENAMES:
+        return repoImpl->state_filelists;
+    case _HY_REPODATA_PRESTO:
+        return repoImpl->state_presto;
+    case _HY_REPODATA_UPDATEINFO:
+        return repoImpl->state_updateinfo;
+    case _HY_REPODATA_OTHER:
+        return repoImpl->state_other;
+    default:
+        assert(0);
+        return _HY_NEW;
+    }
+}
+
 Id
 repo_get_repodata(HyRepo repo, enum _hy_repo_repodata which)
 {
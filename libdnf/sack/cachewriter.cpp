@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2022 Red Hat, Inc.
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "cachewriter.hpp"
+#include "../dnf-types.h"
+#include "../hy-iutil-private.hpp"
+#include "../utils/bgettext/bgettext-lib.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace libdnf {
+
+// a temporary cache this old belongs to a writer that was killed, not to one still writing
+static constexpr time_t STALE_TMP_AGE = 60 * 60;
+
+// Remove the temporary files "<path>.XXXXXX" that crashed writers left behind
+static void
+removeStaleTemporaries(const std::string & path)
+{
+    g_autofree gchar * dirname = g_path_get_dirname(path.c_str());
+    g_autofree gchar * basename = g_path_get_basename(path.c_str());
+    GDir * dir = g_dir_open(dirname, 0, nullptr);
+    if (!dir)
+        return;
+    auto prefixLen = strlen(basename);
+    auto now = time(nullptr);
+    while (auto name = g_dir_read_name(dir)) {
+        if (strlen(name) != prefixLen + 7 || strncmp(name, basename, prefixLen) != 0 ||
+            name[prefixLen] != '.')
+            continue;
+        g_autofree gchar * tmpPath = g_build_filename(dirname, name, nullptr);
+        struct stat st;
+        if (stat(tmpPath, &st) == 0 && S_ISREG(st.st_mode) && now - st.st_mtime > STALE_TMP_AGE) {
+            g_debug("Removing stale temporary cache %s", tmpPath);
+            unlink(tmpPath);
+        }
+    }
+    g_dir_close(dir);
+}
+
+static gboolean
+fsyncPath(const std::string & path, int flags, GError ** error)
+{
+    int fd = open(path.c_str(), flags);
+    if (fd < 0 || fsync(fd) != 0) {
+        g_set_error(error, DNF_ERROR, DNF_ERROR_FILE_INVALID,
+                    _("Failed to sync %1$s: %2$s"), path.c_str(), strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return FALSE;
+    }
+    close(fd);
+    return TRUE;
+}
+
+static gboolean
+finishCache(const std::string & tmpPath, const std::string & path,
+            DnfSackCacheFsyncPolicy fsyncPolicy, GError ** error)
+{
+    if (fsyncPolicy != DNF_SACK_CACHE_FSYNC_NONE && !fsyncPath(tmpPath, O_RDONLY, error)) {
+        unlink(tmpPath.c_str());
+        return FALSE;
+    }
+    if (rename(tmpPath.c_str(), path.c_str()) != 0) {
+        g_set_error(error, DNF_ERROR, DNF_ERROR_FILE_INVALID,
+                    _("Failed renaming %1$s to %2$s: %3$s"),
+                    tmpPath.c_str(), path.c_str(), strerror(errno));
+        unlink(tmpPath.c_str());
+        return FALSE;
+    }
+    if (fsyncPolicy == DNF_SACK_CACHE_FSYNC_FULL) {
+        // the rename is only durable once the directory entry is written
+        g_autofree gchar * dir = g_path_get_dirname(path.c_str());
+        return fsyncPath(dir, O_RDONLY | O_DIRECTORY, error);
+    }
+    return TRUE;
+}
+
+CacheWriter::~CacheWriter()
+{
+    g_autoptr(GError) error = nullptr;
+    if (!wait(&error))
+        g_warning("%s", error->message);
+    if (worker.joinable()) {
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            stopping = true;
+        }
+        cond.notify_all();
+        worker.join();
+    }
+}
+
+void
+CacheWriter::setAsync(bool value)
+{
+    std::lock_guard<std::mutex> guard(mutex);
+    async = value;
+}
+
+void
+CacheWriter::setFsyncPolicy(DnfSackCacheFsyncPolicy value)
+{
+    std::lock_guard<std::mutex> guard(mutex);
+    fsyncPolicy = value;
+}
+
+gboolean
+CacheWriter::commit(const std::string & tmpPath, const std::string & path, GError ** error)
+{
+    removeStaleTemporaries(path);
+
+    // rename() keeps the mode of the file. It is set here because reading the umask changes it
+    // for the whole process for a moment, which must not happen on the worker.
+    if (chmod(tmpPath.c_str(), 0666 & ~get_umask()) != 0) {
+        g_set_error(error, DNF_ERROR, DNF_ERROR_FILE_INVALID,
+                    _("Failed setting perms on %1$s: %2$s"), tmpPath.c_str(), strerror(errno));
+        unlink(tmpPath.c_str());
+        return FALSE;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!async) {
+        auto policy = fsyncPolicy;
+        lock.unlock();
+        return finishCache(tmpPath, path, policy, error);
+    }
+    if (!worker.joinable())
+        worker = std::thread(&CacheWriter::run, this);
+    jobs.push_back({tmpPath, path, fsyncPolicy});
+    lock.unlock();
+    cond.notify_all();
+    return TRUE;
+}
+
+gboolean
+CacheWriter::wait(GError ** error)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    cond.wait(lock, [this] { return jobs.empty() && !busy; });
+    if (firstError) {
+        g_propagate_error(error, firstError);
+        firstError = nullptr;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+void
+CacheWriter::run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        cond.wait(lock, [this] { return stopping || !jobs.empty(); });
+        if (jobs.empty())
+            return;
+        auto job = std::move(jobs.front());
+        jobs.pop_front();
+        busy = true;
+        lock.unlock();
+
+        GError * error = nullptr;
+        if (!finishCache(job.tmpPath, job.path, job.fsyncPolicy, &error))
+            g_debug("Writing of cache %s failed: %s", job.path.c_str(), error->message);
+
+        lock.lock();
+        busy = false;
+        if (error) {
+            if (firstError)
+                g_error_free(error);
+            else
+                firstError = error;
+        }
+        cond.notify_all();
+    }
+}
+
+}
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2022 Red Hat, Inc.
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef __CACHE_WRITER_HPP
+#define __CACHE_WRITER_HPP
+
+#include "../dnf-sack.h"
+
+#include <glib.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace libdnf {
+
+/**
+* @brief Puts solv caches in place, optionally on a worker thread.
+*
+* The caches are serialized into a temporary file next to their target by the caller, libsolv
+* pools cannot be accessed from several threads. The writer flushes the temporary file
+* according to the fsync policy and atomically renames it over the target, so readers see either
+* the old or the complete new cache, also after a crash.
+*/
+class CacheWriter {
+public:
+    CacheWriter() = default;
+    ~CacheWriter();
+    CacheWriter(const CacheWriter &) = delete;
+    CacheWriter & operator=(const CacheWriter &) = delete;
+
+    void setAsync(bool value);
+    void setFsyncPolicy(DnfSackCacheFsyncPolicy value);
+
+    /**
+    * @brief Rename tmpPath over path. In async mode the work is queued and errors are reported
+    * by wait(). Temporary files of path that a killed writer left behind are removed.
+    *
+    * @return FALSE and set error if it fails synchronously
+    */
+    gboolean commit(const std::string & tmpPath, const std::string & path, GError ** error);
+
+    /**
+    * @brief Wait till all queued caches are in place.
+    *
+    * @return FALSE and set error if a queued cache failed since the last wait
+    */
+    gboolean wait(GError ** error);
+
+private:
+    struct Job {
+        std::string tmpPath;
+        std::string path;
+        DnfSackCacheFsyncPolicy fsyncPolicy;
+    };
+
+    void run();
+
+    bool async{false};
+    DnfSackCacheFsyncPolicy fsyncPolicy{DNF_SACK_CACHE_FSYNC_NONE};
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<Job> jobs;
+    bool busy{false};
+    bool stopping{false};
+    GError * firstError{nullptr};
+    std::thread worker;
+};
+
+}
+
+#endif /* __CACHE_WRITER_HPP */
@@ -46,6 +46,9 @@ extern "C" {
 #include "advisory.hpp"
 #include "advisorypkg.hpp"
 #include "packageset.hpp"
+#include "../log.hpp"
+#include "../utils/bgettext/bgettext-lib.h"
+#include "../utils/tinyformat/tinyformat.hpp"
 
 #include "libdnf/repo/solvable/Dependency.hpp"
 #include "libdnf/repo/solvable/DependencyContainer.hpp"
@@ -62,29 +65,6 @@ struct default_delete<DnfPackage> {
 
 namespace libdnf {
 
-struct NevraID {
-public:
-    NevraID() : name(0), arch(0), evr(0) {};
-    NevraID(const NevraID & src) = default;
-    NevraID(NevraID && src) noexcept = default;
-    NevraID & operator=(const NevraID & src) = default;
-    NevraID & operator=(NevraID && src) = default;
-    Id name;
-    Id arch;
-    Id evr;
-    std::string evr_str;
-    /**
-    * @brief Parsing function for nevra string into name, evr, arch and transforming it into libsolv
-    * Id
-    *
-    * int createNewEVR - `1` will create new id for evr when it is unknown, `0` will exit with false when evr is unknown
-    *
-    * @return bool Returns true if parsing succesful and all elements is known to pool
-    */
-
-    bool parse(Pool * pool, const char * nevraPattern, bool createEVRId);
-};
-
 bool
 NevraID::parse(Pool * pool, const char * nevraPattern, bool createEVRId)
 {
@@ -440,64 +420,6 @@ type2flags(int type, int keyname)
     }
 }
 
-static char *
-pool_solvable_epoch_optional_2str(Pool *pool, const Solvable *s, gboolean with_epoch)
-{
-    const char *e;
-    const char *name = pool_id2str(pool, s->name);
-    const char *evr = pool_id2str(pool, s->evr);
-    const char *arch = pool_id2str(pool, s->arch);
-    bool present_epoch = false;
-
-    for (e = evr + 1; *e != '-' && *e != '\0'; ++e) {
-        if (*e == ':') {
-            present_epoch = true;
-            break;
-        }
-    }
-    char *output_string;
-    int evr_length, arch_length;
-    int extra_epoch_length = 0;
-    int name_length = strlen(name);
-    evr_length = strlen(evr);
-    arch_length = strlen(arch);
-    if (!present_epoch && with_epoch) {
-        extra_epoch_length = 2;
-    } else if (present_epoch && !with_epoch) {
-        extra_epoch_length = evr - e - 1;
-    }
-
-    output_string = pool_alloctmpspace(
-        pool, name_length + evr_length + extra_epoch_length + arch_length + 3);
-
-    strcpy(output_string, name);
-
-    if (evr_length || extra_epoch_length > 0) {
-        output_string[name_length++] = '-';
-
-        if (extra_epoch_length > 0) {
-            output_string[name_length++] = '0';
-            output_string[name_length++] = ':';
-            output_string[name_length] = '\0';
-        }
-    }
-
-    if (evr_length) {
-        if (extra_epoch_length >= 0) {
-            strcpy(output_string + name_length, evr);
-        } else {
-            strcpy(output_string + name_length, evr - extra_epoch_length);
-            evr_length = evr_length + extra_epoch_length;
-        }
-    }
-
-    if (arch_length) {
-        output_string[name_length + evr_length] = '.';
-        strcpy(output_string + name_length + evr_length + 1, arch);
-    }
-    return output_string;
-}
-
 static int
 filter_latest_sortcmp(const void *ap, const void *bp, void *dp)
 {
@@ -823,6 +745,7 @@ private:
     void filterUpdownByPriority(const Filter & f, Map *m);
     void filterUpdownAble(const Filter  &f, Map *m);
     void filterDataiterator(const Filter & f, Map *m);
+    void loadLazyFilelists(const Filter & f);
     int filterUnneededOrSafeToRemove(const Swdb &swdb, bool debug_solver, bool safeToRemove);
     void obsoletesByPriority(Pool * pool, Solvable * candidate, Map * m, const Map * target, int obsprovides);
 
@@ -1212,9 +1135,17 @@ Query::Impl::initResult()
         if (pool->considered)
             map_and(result->getMap(), pool->considered);
     } else {
-        dnf_sack_recompute_considered_map(sack, &considered_cached, flags);
-        if (considered_cached) {
+        // the sack keeps the map for every flags up to date, the query keeps its own copy
+        auto considered = dnf_sack_get_considered_map(sack, flags);
+        if (considered) {
+            if (!considered_cached)
+                considered_cached = static_cast<Map *>(g_malloc0(sizeof(Map)));
+            else
+                map_free(considered_cached);
+            map_init_clone(considered_cached, considered);
             map_and(result->getMap(), considered_cached);
+        } else if (considered_cached) {
+            considered_cached = free_map_fully(considered_cached);
         }
     }
 }
@@ -2193,21 +2124,68 @@ Query::Impl::filterDataiterator(const Filter & f, Map *m)
     }
 }
 
+// number of memoized unneeded sets, including the one without removals
+static constexpr std::size_t UNNEEDED_CACHE_SIZE = 16;
+
+/// Everything the unneeded packages depend on: the packages of the sack, its excludes, the
+/// installonly settings and the history
+static std::string
+unneededCacheKey(DnfSack * sack, const Swdb & swdb)
+{
+    Pool * pool = dnf_sack_get_pool(sack);
+    dnf_sack_recompute_considered(sack);
+    auto key = tfm::format("%s\n%u %d %d %d %u\n", swdb.getHistoryStamp(),
+                           dnf_sack_get_provides_generation(sack), pool->nsolvables,
+                           pool->installed ? pool->installed->repoid : 0,
+                           pool->installed ? pool->installed->end : 0,
+                           dnf_sack_get_installonly_limit(sack));
+    Queue * installonly = dnf_sack_get_installonly(sack);
+    key.append(reinterpret_cast<const char *>(installonly->elements),
+               installonly->count * sizeof(Id));
+    if (pool->considered)
+        key.append(reinterpret_cast<const char *>(pool->considered->map), pool->considered->size);
+    return key;
+}
+
 int
 Query::Impl::filterUnneededOrSafeToRemove(const Swdb &swdb, bool debug_solver, bool safeToRemove)
 {
     apply();
-    Goal goal(sack);
     Pool *pool = dnf_sack_get_pool(sack);
-    Query installed(sack);
-    installed.installed();
-    auto userInstalled = installed.getResultPset();
 
-    swdb.filterUserinstalled(*userInstalled);
+    // the user installed packages and the solves are shared by the calls for the same state
+    auto & cache = dnf_sack_get_unneeded_cache(sack);
+    auto key = unneededCacheKey(sack, swdb);
+    if (cache.key != key) {
+        Query installed(sack);
+        installed.installed();
+        cache.userInstalled.reset(new PackageSet(*installed.getResultPset()));
+        swdb.filterUserinstalled(*cache.userInstalled);
+        cache.unneeded.clear();
+        cache.key = std::move(key);
+    }
+
+    // only the user installed packages of the query change the solve
+    std::vector<Id> removed;
     if (safeToRemove) {
-        *userInstalled -= *result;
+        Id id = -1;
+        while ((id = cache.userInstalled->next(id)) != -1) {
+            if (result->has(id))
+                removed.push_back(id);
+        }
+    }
+    auto cached = cache.unneeded.find(removed);
+    if (cached != cache.unneeded.end() && !debug_solver) {
+        map_and(result->getMap(), cached->second->getMap());
+        return 0;
     }
-    goal.userInstalled(*userInstalled);
+
+    Goal goal(sack);
+    PackageSet userInstalled(*cache.userInstalled);
+    for (Id id : removed) {
+        userInstalled.remove(id);
+    }
+    goal.userInstalled(userInstalled);
 
     int ret1 = goal.run(DNF_NONE);
     if (ret1)
@@ -2232,10 +2210,55 @@ Query::Impl::filterUnneededOrSafeToRemove(const Swdb &swdb, bool debug_solver, b
         MAPSET(&resultInternal, que[i]);
     }
     map_and(result->getMap(), &resultInternal);
+
+    // the removal sets of safe to remove queries vary, the base result is always kept
+    if (cache.unneeded.size() >= UNNEEDED_CACHE_SIZE) {
+        for (auto it = cache.unneeded.begin(); it != cache.unneeded.end();) {
+            it = it->first.empty() ? std::next(it) : cache.unneeded.erase(it);
+        }
+    }
+    cache.unneeded[removed].reset(new PackageSet(sack, &resultInternal));
     map_free(&resultInternal);
     return 0;
 }
 
+void
+Query::Impl::loadLazyFilelists(const Filter & f)
+{
+    if (!(dnf_sack_get_lazy_extensions(sack) & DNF_SACK_LOAD_FLAG_USE_FILELISTS))
+        return;
+
+    // exact paths stored in primary.xml give the same answer without filelists
+    if ((f.getCmpType() & ~HY_NOT) == HY_EQ) {
+        bool allPrimary = true;
+        for (const auto & match : f.getMatches()) {
+            if (!is_primary_file(match.str)) {
+                allPrimary = false;
+                break;
+            }
+        }
+        if (allPrimary)
+            return;
+    }
+
+    // load filelists only for repositories with packages in the current result
+    Pool *pool = dnf_sack_get_pool(sack);
+    Repo *lastRepo = nullptr;
+    Id id = -1;
+    while ((id = result->next(id)) != -1) {
+        Repo *repo = pool_id2solvable(pool, id)->repo;
+        if (repo == lastRepo)
+            continue;
+        lastRepo = repo;
+        g_autoptr(GError) error = NULL;
+        if (!dnf_sack_load_lazy_extensions(sack, DNF_SACK_LOAD_FLAG_USE_FILELISTS, repo, &error)) {
+            auto logger(Log::getLogger());
+            logger->warning(tfm::format(_("Result of the file query is incomplete: %s"),
+                                        error->message));
+        }
+    }
+}
+
 bool Query::Impl::isGlob(const std::vector<const char *> &matches) const
 {
     for (const char *match : matches) {
@@ -2353,6 +2376,10 @@ Query::Impl::apply()
             case HY_PKG_UPGRADES_BY_PRIORITY:
                 filterUpdownByPriority(f, &m);
                 break;
+            case HY_PKG_FILE:
+                loadLazyFilelists(f);
+                filterDataiterator(f, &m);
+                break;
             default:
                 filterDataiterator(f, &m);
         }
@@ -0,0 +1,257 @@
+/*
+ * Copyright (C) 2022 Red Hat, Inc.
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "repoclosure.hpp"
+#include "../dnf-sack-private.hpp"
+
+#include <solv/pool.h>
+#include <solv/poolid.h>
+#include <solv/repo.h>
+
+#include <algorithm>
+#include <atomic>
+#include <string.h>
+#include <thread>
+#include <unordered_set>
+
+namespace libdnf {
+
+// spawning threads does not pay off for fewer dependencies
+static constexpr std::size_t MIN_DEPS_PER_THREAD = 256;
+
+static bool
+inMap(const Map * map, Id id)
+{
+    return id < (map->size << 3) && MAPTST(map, id);
+}
+
+/// A name or a versioned name, the providers are found without modifying the pool
+static bool
+isSimpleDep(Pool * pool, Id dep)
+{
+    if (!ISRELDEP(dep))
+        return true;
+    Reldep * rd = GETRELDEP(pool, dep);
+    return !ISRELDEP(rd->name) && rd->flags > 0 && rd->flags <= (REL_GT | REL_EQ | REL_LT);
+}
+
+/// Only reads the pool, the providers of the name must be computed already
+static Id
+findSimpleProvider(Pool * pool, const Map * targetsMap, Id dep)
+{
+    Id p, pp;
+    if (!ISRELDEP(dep)) {
+        FOR_PROVIDES(p, pp, dep) {
+            if (inMap(targetsMap, p))
+                return p;
+        }
+        return 0;
+    }
+    // the same matching as pool_addrelproviders() does
+    Reldep * rd = GETRELDEP(pool, dep);
+    FOR_PROVIDES(p, pp, rd->name) {
+        if (!inMap(targetsMap, p))
+            continue;
+        Solvable * s = pool_id2solvable(pool, p);
+        if (!s->provides)
+            continue;
+        for (Id * pidp = s->repo->idarraydata + s->provides; *pidp; ++pidp) {
+            if (pool_match_dep(pool, *pidp, dep))
+                return p;
+        }
+    }
+    return 0;
+}
+
+RepoClosure::RepoClosure(DnfSack * sack)
+: sack(sack), minDepsPerThread(MIN_DEPS_PER_THREAD), packages(new PackageSet(sack)),
+  targets(new PackageSet(sack)) {}
+
+void
+RepoClosure::check(const PackageSet & newPackages, const PackageSet & newTargets)
+{
+    packages.reset(new PackageSet(sack));
+    targets.reset(new PackageSet(sack));
+    packageRequires.clear();
+    requirers.clear();
+    providers.clear();
+    broken.clear();
+    update(newPackages, newTargets, PackageSet(sack));
+}
+
+void
+RepoClosure::collectRequires(Id package, std::vector<Id> & newDeps)
+{
+    Pool * pool = dnf_sack_get_pool(sack);
+    Solvable * s = pool_id2solvable(pool, package);
+    std::vector<Id> deps;
+    if (s->requires) {
+        for (Id * dp = s->repo->idarraydata + s->requires; *dp; ++dp) {
+            Id dep = *dp;
+            if (dep == SOLVABLE_PREREQMARKER)
+                continue;
+            Id name = dep;
+            while (ISRELDEP(name))
+                name = GETRELDEP(pool, name)->name;
+            // provided by rpm itself
+            if (strncmp(pool_id2str(pool, name), "rpmlib(", 7) == 0)
+                continue;
+            deps.push_back(dep);
+        }
+    }
+    std::sort(deps.begin(), deps.end());
+    deps.erase(std::unique(deps.begin(), deps.end()), deps.end());
+    for (Id dep : deps) {
+        auto & depRequirers = requirers[dep];
+        if (depRequirers.empty())
+            newDeps.push_back(dep);
+        depRequirers.push_back(package);
+    }
+    packageRequires[package] = std::move(deps);
+}
+
+std::vector<Id>
+RepoClosure::findProviders(const std::vector<Id> & deps, const Map * targetsMap)
+{
+    Pool * pool = dnf_sack_get_pool(sack);
+    std::vector<Id> found(deps.size());
+
+    // everything which may extend the pool is done first, by this thread
+    std::vector<std::size_t> simple;
+    for (std::size_t i = 0; i < deps.size(); ++i) {
+        Id dep = deps[i];
+        if (isSimpleDep(pool, dep)) {
+            pool_whatprovides(pool, ISRELDEP(dep) ? GETRELDEP(pool, dep)->name : dep);
+            simple.push_back(i);
+            continue;
+        }
+        Id p, pp;
+        FOR_PROVIDES(p, pp, dep) {
+            if (inMap(targetsMap, p)) {
+                found[i] = p;
+                break;
+            }
+        }
+    }
+
+    std::atomic<std::size_t> next{0};
+    auto worker = [&]() {
+        for (auto i = next++; i < simple.size(); i = next++)
+            found[simple[i]] = findSimpleProvider(pool, targetsMap, deps[simple[i]]);
+    };
+
+    std::size_t nthreads = std::min<std::size_t>(simple.size() / minDepsPerThread + 1,
+                                                 std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<std::thread> threads;
+    for (std::size_t i = 1; i < nthreads; ++i)
+        threads.emplace_back(worker);
+    worker();
+    for (auto & thread : threads)
+        thread.join();
+    return found;
+}
+
+void
+RepoClosure::update(const PackageSet & newPackages, const PackageSet & newTargets,
+                    const PackageSet & changed)
+{
+    Pool * pool = dnf_sack_get_pool(sack);
+    dnf_sack_make_provides_ready(sack);
+
+    // the previous sets may come from a smaller or a larger pool
+    std::unordered_set<Id> changedPackages;
+    std::unordered_set<Id> changedProviders;
+    for (Id id = changed.next(-1); id != -1; id = changed.next(id)) {
+        changedPackages.insert(id);
+        changedProviders.insert(id);
+    }
+    auto addDifference = [](const PackageSet & before, const PackageSet & after,
+                            std::unordered_set<Id> & difference) {
+        for (Id id = before.next(-1); id != -1; id = before.next(id)) {
+            if (!inMap(after.getMap(), id))
+                difference.insert(id);
+        }
+        for (Id id = after.next(-1); id != -1; id = after.next(id)) {
+            if (!inMap(before.getMap(), id))
+                difference.insert(id);
+        }
+    };
+    addDifference(*packages, newPackages, changedPackages);
+    addDifference(*targets, newTargets, changedProviders);
+
+    // forget the changed packages, then collect their current requires
+    for (Id id : changedPackages) {
+        broken.erase(id);
+        auto it = packageRequires.find(id);
+        if (it == packageRequires.end())
+            continue;
+        for (Id dep : it->second) {
+            auto & depRequirers = requirers[dep];
+            depRequirers.erase(std::remove(depRequirers.begin(), depRequirers.end(), id),
+                               depRequirers.end());
+            if (depRequirers.empty()) {
+                requirers.erase(dep);
+                providers.erase(dep);
+            }
+        }
+        packageRequires.erase(it);
+    }
+    std::vector<Id> deps;
+    std::unordered_set<Id> affected;
+    for (Id id : changedPackages) {
+        if (id < pool->nsolvables && inMap(newPackages.getMap(), id)) {
+            collectRequires(id, deps);
+            affected.insert(id);
+        }
+    }
+
+    // a dependency without a provider may be provided now, a changed provider may be gone
+    for (const auto & item : providers) {
+        if (item.second == 0 || changedProviders.count(item.second))
+            deps.push_back(item.first);
+    }
+
+    auto found = findProviders(deps, newTargets.getMap());
+    for (std::size_t i = 0; i < deps.size(); ++i) {
+        auto & provider = providers[deps[i]];
+        if ((provider == 0) != (found[i] == 0)) {
+            auto & depRequirers = requirers[deps[i]];
+            affected.insert(depRequirers.begin(), depRequirers.end());
+        }
+        provider = found[i];
+    }
+
+    for (Id id : affected) {
+        std::vector<Id> missing;
+        for (Id dep : packageRequires[id]) {
+            if (providers[dep] == 0)
+                missing.push_back(dep);
+        }
+        if (missing.empty())
+            broken.erase(id);
+        else
+            broken[id] = std::move(missing);
+    }
+
+    packages.reset(new PackageSet(newPackages));
+    targets.reset(new PackageSet(newTargets));
+}
+
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2022 Red Hat, Inc.
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef __REPO_CLOSURE_HPP
+#define __REPO_CLOSURE_HPP
+
+#include "../dnf-types.h"
+#include "packageset.hpp"
+
+#include <solv/bitmap.h>
+
+#include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace libdnf {
+
+/**
+* @brief Checks that the requires of packages are provided by a set of target packages.
+*
+* The repoclosure check: a package is broken if any of its requires has no provider among the
+* targets. The requires are evaluated once per distinct dependency, simple ones (a name or a
+* versioned name) by several threads. The checker remembers a provider of every dependency,
+* after a repo update update() checks again only the dependencies whose provider changed and
+* the packages which changed or require them.
+*/
+class RepoClosure {
+public:
+    explicit RepoClosure(DnfSack * sack);
+    RepoClosure(const RepoClosure &) = delete;
+    RepoClosure & operator=(const RepoClosure &) = delete;
+
+    /// Check all packages, previous results are dropped
+    void check(const PackageSet & packages, const PackageSet & targets);
+
+    /**
+    * @brief Check again after packages or targets changed, the results are the same as of check().
+    *
+    * Packages added to or removed from packages and targets since the last check are detected.
+    *
+    * @param changed solvables replaced in the pool since the last check, e.g. the packages of a
+    * repo which was loaded again
+    */
+    void update(const PackageSet & packages, const PackageSet & targets, const PackageSet & changed);
+
+    /// Broken packages and their requires without a provider, sorted by id
+    const std::map<Id, std::vector<Id>> & getBroken() const noexcept { return broken; }
+
+    /// Smallest number of simple dependencies per additional thread, 256 by default
+    void setMinDepsPerThread(std::size_t value) noexcept { minDepsPerThread = value ? value : 1; }
+
+private:
+    void collectRequires(Id package, std::vector<Id> & newDeps);
+    std::vector<Id> findProviders(const std::vector<Id> & deps, const Map * targetsMap);
+
+    DnfSack * sack;
+    std::size_t minDepsPerThread;
+    std::unique_ptr<PackageSet> packages;
+    std::unique_ptr<PackageSet> targets;
+    /// Requires of every checked package
+    std::unordered_map<Id, std::vector<Id>> packageRequires;
+    /// Checked packages requiring the dependency
+    std::unordered_map<Id, std::vector<Id>> requirers;
+    /// A target providing the dependency, 0 if there is none
+    std::unordered_map<Id, Id> providers;
+    std::map<Id, std::vector<Id>> broken;
+};
+
+}
+
+#endif /* __REPO_CLOSURE_HPP */
@@ -0,0 +1,429 @@
+/*
+ * Copyright (C) 2022 Red Hat, Inc.
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "subjectmatcher.hpp"
+#include "query.hpp"
+#include "../dnf-sack-private.hpp"
+#include "../hy-iutil-private.hpp"
+#include "../hy-subject.h"
+#include "../hy-util-private.hpp"
+#include "../log.hpp"
+#include "../nevra.hpp"
+#include "../repo/solvable/Dependency.hpp"
+#include "../repo/solvable/DependencyContainer.hpp"
+#include "../utils/bgettext/bgettext-lib.h"
+#include "../utils/tinyformat/tinyformat.hpp"
+
+#include <solv/evr.h>
+#include <solv/pool.h>
+#include <solv/repo.h>
+
+#include <algorithm>
+#include <fnmatch.h>
+#include <string.h>
+
+namespace libdnf {
+
+static bool
+isFiltered(const std::string & value)
+{
+    return !value.empty() && value != "*";
+}
+
+SubjectMatcher::SubjectMatcher(DnfSack * sack) : sack(sack) {}
+
+std::size_t
+SubjectMatcher::addSubject(const char * subject)
+{
+    std::size_t index = subjects.size();
+    std::size_t firstForm = forms.size();
+    std::size_t rank = 0;
+    Nevra nevra;
+    for (std::size_t i = 0; HY_FORMS_MOST_SPEC[i] != _HY_FORM_STOP_; ++i) {
+        if (!nevra.parse(subject, HY_FORMS_MOST_SPEC[i]))
+            continue;
+        Form form{};
+        form.subject = index;
+        form.rank = rank++;
+        form.name = nevra.getName();
+        form.epoch = nevra.getEpoch();
+        form.version = nevra.getVersion();
+        form.versionGlob = hy_is_glob_pattern(form.version.c_str());
+        form.release = nevra.getRelease();
+        form.releaseGlob = hy_is_glob_pattern(form.release.c_str());
+        form.arch = nevra.getArch();
+        form.archGlob = hy_is_glob_pattern(form.arch.c_str());
+        form.justName = nevra.hasJustName();
+        forms.push_back(std::move(form));
+    }
+
+    // the NEVRA filter ignores patterns which cannot be a NEVRA, they never match
+    if (!strpbrk(subject, "(/=<> ")) {
+        Form form{};
+        form.subject = index;
+        form.rank = rank++;
+        form.wholeNevra = true;
+        form.withEpoch = strchr(subject, ':') != nullptr;
+        form.pattern = subject;
+        form.patternGlob = hy_is_glob_pattern(subject);
+        form.epoch = Nevra::EPOCH_NOT_SET;
+        forms.push_back(std::move(form));
+    }
+
+    subjects.push_back({firstForm, rank, std::vector<std::vector<Id>>(rank)});
+    return index;
+}
+
+void
+SubjectMatcher::buildIndex()
+{
+    Pool * pool = dnf_sack_get_pool(sack);
+    exactNameForms.clear();
+    globForms.clear();
+    anyNameForms.clear();
+    globMemo.clear();
+
+    for (auto & form : forms) {
+        if (!form.wholeNevra && !form.archGlob && isFiltered(form.arch))
+            form.archId = pool_str2id(pool, form.arch.c_str(), 0);
+        if (form.wholeNevra || !isFiltered(form.name)) {
+            anyNameForms.push_back(&form);
+        } else if (hy_is_glob_pattern(form.name.c_str())) {
+            globForms.push_back(&form);
+        } else {
+            Id nameId = pool_str2id(pool, form.name.c_str(), 0);
+            // a name unknown to the pool cannot match any package
+            if (nameId)
+                exactNameForms[nameId].push_back(&form);
+        }
+    }
+}
+
+const std::vector<const SubjectMatcher::Form *> &
+SubjectMatcher::globNameForms(Id nameId)
+{
+    auto it = globMemo.find(nameId);
+    if (it != globMemo.end())
+        return it->second;
+
+    Pool * pool = dnf_sack_get_pool(sack);
+    const char * name = pool_id2str(pool, nameId);
+    auto & matching = globMemo[nameId];
+    for (auto form : globForms) {
+        if (fnmatch(form->name.c_str(), name, 0) == 0)
+            matching.push_back(form);
+    }
+    return matching;
+}
+
+void
+SubjectMatcher::match(const Map * candidates)
+{
+    Pool * pool = dnf_sack_get_pool(sack);
+    buildIndex();
+    for (auto & subject : subjects) {
+        subject.best = subject.hits.size();
+        for (auto & hits : subject.hits)
+            hits.clear();
+    }
+
+    std::string version;
+    std::string release;
+    std::string nevras[2];
+    bool nevraDone[2];
+
+    // the filters of Query::addFilter(HyNevra, bool) and of the HY_PKG_NEVRA filter
+    auto formMatches = [&](const Form * form, Solvable * s) {
+        if (form->wholeNevra) {
+            auto & nevra = nevras[form->withEpoch];
+            if (!nevraDone[form->withEpoch]) {
+                nevra = pool_solvable_epoch_optional_2str(pool, s, form->withEpoch);
+                nevraDone[form->withEpoch] = true;
+            }
+            if (form->patternGlob)
+                return fnmatch(form->pattern.c_str(), nevra.c_str(), 0) == 0;
+            return form->pattern == nevra;
+        }
+        if (form->epoch != Nevra::EPOCH_NOT_SET || isFiltered(form->version) ||
+            isFiltered(form->release)) {
+            if (s->evr == ID_EMPTY)
+                return false;
+            if (form->epoch != Nevra::EPOCH_NOT_SET &&
+                pool_get_epoch(pool, pool_id2str(pool, s->evr)) !=
+                static_cast<unsigned long>(form->epoch))
+                return false;
+        }
+        if (isFiltered(form->version)) {
+            if (form->versionGlob) {
+                if (fnmatch(form->version.c_str(), version.c_str(), 0) != 0)
+                    return false;
+            } else {
+                auto vr = pool_tmpjoin(pool, version.c_str(), "-0", nullptr);
+                auto filterVr = pool_tmpjoin(pool, form->version.c_str(), "-0", nullptr);
+                if (pool_evrcmp_str(pool, vr, filterVr, EVRCMP_COMPARE) != 0)
+                    return false;
+            }
+        }
+        if (isFiltered(form->release)) {
+            if (form->releaseGlob) {
+                if (fnmatch(form->release.c_str(), release.c_str(), 0) != 0)
+                    return false;
+            } else {
+                auto vr = pool_tmpjoin(pool, "0-", release.c_str(), nullptr);
+                auto filterVr = pool_tmpjoin(pool, "0-", form->release.c_str(), nullptr);
+                if (pool_evrcmp_str(pool, vr, filterVr, EVRCMP_COMPARE) != 0)
+                    return false;
+            }
+        }
+        if (isFiltered(form->arch)) {
+            if (form->archGlob)
+                return fnmatch(form->arch.c_str(), pool_id2str(pool, s->arch), 0) == 0;
+            return form->archId != 0 && form->archId == s->arch;
+        }
+        return true;
+    };
+
+    // only the most specific form with a match counts, less specific ones are not evaluated
+    auto evaluate = [&](const Form * form, Id id, Solvable * s) {
+        auto & subject = subjects[form->subject];
+        if (form->rank > subject.best || !formMatches(form, s))
+            return;
+        if (form->rank < subject.best) {
+            if (subject.best < subject.hits.size())
+                subject.hits[subject.best].clear();
+            subject.best = form->rank;
+        }
+        subject.hits[form->rank].push_back(id);
+    };
+
+    Id end = std::min(pool->nsolvables, candidates->size << 3);
+    for (Id id = 1; id < end; ++id) {
+        if (!MAPTST(candidates, id))
+            continue;
+        Solvable * s = pool_id2solvable(pool, id);
+        nevraDone[0] = nevraDone[1] = false;
+        // copied, the split parts live in the pool temporary space the filters reuse
+        version.clear();
+        release.clear();
+        if (s->evr != ID_EMPTY) {
+            char * e, * v, * r;
+            pool_split_evr(pool, pool_id2str(pool, s->evr), &e, &v, &r);
+            version = v;
+            if (r)
+                release = r;
+        }
+
+        auto exact = exactNameForms.find(s->name);
+        if (exact != exactNameForms.end()) {
+            for (auto form : exact->second)
+                evaluate(form, id, s);
+        }
+        if (!globForms.empty()) {
+            for (auto form : globNameForms(s->name))
+                evaluate(form, id, s);
+        }
+        for (auto form : anyNameForms)
+            evaluate(form, id, s);
+    }
+}
+
+bool
+SubjectMatcher::matched(std::size_t index) const
+{
+    auto & subject = subjects[index];
+    return subject.best < subject.hits.size();
+}
+
+void
+SubjectMatcher::addMatches(std::size_t index, PackageSet & pset) const
+{
+    auto & subject = subjects[index];
+    if (subject.best >= subject.hits.size())
+        return;
+    for (Id id : subject.hits[subject.best])
+        pset.set(id);
+}
+
+bool
+SubjectMatcher::matchedJustName(std::size_t index) const
+{
+    auto & subject = subjects[index];
+    return subject.best < subject.hits.size() && forms[subject.firstForm + subject.best].justName;
+}
+
+/// The HY_PKG_PROVIDES filter of Query::filterSubject() on the candidates
+static bool
+addProviders(DnfSack * sack, const char * subject, const Map * candidates, PackageSet & pset)
+{
+    Pool * pool = dnf_sack_get_pool(sack);
+    DependencyContainer reldeps(sack);
+    if (hy_is_glob_pattern(subject)) {
+        if (!reldeps.addReldepWithGlob(subject))
+            return false;
+    } else {
+        try {
+            Dependency reldep(sack, subject);
+            reldeps.add(&reldep);
+        } catch (...) {
+            return false;
+        }
+    }
+
+    bool found = false;
+    for (int i = 0; i < reldeps.count(); ++i) {
+        Id p, pp;
+        FOR_PROVIDES(p, pp, reldeps.getId(i)) {
+            if (MAPTST(candidates, p)) {
+                pset.set(p);
+                found = true;
+            }
+        }
+    }
+    return found;
+}
+
+/// The HY_PKG_FILE filters of Query::filterSubject() for several subjects in one filelist walk
+static void
+addFileOwners(DnfSack * sack, const std::vector<std::string> & subjects,
+              const std::vector<std::size_t> & indexes, const Map * candidates,
+              std::vector<PackageSet> & results)
+{
+    Pool * pool = dnf_sack_get_pool(sack);
+    // like the filter a trailing slash is dropped, patterns without glob characters compare exactly
+    std::unordered_map<std::string, std::vector<std::size_t>> exact;
+    std::vector<std::pair<std::string, std::size_t>> globs;
+    for (auto index : indexes) {
+        std::string pattern = subjects[index];
+        if (pattern.size() > 1 && pattern.back() == '/')
+            pattern.pop_back();
+        if (hy_is_glob_pattern(subjects[index].c_str()))
+            globs.emplace_back(std::move(pattern), index);
+        else
+            exact[pattern].push_back(index);
+    }
+
+    Id end = std::min(pool->nsolvables, candidates->size << 3);
+    if (dnf_sack_get_lazy_extensions(sack) & DNF_SACK_LOAD_FLAG_USE_FILELISTS) {
+        Repo * lastRepo = nullptr;
+        for (Id id = 1; id < end; ++id) {
+            if (!MAPTST(candidates, id))
+                continue;
+            Repo * repo = pool_id2solvable(pool, id)->repo;
+            if (repo == lastRepo)
+                continue;
+            lastRepo = repo;
+            g_autoptr(GError) error = NULL;
+            if (!dnf_sack_load_lazy_extensions(sack, DNF_SACK_LOAD_FLAG_USE_FILELISTS, repo,
+                                               &error)) {
+                auto logger(Log::getLogger());
+                logger->warning(tfm::format(_("Result of the file lookup is incomplete: %s"),
+                                            error->message));
+            }
+        }
+    }
+
+    Dataiterator di;
+    // reused for the lookups, its buffer grows to the longest path once
+    std::string path;
+    for (Id id = 1; id < end; ++id) {
+        if (!MAPTST(candidates, id))
+            continue;
+        dataiterator_init(&di, pool, 0, id, SOLVABLE_FILELIST, nullptr,
+                          SEARCH_FILES | SEARCH_COMPLETE_FILELIST);
+        while (dataiterator_step(&di)) {
+            path.assign(di.kv.str);
+            auto it = exact.find(path);
+            if (it != exact.end()) {
+                for (auto index : it->second)
+                    results[index].set(id);
+            }
+            for (auto & glob : globs) {
+                if (fnmatch(glob.first.c_str(), di.kv.str, 0) == 0)
+                    results[glob.second].set(id);
+            }
+        }
+        dataiterator_free(&di);
+    }
+}
+
+std::vector<std::unique_ptr<Selector>>
+resolveSubjectSelectors(DnfSack * sack, const std::vector<std::string> & subjects, bool obsoletes,
+                        const char * reponame)
+{
+    Pool * pool = dnf_sack_get_pool(sack);
+    // the query of hy_subject_get_best_solution()
+    Query base(sack, Query::ExcludeFlags::APPLY_EXCLUDES);
+    base.addFilter(HY_PKG_ARCH, HY_NEQ, "src");
+    base.apply();
+    const Map * candidates = base.getResult();
+
+    std::vector<PackageSet> results(subjects.size(), PackageSet(sack));
+    std::vector<bool> justName(subjects.size(), false);
+    SubjectMatcher matcher(sack);
+    for (auto & subject : subjects)
+        matcher.addSubject(subject.c_str());
+    matcher.match(candidates);
+
+    std::vector<std::size_t> fileSubjects;
+    // the provides are only needed once a subject is not matched by its NEVRA
+    bool providesReady = false;
+    for (std::size_t i = 0; i < subjects.size(); ++i) {
+        if (matcher.matched(i)) {
+            matcher.addMatches(i, results[i]);
+            justName[i] = matcher.matchedJustName(i);
+            continue;
+        }
+        if (!providesReady) {
+            dnf_sack_make_provides_ready(sack);
+            providesReady = true;
+        }
+        if (addProviders(sack, subjects[i].c_str(), candidates, results[i]))
+            continue;
+        if (hy_is_file_pattern(subjects[i].c_str()))
+            fileSubjects.push_back(i);
+    }
+    if (!fileSubjects.empty())
+        addFileOwners(sack, subjects, fileSubjects, candidates, results);
+
+    std::vector<std::unique_ptr<Selector>> selectors;
+    selectors.reserve(subjects.size());
+    for (std::size_t i = 0; i < subjects.size(); ++i) {
+        auto & pset = results[i];
+        if (pset.size() != 0 && obsoletes && justName[i]) {
+            Query obsoleting(sack, Query::ExcludeFlags::IGNORE_EXCLUDES);
+            obsoleting.addFilter(HY_PKG, HY_EQ, &pset);
+            obsoleting.addFilter(HY_PKG_OBSOLETES, HY_EQ, &pset);
+            pset += *obsoleting.getResultPset();
+        }
+        if (pset.size() != 0 && reponame) {
+            Id id = -1;
+            while ((id = pset.next(id)) != -1) {
+                Repo * repo = pool_id2solvable(pool, id)->repo;
+                if (repo != pool->installed && strcmp(repo->name, reponame) != 0)
+                    pset.remove(id);
+            }
+        }
+        selectors.emplace_back(new Selector(sack));
+        selectors.back()->set(&pset);
+    }
+    return selectors;
+}
+
+}
@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2022 Red Hat, Inc.
+ *
+ * Licensed under the GNU Lesser General Public License Version 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef __SUBJECT_MATCHER_HPP
+#define __SUBJECT_MATCHER_HPP
+
+#include "../dnf-types.h"
+#include "packageset.hpp"
+#include "selector.hpp"
+
+#include <solv/bitmap.h>
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace libdnf {
+
+/**
+* @brief Matches many subjects against the packages of a sack in a single pass.
+*
+* Every subject is resolved exactly like Query::filterSubject(subject, nullptr, false, true,
+* false, false) would do on a query holding the candidates: the NEVRA forms are tried from the
+* most specific one and the first form matching any candidate wins, the NEVRA glob is the
+* fallback. Instead of one query per subject, the forms of all subjects are compiled up front.
+* Forms with an exact name are looked up by name id, glob names are matched once per distinct
+* package name, so the cost of a pass hardly depends on the number of subjects.
+*/
+class SubjectMatcher {
+public:
+    explicit SubjectMatcher(DnfSack * sack);
+    SubjectMatcher(const SubjectMatcher &) = delete;
+    SubjectMatcher & operator=(const SubjectMatcher &) = delete;
+
+    /**
+    * @brief Compile the subject. Subjects must be added before match() is called.
+    *
+    * @return index of the subject used for the results
+    */
+    std::size_t addSubject(const char * subject);
+
+    /// Resolve all subjects against the packages in the candidates map
+    void match(const Map * candidates);
+
+    /// Whether any candidate matched the subject, same as the bool returned by filterSubject
+    bool matched(std::size_t index) const;
+
+    /// Add the packages matched by the subject to pset
+    void addMatches(std::size_t index, PackageSet & pset) const;
+
+    /// Whether the matching form of the subject has just a name, like Nevra::hasJustName()
+    bool matchedJustName(std::size_t index) const;
+
+private:
+    struct Form {
+        std::size_t subject;
+        std::size_t rank;
+        // the fallback form matches the pattern against the whole NEVRA string
+        bool wholeNevra;
+        bool withEpoch;
+        std::string pattern;
+        bool patternGlob;
+        // filters of a parsed NEVRA form, empty strings and -1 are not filtered on
+        std::string name;
+        long epoch;
+        std::string version;
+        bool versionGlob;
+        std::string release;
+        bool releaseGlob;
+        std::string arch;
+        bool archGlob;
+        Id archId;
+        bool justName;
+    };
+
+    struct Subject {
+        std::size_t firstForm;
+        std::size_t best;
+        std::vector<std::vector<Id>> hits;
+    };
+
+    void buildIndex();
+    const std::vector<const Form *> & globNameForms(Id nameId);
+
+    DnfSack * sack;
+    std::vector<Subject> subjects;
+    std::vector<Form> forms;
+    std::unordered_map<Id, std::vector<const Form *>> exactNameForms;
+    std::vector<const Form *> globForms;
+    std::vector<const Form *> anyNameForms;
+    std::unordered_map<Id, std::vector<const Form *>> globMemo;
+};
+
+/**
+* @brief Resolve many subjects to selectors like hy_subject_get_best_selector() with no forms.
+*
+* The NEVRA forms of all subjects are matched by a single SubjectMatcher pass. The subjects
+* without a match are looked up in the provides index and the remaining file patterns are
+* matched in a single walk of the filelists.
+*
+* @param obsoletes add the packages obsoleting the matches of subjects with just a name
+* @param reponame restrict the available packages to the repo, nullptr for all repos
+* @return a selector for every subject, in the order of subjects
+*/
+std::vector<std::unique_ptr<Selector>> resolveSubjectSelectors(
+    DnfSack * sack, const std::vector<std::string> & subjects, bool obsoletes, const char * reponame);
+
+}
+
+#endif /* __SUBJECT_MATCHER_HPP */
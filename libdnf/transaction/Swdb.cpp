@@ -614,6 +614,21 @@ Swdb::filterUserinstalled(PackageSet & installed) const
     }
 }
 
+std::string
+Swdb::getHistoryStamp() const
+{
+    // changes made through this connection are counted by SQLite, data_version changes with every
+    // commit of another connection, e.g. of another process
+    SQLite3::Statement lastTrans(*conn, "SELECT COALESCE(MAX(id), 0) FROM trans");
+    SQLite3::Statement dataVersion(*conn, "PRAGMA data_version");
+    if (lastTrans.step() != SQLite3::Statement::StepResult::ROW ||
+        dataVersion.step() != SQLite3::Statement::StepResult::ROW) {
+        return {};
+    }
+    return conn->getPath() + ":" + std::to_string(lastTrans.get< int64_t >(0)) + ":" +
+           std::to_string(conn->totalChanges()) + ":" + std::to_string(dataVersion.get< int64_t >(0));
+}
+
 std::vector< int64_t >
 Swdb::searchTransactionsByRPM(const std::vector< std::string > &patterns)
 {
@@ -121,6 +121,12 @@ public:
     */
     void filterUserinstalled(PackageSet & installed) const;
 
+    /**
+    * @brief Stamp of the history, it changes with every change of the database, including those
+    * made by other connections
+    */
+    std::string getHistoryStamp() const;
+
 protected:
     friend class Transformer;
 
@@ -351,6 +351,9 @@ public:
 
     int changes() { return sqlite3_changes(db); }
 
+    /// Rows changed through this connection since it was opened
+    int totalChanges() { return sqlite3_total_changes(db); }
+
     int64_t lastInsertRowID() { return sqlite3_last_insert_rowid(db); }
 
     std::string getError() const { return sqlite3_errmsg(db); }
@@ -255,6 +255,46 @@ set_protect_running_kernel(_GoalObject *self, PyObject * value, void * closure)
     return 0;
 } CATCH_TO_PYTHON_INT
 
+static PyObject *
+get_profiling(_GoalObject *self, void * unused) try
+{
+    return PyBool_FromLong(self->goal->getProfiling());
+} CATCH_TO_PYTHON
+
+static int
+set_profiling(_GoalObject *self, PyObject * value, void * closure) try
+{
+    if(!PyBool_Check(value)) {
+        PyErr_SetString(PyExc_TypeError, "Only Bool Type accepted");
+        return -1;
+    }
+    self->goal->setProfiling(PyObject_IsTrue(value));
+    return 0;
+} CATCH_TO_PYTHON_INT
+
+/// Phases of the last run as {phase: {"wall_seconds": ..., "cpu_seconds": ..., size: value}}
+static PyObject *
+get_profile(_GoalObject *self, void * unused) try
+{
+    UniquePtrPyObject pyProfile(PyDict_New());
+    if (!pyProfile)
+        return NULL;
+    for (const auto & phase : self->goal->getProfile()) {
+        UniquePtrPyObject pyPhase(Py_BuildValue("{s:d,s:d}", "wall_seconds", phase.wallSeconds,
+                                                "cpu_seconds", phase.cpuSeconds));
+        if (!pyPhase)
+            return NULL;
+        for (const auto & size : phase.sizes) {
+            UniquePtrPyObject pySize(PyLong_FromLong(size.second));
+            if (!pySize || PyDict_SetItemString(pyPhase.get(), size.first.c_str(), pySize.get()) == -1)
+                return NULL;
+        }
+        if (PyDict_SetItemString(pyProfile.get(), phase.name.c_str(), pyPhase.get()) == -1)
+            return NULL;
+    }
+    return pyProfile.release();
+} CATCH_TO_PYTHON
+
 static PyObject *
 erase(_GoalObject *self, PyObject *args, PyObject *kwds) try
 {
@@ -677,6 +717,8 @@ static PyGetSetDef goal_getsetters[] = {
     {(char*)"actions",        (getter)get_actions, NULL, NULL, NULL},
     {(char*)"protect_running_kernel", (getter)get_protect_running_kernel,
         (setter)set_protect_running_kernel, NULL, NULL},
+    {(char*)"profiling", (getter)get_profiling, (setter)set_profiling, NULL, NULL},
+    {(char*)"profile", (getter)get_profile, NULL, NULL, NULL},
     {NULL}                /* sentinel */
 };
 
@@ -605,7 +605,7 @@ static PyObject *
 filter_modules(_SackObject *self, PyObject *args, PyObject *kwds) try
 {
     const char *kwlist[] = {"module_container", "hotfix_repos", "install_root", "platform_module",
-        "update_only", "debugsolver", "module_obsoletes", NULL};
+        "update_only", "debugsolver", "module_obsoletes", "phase_stats", NULL};
     PyObject * pyModuleContainer;
     PyObject * pyHotfixRepos;
     char * installRoot = nullptr;
@@ -613,10 +613,12 @@ filter_modules(_SackObject *self, PyObject *args, PyObject *kwds) try
     PyObject * pyUpdateOnly = nullptr;
     PyObject * pyDebugSolver = nullptr;
     PyObject * pyModuleObsoletes = nullptr;
+    PyObject * pyPhaseStats = nullptr;
 
-    if (!PyArg_ParseTupleAndKeywords(args, kwds, "OOzz|O!O!O!", (char**) kwlist, &pyModuleContainer,
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "OOzz|O!O!O!O!", (char**) kwlist, &pyModuleContainer,
                                      &pyHotfixRepos, &installRoot, &platformModule, &PyBool_Type, &pyUpdateOnly,
-                                     &PyBool_Type, &pyDebugSolver, &PyBool_Type, &pyModuleObsoletes))
+                                     &PyBool_Type, &pyDebugSolver, &PyBool_Type, &pyModuleObsoletes,
+                                     &PyList_Type, &pyPhaseStats))
         return 0;
     bool updateOnly = pyUpdateOnly == NULL || PyObject_IsTrue(pyUpdateOnly);
     bool debugSolver = pyDebugSolver != NULL && PyObject_IsTrue(pyDebugSolver);
@@ -634,8 +636,17 @@ filter_modules(_SackObject *self, PyObject *args, PyObject *kwds) try
     std::transform(hotfixRepos.begin(), hotfixRepos.end(), hotfixReposCString.begin(),
         std::mem_fn(&std::string::c_str));
     try {
+        std::vector<libdnf::ModuleFilteringPhase> phases;
         auto problems = dnf_sack_filter_modules_v2(self->sack, moduleContainer, hotfixReposCString.data(),
-            installRoot, platformModule, updateOnly, debugSolver, moduleObsoletes);
+            installRoot, platformModule, updateOnly, debugSolver, moduleObsoletes,
+            pyPhaseStats ? &phases : nullptr);
+        // a dict per phase is appended to the list given by the caller
+        for (const auto & phase : phases) {
+            UniquePtrPyObject pyPhase(Py_BuildValue("{s:s,s:d,s:n}", "phase", phase.name.c_str(),
+                "seconds", phase.seconds, "count", static_cast<Py_ssize_t>(phase.count)));
+            if (!pyPhase || PyList_Append(pyPhaseStats, pyPhase.get()) == -1)
+                return NULL;
+        }
         if (problems.second == libdnf::ModulePackageContainer::ModuleErrorType::NO_ERROR) {
             PyObject * returnTuple = PyTuple_New(0);
             return returnTuple;
@@ -733,14 +744,16 @@ static PyObject *
 load_repo(_SackObject *self, PyObject *args, PyObject *kwds) try
 {
     const char *kwlist[] = {"repo", "build_cache", "load_filelists", "load_presto",
-                      "load_updateinfo", "load_other", NULL};
+                      "load_updateinfo", "load_other", "lazy_extensions", NULL};
 
     PyObject * repoPyObj = NULL;
     int build_cache = 0, load_filelists = 0, load_presto = 0, load_updateinfo = 0, load_other = 0;
-    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|iiiii", (char**) kwlist,
+    int lazy_extensions = 0;
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O|iiiiii", (char**) kwlist,
                                      &repoPyObj,
                                      &build_cache, &load_filelists,
-                                     &load_presto, &load_updateinfo, &load_other))
+                                     &load_presto, &load_updateinfo, &load_other,
+                                     &lazy_extensions))
         return 0;
 
     // Is it old deprecated _hawkey.Repo object?
@@ -775,6 +788,8 @@ load_repo(_SackObject *self, PyObject *args, PyObject *kwds) try
         flags |= DNF_SACK_LOAD_FLAG_USE_UPDATEINFO;
     if (load_other)
         flags |= DNF_SACK_LOAD_FLAG_USE_OTHER;
+    if (lazy_extensions)
+        flags |= DNF_SACK_LOAD_FLAG_LAZY_EXTENSIONS;
     Py_BEGIN_ALLOW_THREADS;
     ret = dnf_sack_load_repo(self->sack, crepo, flags, &error);
     Py_END_ALLOW_THREADS;
@@ -21,9 +21,12 @@
 #include <check.h>
 #include <glib.h>
 #include <stdarg.h>
+#include <algorithm>
+#include <string>
 #include <vector>
 
 #include "libdnf/goal/Goal.hpp"
+#include "libdnf/goal/IdQueue.hpp"
 #include "libdnf/dnf-types.h"
 #include "libdnf/hy-goal-private.hpp"
 #include "libdnf/hy-iutil.h"
@@ -130,6 +133,84 @@ assert_iueo(HyGoal goal, int i, int u, int e, int o)
     ck_assert_int_eq(size_and_free(hy_goal_list_obsoleted(goal, NULL)), o);
 }
 
+/* list the steps of one type by querying every step of trans, one type at a time */
+static libdnf::PackageSet
+list_steps_of_type(DnfSack *sack, Transaction *trans, Id type_filter1, Id type_filter2)
+{
+    libdnf::PackageSet plist(sack);
+    const int common_mode = SOLVER_TRANSACTION_SHOW_OBSOLETES |
+        SOLVER_TRANSACTION_CHANGE_IS_REINSTALL;
+
+    for (int i = 0; i < trans->steps.count; ++i) {
+        Id p = trans->steps.elements[i];
+        Id type;
+        if (type_filter1 == SOLVER_TRANSACTION_OBSOLETED)
+            type = transaction_type(trans, p, common_mode);
+        else
+            type = transaction_type(trans, p, common_mode |
+                                    SOLVER_TRANSACTION_SHOW_ACTIVE|
+                                    SOLVER_TRANSACTION_SHOW_ALL);
+        if (type == type_filter1 || (type_filter2 && type == type_filter2))
+            plist.set(p);
+    }
+    return plist;
+}
+
+static void
+assert_same_pset(const libdnf::PackageSet & actual, const libdnf::PackageSet & expected,
+                 const char *what)
+{
+    fail_unless(actual.size() == expected.size(), "%s: %d packages, expected %d", what,
+                (int)actual.size(), (int)expected.size());
+    Id id = -1;
+    while ((id = expected.next(id)) != -1)
+        fail_unless(actual.has(id), "%s: solvable %d missing", what, id);
+}
+
+/* assert that every list of the solved goal equals the steps of that type in the transaction
+ * of the goal, queried one type at a time; returns the number of step types present */
+static int
+assert_lists_match_transaction(HyGoal goal, DnfSack *sack)
+{
+    Transaction *trans = libdnf::goalTransaction(*goal);
+    fail_if(trans == NULL);
+
+    struct {
+        const char *what;
+        libdnf::PackageSet actual;
+        Id type_filter1;
+        Id type_filter2;
+    } lists[] = {
+        {"installs", goal->listInstalls(), SOLVER_TRANSACTION_INSTALL, SOLVER_TRANSACTION_OBSOLETES},
+        {"upgrades", goal->listUpgrades(), SOLVER_TRANSACTION_UPGRADE, 0},
+        {"downgrades", goal->listDowngrades(), SOLVER_TRANSACTION_DOWNGRADE, 0},
+        {"reinstalls", goal->listReinstalls(), SOLVER_TRANSACTION_REINSTALL, 0},
+        {"erasures", goal->listErasures(), SOLVER_TRANSACTION_ERASE, 0},
+        {"obsoleted", goal->listObsoleted(), SOLVER_TRANSACTION_OBSOLETED, 0},
+    };
+    int present = 0;
+    for (auto & list : lists) {
+        auto expected = list_steps_of_type(sack, trans, list.type_filter1, list.type_filter2);
+        assert_same_pset(list.actual, expected, list.what);
+        if (expected.size())
+            ++present;
+    }
+
+    libdnf::IdQueue obsoletes;
+    for (int i = 0; i < trans->steps.count; ++i) {
+        Id p = trans->steps.elements[i];
+        transaction_all_obs_pkgs(trans, p, obsoletes.getQueue());
+        libdnf::PackageSet expected(sack);
+        for (int j = 0; j < obsoletes.size(); ++j)
+            expected.set(obsoletes[j]);
+        DnfPackage *pkg = dnf_package_new(sack, p);
+        assert_same_pset(goal->listObsoletedByPackage(pkg), expected, "obsoleted by package");
+        g_object_unref(pkg);
+    }
+
+    return present;
+}
+
 START_TEST(test_goal_sanity)
 {
     HyGoal goal = hy_goal_create(test_globals.sack);
@@ -176,6 +257,64 @@ START_TEST(test_goal_install)
 }
 END_TEST
 
+START_TEST(test_goal_run_repeated)
+{
+    DnfSack *sack = test_globals.sack;
+    DnfPackage *pkg = get_latest_pkg(sack, "walrus");
+    libdnf::Goal goal(sack);
+    goal.install(pkg, false);
+    g_object_unref(pkg);
+    fail_if(goal.run(DNF_NONE));
+    assert_iueo(&goal, 2, 0, 0, 0);
+
+    // the solver of the first run is used again
+    fail_if(goal.run(DNF_NONE));
+    assert_iueo(&goal, 2, 0, 0, 0);
+
+    // a new one once the excludes change
+    HyQuery q = hy_query_create(sack);
+    hy_query_filter(q, HY_PKG_NAME, HY_EQ, "semolina");
+    DnfPackageSet *semolina = hy_query_run_set(q);
+    hy_query_free(q);
+    dnf_sack_set_excludes(sack, semolina);
+    fail_unless(goal.run(DNF_NONE));
+    dnf_sack_set_excludes(sack, NULL);
+    dnf_packageset_free(semolina);
+    fail_if(goal.run(DNF_NONE));
+    assert_iueo(&goal, 2, 0, 0, 0);
+}
+END_TEST
+
+START_TEST(test_goal_run_profile)
+{
+    DnfSack *sack = test_globals.sack;
+    DnfPackage *pkg = get_latest_pkg(sack, "walrus");
+    libdnf::Goal goal(sack);
+    goal.install(pkg, false);
+    g_object_unref(pkg);
+    fail_if(goal.run(DNF_NONE));
+    fail_unless(goal.getProfile().empty());
+
+    goal.setProfiling(true);
+    fail_if(goal.run(DNF_NONE));
+    const char * names[] = {"construct_job", "recompute_considered", "make_provides_ready",
+                            "solver_solve", "limit_installonly", "create_transaction",
+                            "protected_in_removals"};
+    auto & profile = goal.getProfile();
+    ck_assert_int_eq(profile.size(), 7);
+    for (unsigned i = 0; i < profile.size(); ++i) {
+        ck_assert_str_eq(profile[i].name.c_str(), names[i]);
+        fail_unless(profile[i].wallSeconds >= 0);
+    }
+    fail_unless(profile[0].sizes.at("job_size") >= 1);
+    fail_unless(profile[3].sizes.at("rules") > 0);
+    fail_unless(profile[3].sizes.at("decisions") > 0);
+    ck_assert_int_eq(profile[3].sizes.at("problems"), 0);
+    // walrus and its dependency
+    ck_assert_int_eq(profile[5].sizes.at("steps"), 2);
+}
+END_TEST
+
 START_TEST(test_goal_install_multilib)
 {
     // Tests installation of multilib package. The package is selected via
@@ -599,11 +738,60 @@ START_TEST(test_goal_describe_problem_rules)
     fail_unless(problems[0] == expected[0]);
     fail_unless(problems[1] == expected[1]);
 
+    // the structured rules render to the same messages
+    auto rules = goal->getProblemRules(0);
+    fail_unless(rules.size() >= 2);
+    std::vector<std::string> rendered;
+    for (auto & rule : rules) {
+        auto message = goal->describeProblemRule(rule, true);
+        if (std::find(rendered.begin(), rendered.end(), message) == rendered.end())
+            rendered.push_back(message);
+    }
+    fail_unless(rendered == problems);
+    fail_unless(goal->getProblemRules(hy_goal_count_problems(goal)).empty());
+
+    auto allProblems = goal->describeAllProblemRules(true);
+    fail_unless(allProblems.size() >= 1);
+    fail_unless(allProblems[0] == problems);
+
     g_object_unref(pkg);
     hy_goal_free(goal);
 }
 END_TEST
 
+START_TEST(test_goal_run_batch)
+{
+    DnfSack *sack = test_globals.sack;
+    DnfPackage *walrus = get_latest_pkg(sack, "walrus");
+    DnfPackage *hello = get_latest_pkg(sack, "hello");
+    libdnf::Goal goalWalrus(sack);
+    libdnf::Goal goalHello(sack);
+    libdnf::Goal goalBoth(sack);
+    goalWalrus.install(walrus, false);
+    goalHello.install(hello, false);
+    goalBoth.install(walrus, false);
+    goalBoth.install(hello, false);
+
+    auto results = libdnf::Goal::runBatch({&goalWalrus, &goalHello, &goalBoth}, DNF_NONE);
+    fail_unless(results.size() == 3);
+    fail_if(results[0]);
+    fail_unless(results[1]);
+    fail_unless(results[2]);
+    assert_iueo(&goalWalrus, 2, 0, 0, 0);
+    fail_unless(goalHello.describeProblemRules(0, true).size() == 2);
+
+    // the same results as the goals run one after another
+    libdnf::Goal serial(sack);
+    serial.install(hello, false);
+    fail_unless(serial.run(DNF_NONE));
+    fail_unless(serial.describeAllProblemRules(true) == goalHello.describeAllProblemRules(true));
+    fail_unless(goalBoth.countProblems() == serial.countProblems());
+
+    g_object_unref(walrus);
+    g_object_unref(hello);
+}
+END_TEST
+
 START_TEST(test_goal_no_reinstall)
 {
     DnfSack *sack = test_globals.sack;
@@ -617,6 +805,37 @@ START_TEST(test_goal_no_reinstall)
 }
 END_TEST
 
+START_TEST(test_goal_list_classified)
+{
+    DnfSack *sack = test_globals.sack;
+    DnfPackage *walrus = get_latest_pkg(sack, "walrus");
+    DnfPackage *fool = get_latest_pkg(sack, "fool");
+    DnfPackage *baby = get_available_pkg(sack, "baby");
+    DnfPackage *gun = by_name_repo(sack, "gun", HY_SYSTEM_REPO_NAME);
+    HyGoal goal = hy_goal_create(sack);
+
+    // install, upgrade obsoleting penny, downgrade and erase in one transaction
+    fail_if(hy_goal_install(goal, walrus));
+    fail_if(hy_goal_upgrade_to(goal, fool));
+    fail_if(hy_goal_install(goal, baby));
+    fail_if(hy_goal_erase(goal, gun));
+
+    fail_if(hy_goal_run_flags(goal, DNF_NONE));
+    assert_iueo(goal, 2, 1, 1, 1);
+    ck_assert_int_eq(size_and_free(hy_goal_list_downgrades(goal, NULL)), 1);
+    // all types but reinstalls
+    ck_assert_int_eq(assert_lists_match_transaction(goal, sack), 5);
+    // the classification is kept, a second pass gives the same lists
+    ck_assert_int_eq(assert_lists_match_transaction(goal, sack), 5);
+
+    g_object_unref(walrus);
+    g_object_unref(fool);
+    g_object_unref(baby);
+    g_object_unref(gun);
+    hy_goal_free(goal);
+}
+END_TEST
+
 START_TEST(test_goal_erase_simple)
 {
     DnfSack *sack = test_globals.sack;
@@ -1333,6 +1552,25 @@ START_TEST(test_goal_forcebest_arches)
 }
 END_TEST
 
+START_TEST(test_goal_list_classified_change)
+{
+    DnfSack *sack = test_globals.sack;
+    HyGoal goal = hy_goal_create(sack);
+
+    hy_goal_upgrade_all(goal);
+
+    fail_if(hy_goal_run_flags(goal, DNF_NONE));
+    fail_unless(size_and_free(hy_goal_list_reinstalls(goal, NULL)) == 1);
+    // the upgrade and the change listed as reinstall
+    ck_assert_int_eq(assert_lists_match_transaction(goal, sack), 2);
+
+    // a new run classifies the new transaction
+    fail_if(hy_goal_run_flags(goal, DNF_NONE));
+    ck_assert_int_eq(assert_lists_match_transaction(goal, sack), 2);
+    hy_goal_free(goal);
+}
+END_TEST
+
 START_TEST(test_goal_change)
 {
     // test that changes are handled like reinstalls
@@ -1394,6 +1632,8 @@ goal_suite(void)
     tcase_add_test(tc, test_goal_sanity);
     tcase_add_test(tc, test_goal_list_err);
     tcase_add_test(tc, test_goal_install);
+    tcase_add_test(tc, test_goal_run_repeated);
+    tcase_add_test(tc, test_goal_run_profile);
     tcase_add_test(tc, test_goal_install_multilib);
     tcase_add_test(tc, test_goal_install_selector);
     tcase_add_test(tc, test_goal_install_selector_err);
@@ -1409,8 +1649,10 @@ goal_suite(void)
     tcase_add_test(tc, test_goal_get_reason);
     tcase_add_test(tc, test_goal_get_reason_selector);
     tcase_add_test(tc, test_goal_describe_problem_rules);
+    tcase_add_test(tc, test_goal_run_batch);
     tcase_add_test(tc, test_goal_distupgrade_all_keep_arch);
     tcase_add_test(tc, test_goal_no_reinstall);
+    tcase_add_test(tc, test_goal_list_classified);
     tcase_add_test(tc, test_goal_erase_simple);
     tcase_add_test(tc, test_goal_erase_with_deps);
     tcase_add_test(tc, test_goal_protected);
@@ -1471,6 +1713,7 @@ goal_suite(void)
     tc = tcase_create("Change");
     tcase_add_unchecked_fixture(tc, fixture_with_change, teardown);
     tcase_add_test(tc, test_goal_change);
+    tcase_add_test(tc, test_goal_list_classified_change);
     tcase_add_test(tc, test_goal_clone);
     suite_add_tcase(s, tc);
 
@@ -101,6 +101,22 @@ START_TEST(test_checksum)
 }
 END_TEST
 
+START_TEST(test_checksum_strings)
+{
+    unsigned char cs1[CHKSUM_BYTES];
+    unsigned char cs2[CHKSUM_BYTES];
+
+    fail_if(checksum_strings(cs1, {"primary", "sha256:ab"}));
+    fail_if(checksum_strings(cs2, {"primary", "sha256:ab"}));
+    fail_if(checksum_cmp(cs1, cs2));
+    /* the boundaries between the strings are part of the checksum */
+    fail_if(checksum_strings(cs2, {"primarysha256:ab"}));
+    fail_unless(checksum_cmp(cs1, cs2));
+    fail_if(checksum_strings(cs2, {"primary", "sha256:a", "b"}));
+    fail_unless(checksum_cmp(cs1, cs2));
+}
+END_TEST
+
 START_TEST(test_dnf_solvfile_userdata)
 {
     char *new_file = solv_dupjoin(test_globals.tmpdir,
@@ -193,6 +209,7 @@ iutil_suite(void)
     TCase *tc = tcase_create("Main");
     tcase_add_test(tc, test_abspath);
     tcase_add_test(tc, test_checksum);
+    tcase_add_test(tc, test_checksum_strings);
     tcase_add_test(tc, test_dnf_solvfile_userdata);
     tcase_add_test(tc, test_mkcachedir);
     tcase_add_test(tc, test_version_split);
@@ -33,6 +33,9 @@
 #include "libdnf/dnf-sack-private.hpp"
 #include "libdnf/sack/packageset.hpp"
 #include "libdnf/sack/query.hpp"
+#include "libdnf/transaction/RPMItem.hpp"
+#include "libdnf/transaction/Swdb.hpp"
+#include "libdnf/transaction/Transformer.hpp"
 #include "fixtures.h"
 #include "test_suites.h"
 #include "testsys.h"
@@ -861,6 +864,79 @@ START_TEST(test_disabled_repo)
 }
 END_TEST
 
+static DnfPackageSet *
+packages_named(DnfSack *sack, const char *name)
+{
+    HyQuery q = hy_query_create_flags(sack, HY_IGNORE_EXCLUDES);
+    hy_query_filter(q, HY_PKG_NAME, HY_EQ, name);
+    DnfPackageSet *pset = hy_query_run_set(q);
+    hy_query_free(q);
+    return pset;
+}
+
+// the incrementally updated considered maps match a full recomputation
+static void
+check_considered(DnfSack *sack)
+{
+    Pool *pool = dnf_sack_get_pool(sack);
+    for (auto flags : {libdnf::Query::ExcludeFlags::APPLY_EXCLUDES,
+                       libdnf::Query::ExcludeFlags::IGNORE_MODULAR_EXCLUDES,
+                       libdnf::Query::ExcludeFlags::IGNORE_REGULAR_EXCLUDES,
+                       libdnf::Query::ExcludeFlags::IGNORE_EXCLUDES}) {
+        Map *fresh = NULL;
+        dnf_sack_recompute_considered_map(sack, &fresh, flags);
+        const Map *kept = dnf_sack_get_considered_map(sack, flags);
+        for (Id p = 2; p < pool->nsolvables; ++p)
+            fail_unless((!fresh || MAPTST(fresh, p)) == (!kept || MAPTST(kept, p)));
+        if (fresh) {
+            map_free(fresh);
+            g_free(fresh);
+        }
+    }
+}
+
+START_TEST(test_excluded_incremental)
+{
+    DnfSack *sack = test_globals.sack;
+    DnfPackageSet *jay = packages_named(sack, "jay");
+    DnfPackageSet *penny = packages_named(sack, "penny");
+    DnfPackageSet *dog = packages_named(sack, "dog");
+
+    check_considered(sack);
+    dnf_sack_add_excludes(sack, jay);
+    check_considered(sack);
+    dnf_sack_add_module_excludes(sack, dog);
+    check_considered(sack);
+    dnf_sack_add_includes(sack, penny);
+    check_considered(sack);
+    dnf_sack_set_use_includes(sack, "main", TRUE);
+    check_considered(sack);
+    dnf_sack_add_includes(sack, jay);
+    check_considered(sack);
+    dnf_sack_remove_includes(sack, penny);
+    check_considered(sack);
+    dnf_sack_repo_enabled(sack, "main", 0);
+    check_considered(sack);
+    dnf_sack_repo_enabled(sack, "main", 1);
+    check_considered(sack);
+    dnf_sack_set_excludes(sack, penny);
+    check_considered(sack);
+    dnf_sack_remove_excludes(sack, penny);
+    check_considered(sack);
+    dnf_sack_set_use_includes(sack, NULL, FALSE);
+    check_considered(sack);
+    dnf_sack_set_includes(sack, NULL);
+    check_considered(sack);
+    dnf_sack_remove_module_excludes(sack, dog);
+    check_considered(sack);
+
+    dnf_sack_set_module_excludes(sack, NULL);
+    delete jay;
+    delete penny;
+    delete dog;
+}
+END_TEST
+
 START_TEST(test_query_nevra_glob)
 {
     DnfSack *sack = test_globals.sack;
@@ -1033,6 +1109,100 @@ START_TEST(test_union)
 }
 END_TEST
 
+START_TEST(test_query_unneeded)
+{
+    DnfSack *sack = test_globals.sack;
+    auto conn = std::make_shared<libdnf::SQLite3>(":memory:");
+    libdnf::Transformer::createDatabase(conn);
+    libdnf::Swdb swdb(conn);
+
+    // without any history all installed packages are user installed
+    libdnf::Query unneeded(sack);
+    unneeded.installed();
+    fail_unless(unneeded.filterUnneeded(swdb, false) == 0);
+    fail_unless(unneeded.size() == 0);
+
+    // the second round is answered by the memoized solves
+    for (int round = 0; round < 2; ++round) {
+        libdnf::Query flying(sack);
+        flying.installed();
+        flying.addFilter(HY_PKG_NAME, HY_EQ, "flying");
+        fail_unless(flying.filterSafeToRemove(swdb, false) == 0);
+        fail_unless(flying.size() == 1);
+
+        // flying requires P-lib
+        libdnf::Query lib(sack);
+        lib.installed();
+        lib.addFilter(HY_PKG_NAME, HY_EQ, "penny-lib");
+        fail_unless(lib.filterSafeToRemove(swdb, false) == 0);
+        fail_unless(lib.size() == 0);
+
+        libdnf::Query both(sack);
+        both.installed();
+        const char *names[] = {"flying", "penny-lib", NULL};
+        both.addFilter(HY_PKG_NAME, HY_EQ, names);
+        fail_unless(both.filterSafeToRemove(swdb, false) == 0);
+        fail_unless(both.size() == 2);
+    }
+}
+END_TEST
+
+static std::vector<std::string>
+unneeded_names(DnfSack *sack, const libdnf::Swdb & swdb)
+{
+    Pool *pool = dnf_sack_get_pool(sack);
+    libdnf::Query unneeded(sack);
+    unneeded.installed();
+    fail_unless(unneeded.filterUnneeded(swdb, false) == 0);
+    std::vector<std::string> names;
+    auto pset = unneeded.runSet();
+    Id id = -1;
+    while ((id = pset->next(id)) != -1)
+        names.push_back(pool_id2str(pool, pool_id2solvable(pool, id)->name));
+    return names;
+}
+
+START_TEST(test_query_unneeded_invalidated)
+{
+    DnfSack *sack = test_globals.sack;
+    auto conn = std::make_shared<libdnf::SQLite3>(":memory:");
+    libdnf::Transformer::createDatabase(conn);
+    libdnf::Swdb swdb(conn);
+    fail_unless(unneeded_names(sack, swdb).empty());
+
+    // a transaction installs fool as a dependency, nothing requires it
+    swdb.initTransaction();
+    auto fool = std::make_shared<libdnf::RPMItem>(conn);
+    fool->setName("fool");
+    fool->setEpoch(0);
+    fool->setVersion("1");
+    fool->setRelease("3");
+    fool->setArch("noarch");
+    auto item = swdb.addItem(fool, "main", libdnf::TransactionItemAction::INSTALL,
+                             libdnf::TransactionItemReason::DEPENDENCY);
+    item->setState(libdnf::TransactionItemState::DONE);
+    swdb.beginTransaction(1, "", "", 0);
+    swdb.endTransaction(2, "", libdnf::TransactionState::DONE);
+    swdb.closeTransaction();
+    fail_unless(unneeded_names(sack, swdb) == std::vector<std::string>{"fool"});
+
+    // changing the reason in place adds no transaction and keeps the sum of the states
+    conn->exec("UPDATE trans_item SET reason = 2");
+    fail_unless(unneeded_names(sack, swdb).empty());
+
+    conn->exec("UPDATE trans_item SET reason = 1");
+    fail_unless(unneeded_names(sack, swdb) == std::vector<std::string>{"fool"});
+
+    // the excludes change the considered packages and with them the solve
+    libdnf::Query foolQuery(sack);
+    foolQuery.addFilter(HY_PKG_NAME, HY_EQ, "fool");
+    dnf_sack_add_excludes(sack, foolQuery.runSet());
+    fail_unless(unneeded_names(sack, swdb).empty());
+    dnf_sack_reset_excludes(sack);
+    fail_unless(unneeded_names(sack, swdb) == std::vector<std::string>{"fool"});
+}
+END_TEST
+
 Suite *
 query_suite(void)
 {
@@ -1048,6 +1218,8 @@ query_suite(void)
     tcase_add_test(tc, test_query_empty);
     tcase_add_test(tc, test_query_repo);
     tcase_add_test(tc, test_query_installed_available);
+    tcase_add_test(tc, test_query_unneeded);
+    tcase_add_test(tc, test_query_unneeded_invalidated);
     tcase_add_test(tc, test_query_name);
     tcase_add_test(tc, test_query_evr);
     tcase_add_test(tc, test_query_epoch);
@@ -1115,6 +1287,7 @@ query_suite(void)
     tcase_add_checked_fixture(tc, fixture_reset, NULL);
     tcase_add_test(tc, test_excluded);
     tcase_add_test(tc, test_disabled_repo);
+    tcase_add_test(tc, test_excluded_incremental);
     suite_add_tcase(s, tc);
 
     tc = tcase_create("Advisories");
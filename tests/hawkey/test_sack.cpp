@@ -21,10 +21,17 @@
 #include <check.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 #include <unistd.h>
+#include <utime.h>
 #include <sys/types.h>
+#include <sys/utsname.h>
+#include <map>
+#include <string>
+#include <vector>
 
 
+#include <rpm/rpmmacro.h>
 #include <solv/testcase.h>
 
 #include <glib/gstdio.h>
@@ -36,6 +43,8 @@
 #include "libdnf/dnf-sack-private.hpp"
 #include "libdnf/hy-util.h"
 #include "libdnf/hy-iutil-private.hpp"
+#include "libdnf/sack/query.hpp"
+#include "libdnf/sack/repoclosure.hpp"
 #include "fixtures.h"
 #include "testsys.h"
 #include "test_suites.h"
@@ -149,6 +158,96 @@ START_TEST(test_repo_written)
 }
 END_TEST
 
+static int
+count_tmp_caches(const char *dir, const char *reponame)
+{
+    g_autoptr(GDir) gdir = g_dir_open(dir, 0, NULL);
+    const gchar *name;
+    int count = 0;
+
+    fail_if(gdir == NULL);
+    while ((name = g_dir_read_name(gdir)) != NULL)
+        if (g_str_has_prefix(name, reponame) &&
+            !g_str_has_suffix(name, ".solv") && !g_str_has_suffix(name, ".solvx"))
+            ++count;
+    return count;
+}
+
+START_TEST(test_repo_written_async)
+{
+    g_autoptr(GError) error = NULL;
+    DnfSack *sack = dnf_sack_new();
+    dnf_sack_set_cachedir(sack, test_globals.tmpdir);
+    fail_unless(dnf_sack_setup(sack, DNF_SACK_SETUP_FLAG_MAKE_CACHE_DIR, NULL));
+    dnf_sack_set_async_cache_writes(sack, TRUE);
+    dnf_sack_set_cache_fsync_policy(sack, DNF_SACK_CACHE_FSYNC_FULL);
+    char *filename = dnf_sack_give_cache_fn(sack, "test_sack_written_async", NULL);
+
+    setup_yum_sack(sack, "test_sack_written_async");
+    fail_unless(dnf_sack_wait_for_cache_writes(sack, &error));
+    g_assert_no_error(error);
+    fail_if(access(filename, R_OK|W_OK));
+    fail_unless(count_tmp_caches(dnf_sack_get_cache_dir(sack), "test_sack_written_async") == 0);
+    g_object_unref(sack);
+
+    /* the written caches are used by the next sack */
+    sack = dnf_sack_new();
+    dnf_sack_set_cachedir(sack, test_globals.tmpdir);
+    fail_unless(dnf_sack_setup(sack, DNF_SACK_SETUP_FLAG_MAKE_CACHE_DIR, NULL));
+    setup_yum_sack(sack, "test_sack_written_async");
+    HyRepo repo = hrepo_by_name(sack, "test_sack_written_async");
+    fail_unless(libdnf::repoGetImpl(repo)->state_main == _HY_LOADED_CACHE);
+    fail_unless(libdnf::repoGetImpl(repo)->state_filelists == _HY_LOADED_CACHE);
+
+    g_free(filename);
+    g_object_unref(sack);
+}
+END_TEST
+
+START_TEST(test_repo_written_after_crash)
+{
+    DnfSack *sack = dnf_sack_new();
+    dnf_sack_set_cachedir(sack, test_globals.tmpdir);
+    fail_unless(dnf_sack_setup(sack, DNF_SACK_SETUP_FLAG_MAKE_CACHE_DIR, NULL));
+    dnf_sack_set_async_cache_writes(sack, TRUE);
+    char *filename = dnf_sack_give_cache_fn(sack, "test_sack_crashed", NULL);
+    char *tmp_filename = g_strconcat(filename, ".Xa81Bc", NULL);
+    char *fresh_tmp_filename = g_strconcat(filename, ".Yb92Cd", NULL);
+
+    /* leftovers of a writer killed in the middle of a write a day ago */
+    fail_unless(g_file_set_contents(filename, "SOLV", -1, NULL));
+    fail_unless(g_file_set_contents(tmp_filename, "SOLV\x08\0\0", 7, NULL));
+    struct utimbuf day_ago;
+    day_ago.actime = day_ago.modtime = time(NULL) - 24 * 60 * 60;
+    fail_if(utime(tmp_filename, &day_ago));
+    /* a cache another writer may be just writing */
+    fail_unless(g_file_set_contents(fresh_tmp_filename, "SOLV", -1, NULL));
+
+    setup_yum_sack(sack, "test_sack_crashed");
+    HyRepo repo = hrepo_by_name(sack, "test_sack_crashed");
+    fail_unless(libdnf::repoGetImpl(repo)->state_main == _HY_WRITTEN);
+    g_object_unref(sack);
+
+    /* the stale temporary file was ignored and removed, the fresh one is kept */
+    fail_unless(access(tmp_filename, F_OK) == -1);
+    fail_if(access(fresh_tmp_filename, F_OK));
+
+    /* destroying the sack has put the new cache in place */
+    sack = dnf_sack_new();
+    dnf_sack_set_cachedir(sack, test_globals.tmpdir);
+    fail_unless(dnf_sack_setup(sack, DNF_SACK_SETUP_FLAG_MAKE_CACHE_DIR, NULL));
+    setup_yum_sack(sack, "test_sack_crashed");
+    repo = hrepo_by_name(sack, "test_sack_crashed");
+    fail_unless(libdnf::repoGetImpl(repo)->state_main == _HY_LOADED_CACHE);
+
+    g_unlink(fresh_tmp_filename);
+    g_free(fresh_tmp_filename);
+    g_free(tmp_filename);
+    g_free(filename);
+    g_object_unref(sack);
+}
+END_TEST
+
 START_TEST(test_add_cmdline_package)
 {
     g_autoptr(DnfSack) sack = dnf_sack_new();
@@ -236,6 +335,385 @@ START_TEST(test_filelist_from_cache)
 }
 END_TEST
 
+START_TEST(test_filelist_lazy)
+{
+    DnfSack *sack = dnf_sack_new();
+    dnf_sack_set_cachedir(sack, test_globals.tmpdir);
+    fail_unless(dnf_sack_setup(sack, DNF_SACK_SETUP_FLAG_MAKE_CACHE_DIR, NULL));
+    Pool *pool = dnf_sack_get_pool(sack);
+    const char *repo_path = pool_tmpjoin(pool, test_globals.repo_dir, YUM_DIR_SUFFIX, NULL);
+    HyRepo repo = glob_for_repofiles(pool, YUM_REPO_NAME, repo_path);
+    fail_unless(dnf_sack_load_repo(sack, repo,
+                                   DNF_SACK_LOAD_FLAG_USE_FILELISTS |
+                                   DNF_SACK_LOAD_FLAG_LAZY_EXTENSIONS, NULL));
+    fail_unless(libdnf::repoGetImpl(repo)->state_filelists == _HY_NEW);
+
+    // paths from primary.xml are answered without the filelists
+    HyQuery q = hy_query_create(sack);
+    hy_query_filter(q, HY_PKG_FILE, HY_EQ, "/usr/bin/ste");
+    fail_unless(query_count_results(q) == 1);
+    hy_query_free(q);
+    fail_unless(libdnf::repoGetImpl(repo)->state_filelists == _HY_NEW);
+
+    q = hy_query_create(sack);
+    hy_query_filter(q, HY_PKG_FILE, HY_EQ, "/usr/lib/python2.7/site-packages/tour/today.pyc");
+    fail_unless(query_count_results(q) == 1);
+    hy_query_free(q);
+    fail_if(libdnf::repoGetImpl(repo)->state_filelists == _HY_NEW);
+    check_filelist(pool);
+
+    hy_repo_free(repo);
+    g_object_unref(sack);
+}
+END_TEST
+
+START_TEST(test_filelist_lazy_failed)
+{
+    char *cachedir = g_build_filename(test_globals.tmpdir, "lazy-failed", NULL);
+    DnfSack *sack = dnf_sack_new();
+    dnf_sack_set_cachedir(sack, cachedir);
+    fail_unless(dnf_sack_setup(sack, DNF_SACK_SETUP_FLAG_MAKE_CACHE_DIR, NULL));
+    Pool *pool = dnf_sack_get_pool(sack);
+    const char *repo_path = pool_tmpjoin(pool, test_globals.repo_dir, YUM_DIR_SUFFIX, NULL);
+    HyRepo repo = glob_for_repofiles(pool, YUM_REPO_NAME, repo_path);
+    fail_unless(dnf_sack_load_repo(sack, repo,
+                                   DNF_SACK_LOAD_FLAG_USE_FILELISTS |
+                                   DNF_SACK_LOAD_FLAG_LAZY_EXTENSIONS, NULL));
+    // the filelists disappear before they are needed
+    hy_repo_set_string(repo, HY_REPO_FILELISTS_FN, "/nonexistent/filelists.xml.gz");
+
+    HyQuery q = hy_query_create(sack);
+    hy_query_filter(q, HY_PKG_FILE, HY_EQ, "/usr/lib/python2.7/site-packages/tour/today.pyc");
+    fail_unless(query_count_results(q) == 0);
+    hy_query_free(q);
+
+    // the repo stays marked, every later load reports the missing data
+    g_autoptr(GError) error = NULL;
+    fail_unless(dnf_sack_get_lazy_extensions(sack) & DNF_SACK_LOAD_FLAG_USE_FILELISTS);
+    fail_if(dnf_sack_load_lazy_extensions(sack, DNF_SACK_LOAD_FLAG_USE_FILELISTS, NULL, &error));
+    fail_unless(error != NULL);
+    fail_unless(libdnf::repoGetImpl(repo)->lazy_load_failed & DNF_SACK_LOAD_FLAG_USE_FILELISTS);
+
+    hy_repo_free(repo);
+    g_object_unref(sack);
+    g_free(cachedir);
+}
+END_TEST
+
+static DnfSack *
+load_cached_yum_sack(const char *cachedir, const char *repomd_fn, HyRepo *repo)
+{
+    DnfSack *sack = dnf_sack_new();
+    dnf_sack_set_cachedir(sack, cachedir);
+    fail_unless(dnf_sack_setup(sack, DNF_SACK_SETUP_FLAG_MAKE_CACHE_DIR, NULL));
+    Pool *pool = dnf_sack_get_pool(sack);
+    const char *repo_path = pool_tmpjoin(pool, test_globals.repo_dir, YUM_DIR_SUFFIX, NULL);
+    *repo = glob_for_repofiles(pool, YUM_REPO_NAME, repo_path);
+    if (repomd_fn)
+        hy_repo_set_string(*repo, HY_REPO_MD_FN, repomd_fn);
+    fail_unless(dnf_sack_load_repo(sack, *repo,
+                                   DNF_SACK_LOAD_FLAG_BUILD_CACHE |
+                                   DNF_SACK_LOAD_FLAG_USE_FILELISTS |
+                                   DNF_SACK_LOAD_FLAG_USE_UPDATEINFO, NULL));
+    return sack;
+}
+
+START_TEST(test_cache_per_metadata_type)
+{
+    char *cachedir = g_build_filename(test_globals.tmpdir, "per-type", NULL);
+    HyRepo repo;
+
+    DnfSack *sack = load_cached_yum_sack(cachedir, NULL, &repo);
+    auto repoImpl = libdnf::repoGetImpl(repo);
+    fail_unless(repoImpl->state_main == _HY_WRITTEN);
+    fail_unless(repoImpl->state_filelists == _HY_WRITTEN);
+    fail_unless(repoImpl->state_updateinfo == _HY_WRITTEN);
+    hy_repo_free(repo);
+    g_object_unref(sack);
+
+    // unchanged inputs, everything comes from the caches
+    sack = load_cached_yum_sack(cachedir, NULL, &repo);
+    repoImpl = libdnf::repoGetImpl(repo);
+    fail_unless(repoImpl->state_main == _HY_LOADED_CACHE);
+    fail_unless(repoImpl->state_filelists == _HY_LOADED_CACHE);
+    fail_unless(repoImpl->state_updateinfo == _HY_LOADED_CACHE);
+    fail_unless(dnf_sack_count(sack) == TEST_EXPECT_YUM_NSOLVABLES);
+    hy_repo_free(repo);
+    g_object_unref(sack);
+
+    // a refreshed updateinfo record rebuilds just the updateinfo cache
+    char *repomd_fn = g_build_filename(test_globals.repo_dir, YUM_DIR_SUFFIX, "repomd.xml", NULL);
+    gchar *repomd = NULL;
+    fail_unless(g_file_get_contents(repomd_fn, &repomd, NULL, NULL));
+    std::string changed(repomd);
+    auto pos = changed.find("3888e1b46e2cb71d6a85f74d1f6d88652a9e3ed2bb85b30ae592aa0c0de91627");
+    fail_unless(pos != std::string::npos);
+    changed.replace(pos, 4, "0000");
+    char *changed_fn = g_build_filename(test_globals.tmpdir, "per-type-repomd.xml", NULL);
+    fail_unless(g_file_set_contents(changed_fn, changed.c_str(), -1, NULL));
+
+    sack = load_cached_yum_sack(cachedir, changed_fn, &repo);
+    repoImpl = libdnf::repoGetImpl(repo);
+    fail_unless(repoImpl->state_main == _HY_LOADED_CACHE);
+    fail_unless(repoImpl->state_filelists == _HY_LOADED_CACHE);
+    fail_unless(repoImpl->state_updateinfo == _HY_WRITTEN);
+    hy_repo_free(repo);
+    g_object_unref(sack);
+
+    // a changed primary record invalidates the caches of everything built on it
+    pos = changed.find("f1ab2aa6c0e5881b9365f83a951e6696812ebfaaf56fee310c3f080c8849a1b4");
+    fail_unless(pos != std::string::npos);
+    changed.replace(pos, 4, "0000");
+    fail_unless(g_file_set_contents(changed_fn, changed.c_str(), -1, NULL));
+
+    sack = load_cached_yum_sack(cachedir, changed_fn, &repo);
+    repoImpl = libdnf::repoGetImpl(repo);
+    fail_unless(repoImpl->state_main == _HY_WRITTEN);
+    fail_unless(repoImpl->state_filelists == _HY_WRITTEN);
+    fail_unless(repoImpl->state_updateinfo == _HY_LOADED_CACHE);
+    hy_repo_free(repo);
+    g_object_unref(sack);
+
+    g_free(changed_fn);
+    g_free(repomd);
+    g_free(repomd_fn);
+    g_free(cachedir);
+}
+END_TEST
+
+START_TEST(test_snapshot)
+{
+    const int flags = DNF_SACK_LOAD_FLAG_BUILD_CACHE | DNF_SACK_LOAD_FLAG_USE_FILELISTS;
+    unsigned char key[CHKSUM_BYTES];
+    unsigned char key2[CHKSUM_BYTES];
+    int count;
+
+    DnfSack *sack = dnf_sack_new();
+    dnf_sack_set_cachedir(sack, test_globals.tmpdir);
+    fail_unless(dnf_sack_setup(sack, DNF_SACK_SETUP_FLAG_MAKE_CACHE_DIR, NULL));
+    Pool *pool = dnf_sack_get_pool(sack);
+    const char *repo_path = pool_tmpjoin(pool, test_globals.repo_dir, YUM_DIR_SUFFIX, NULL);
+    HyRepo repo = glob_for_repofiles(pool, YUM_REPO_NAME, repo_path);
+    fail_unless(dnf_sack_load_repo(sack, repo, flags, NULL));
+    count = dnf_sack_count(sack);
+    dnf_sack_make_provides_ready(sack);
+    dnf_sack_snapshot_key(sack, {repo}, FALSE, flags, key);
+    fail_unless(dnf_sack_write_snapshot(sack, key, NULL));
+    fail_unless(dnf_sack_wait_for_cache_writes(sack, NULL));
+    hy_repo_free(repo);
+    g_object_unref(sack);
+
+    sack = dnf_sack_new();
+    dnf_sack_set_cachedir(sack, test_globals.tmpdir);
+    fail_unless(dnf_sack_setup(sack, DNF_SACK_SETUP_FLAG_MAKE_CACHE_DIR, NULL));
+    pool = dnf_sack_get_pool(sack);
+    repo = glob_for_repofiles(pool, YUM_REPO_NAME, repo_path);
+
+    // a different configuration does not match the snapshot
+    dnf_sack_snapshot_key(sack, {repo}, FALSE, DNF_SACK_LOAD_FLAG_BUILD_CACHE, key2);
+    fail_unless(checksum_cmp(key, key2));
+    fail_if(dnf_sack_load_snapshot(sack, {repo}, FALSE, key2));
+    fail_unless(dnf_sack_count(sack) == 0);
+
+    dnf_sack_snapshot_key(sack, {repo}, FALSE, flags, key2);
+    fail_if(checksum_cmp(key, key2));
+    fail_unless(dnf_sack_load_snapshot(sack, {repo}, FALSE, key2));
+    fail_unless(dnf_sack_count(sack) == count);
+    fail_unless(libdnf::repoGetImpl(repo)->state_main == _HY_LOADED_CACHE);
+    fail_unless(libdnf::repoGetImpl(repo)->state_filelists == _HY_LOADED_CACHE);
+    check_filelist(pool);
+
+    hy_repo_free(repo);
+    g_object_unref(sack);
+}
+END_TEST
+
+static DnfSack *
+create_rooted_sack(const char *cachedir, const char *root)
+{
+    DnfSack *sack = dnf_sack_new();
+    dnf_sack_set_cachedir(sack, cachedir);
+    dnf_sack_set_rootdir(sack, root);
+    fail_unless(dnf_sack_setup(sack, DNF_SACK_SETUP_FLAG_MAKE_CACHE_DIR, NULL));
+    return sack;
+}
+
+START_TEST(test_snapshot_rpmdb_changed)
+{
+    const int flags = DNF_SACK_LOAD_FLAG_BUILD_CACHE;
+    const std::vector<HyRepo> no_repos;
+    unsigned char key[CHKSUM_BYTES];
+    unsigned char key2[CHKSUM_BYTES];
+    char *dbpath = rpmExpand("%{_dbpath}", NULL);
+    gchar *root = g_build_filename(test_globals.tmpdir, "snapshot-root", NULL);
+    gchar *dbdir = g_build_filename(root, dbpath[0] == '/' ? dbpath : "/var/lib/rpm", NULL);
+    gchar *rpmdb_fn = g_build_filename(dbdir, "rpmdb.sqlite", NULL);
+    gchar *cachedir = g_build_filename(test_globals.tmpdir, "snapshot-rpmdb", NULL);
+    free(dbpath);
+    fail_if(g_mkdir_with_parents(dbdir, 0755));
+    fail_unless(g_file_set_contents(rpmdb_fn, "rpmdb", -1, NULL));
+
+    // the snapshot covers the system repo
+    DnfSack *sack = create_rooted_sack(cachedir, root);
+    fail_if(dnf_sack_rpmdb_stamp(sack).empty());
+    Pool *pool = dnf_sack_get_pool(sack);
+    const char *system_fn = pool_tmpjoin(pool, test_globals.repo_dir, HY_SYSTEM_REPO_NAME ".repo", NULL);
+    fail_if(load_repo(pool, HY_SYSTEM_REPO_NAME, system_fn, TRUE));
+    int count = dnf_sack_count(sack);
+    fail_unless(count > 0);
+    dnf_sack_make_provides_ready(sack);
+    dnf_sack_snapshot_key(sack, no_repos, TRUE, flags, key);
+    fail_unless(dnf_sack_write_snapshot(sack, key, NULL));
+    fail_unless(dnf_sack_wait_for_cache_writes(sack, NULL));
+    g_object_unref(sack);
+
+    // it is restored while the rpmdb is unchanged
+    sack = create_rooted_sack(cachedir, root);
+    dnf_sack_snapshot_key(sack, no_repos, TRUE, flags, key2);
+    fail_if(checksum_cmp(key, key2));
+    fail_unless(dnf_sack_load_snapshot(sack, no_repos, TRUE, key2));
+    fail_unless(dnf_sack_count(sack) == count);
+    fail_if(dnf_sack_get_pool(sack)->installed == NULL);
+    g_object_unref(sack);
+
+    // a transaction changes the rpmdb, the snapshot is stale
+    FILE *fp = fopen(rpmdb_fn, "a");
+    fail_if(fp == NULL);
+    fputs("-changed", fp);
+    fclose(fp);
+    sack = create_rooted_sack(cachedir, root);
+    dnf_sack_snapshot_key(sack, no_repos, TRUE, flags, key2);
+    fail_unless(checksum_cmp(key, key2));
+    fail_if(dnf_sack_load_snapshot(sack, no_repos, TRUE, key2));
+    fail_unless(dnf_sack_count(sack) == 0);
+    fail_unless(dnf_sack_get_pool(sack)->installed == NULL);
+    g_object_unref(sack);
+
+    g_free(cachedir);
+    g_free(rpmdb_fn);
+    g_free(dbdir);
+    g_free(root);
+}
+END_TEST
+
+/* name of the running kernel found by running_kernel(), "-" for none */
+static std::string
+running_kernel_name(DnfSack *sack)
+{
+    Id id = running_kernel(sack);
+    if (id < 0)
+        return "-";
+    Pool *pool = dnf_sack_get_pool(sack);
+    return pool_id2str(pool, pool_id2solvable(pool, id)->name);
+}
+
+static DnfSack *
+create_kernel_sack(const char *cachedir, const char *root, const char *system_fn)
+{
+    DnfSack *sack = create_rooted_sack(cachedir, root);
+    fail_if(load_repo(dnf_sack_get_pool(sack), HY_SYSTEM_REPO_NAME, system_fn, TRUE));
+    return sack;
+}
+
+static std::vector<std::string>
+read_lines(const char *fn)
+{
+    g_autofree gchar *content = NULL;
+    fail_unless(g_file_get_contents(fn, &content, NULL, NULL));
+    g_auto(GStrv) lines = g_strsplit(content, "\n", -1);
+    return std::vector<std::string>(lines, lines + g_strv_length(lines));
+}
+
+START_TEST(test_running_kernel_cache)
+{
+    struct utsname un;
+    fail_if(uname(&un) < 0);
+    char *dbpath = rpmExpand("%{_dbpath}", NULL);
+    gchar *root = g_build_filename(test_globals.tmpdir, "kernel-root", NULL);
+    gchar *dbdir = g_build_filename(root, dbpath[0] == '/' ? dbpath : "/var/lib/rpm", NULL);
+    gchar *rpmdb_fn = g_build_filename(dbdir, "rpmdb.sqlite", NULL);
+    gchar *cachedir = g_build_filename(test_globals.tmpdir, "kernel-cache", NULL);
+    gchar *cache_fn = g_build_filename(cachedir, "running-kernel.cache", NULL);
+    gchar *system_fn = g_build_filename(test_globals.tmpdir, "kernel-system.repo", NULL);
+    gchar *system2_fn = g_build_filename(test_globals.tmpdir, "kernel-system2.repo", NULL);
+    free(dbpath);
+    fail_if(g_mkdir_with_parents(dbdir, 0755));
+    fail_unless(g_file_set_contents(rpmdb_fn, "rpmdb", -1, NULL));
+
+    // the kernel package owns the image of the running release
+    std::string system = std::string("=Ver: 2.0\n") +
+        "=Pkg: kernel 1 1 x86_64\n=Prv: /boot/vmlinuz-" + un.release + "\n" +
+        "=Pkg: tour 4 0 noarch\n";
+    fail_unless(g_file_set_contents(system_fn, system.c_str(), -1, NULL));
+    system += "=Pkg: dog 1 1 x86_64\n";
+    fail_unless(g_file_set_contents(system2_fn, system.c_str(), -1, NULL));
+
+    // a miss walks the files and stores the result
+    DnfSack *sack = create_kernel_sack(cachedir, root, system_fn);
+    ck_assert_str_eq(running_kernel_name(sack).c_str(), "kernel");
+    g_object_unref(sack);
+    auto lines = read_lines(cache_fn);
+    fail_unless(lines.size() >= 2);
+    const std::string key = lines[0];
+    fail_unless(key.compare(0, strlen(un.release) + 1, std::string(un.release) + "|") == 0);
+    ck_assert_str_eq(lines[1].c_str(), "kernel 1-1 x86_64");
+
+    // a hit is taken from the cache without looking at the files
+    fail_unless(g_file_set_contents(cache_fn, (key + "\ntour 4-0 noarch\n").c_str(), -1, NULL));
+    sack = create_kernel_sack(cachedir, root, system_fn);
+    ck_assert_str_eq(running_kernel_name(sack).c_str(), "tour");
+    g_object_unref(sack);
+
+    // so is the negative result
+    fail_unless(g_file_set_contents(cache_fn, (key + "\n-\n").c_str(), -1, NULL));
+    sack = create_kernel_sack(cachedir, root, system_fn);
+    ck_assert_str_eq(running_kernel_name(sack).c_str(), "-");
+    g_object_unref(sack);
+
+    // a corrupt cache is ignored and rewritten
+    fail_unless(g_file_set_contents(cache_fn, "garbage", -1, NULL));
+    sack = create_kernel_sack(cachedir, root, system_fn);
+    ck_assert_str_eq(running_kernel_name(sack).c_str(), "kernel");
+    g_object_unref(sack);
+    lines = read_lines(cache_fn);
+    ck_assert_str_eq(lines[0].c_str(), key.c_str());
+    ck_assert_str_eq(lines[1].c_str(), "kernel 1-1 x86_64");
+
+    // the result for an other kernel release is stale
+    std::string other_release_key = "0.0.0-other" + key.substr(key.find('|'));
+    fail_unless(g_file_set_contents(cache_fn, (other_release_key + "\ntour 4-0 noarch\n").c_str(), -1, NULL));
+    sack = create_kernel_sack(cachedir, root, system_fn);
+    ck_assert_str_eq(running_kernel_name(sack).c_str(), "kernel");
+    g_object_unref(sack);
+
+    // so is the result for other installed packages
+    fail_unless(g_file_set_contents(cache_fn, (key + "\ntour 4-0 noarch\n").c_str(), -1, NULL));
+    sack = create_kernel_sack(cachedir, root, system2_fn);
+    ck_assert_str_eq(running_kernel_name(sack).c_str(), "kernel");
+    g_object_unref(sack);
+    fail_if(read_lines(cache_fn)[0] == key);
+
+    // and the result for an other rpmdb
+    fail_unless(g_file_set_contents(cache_fn, (key + "\ntour 4-0 noarch\n").c_str(), -1, NULL));
+    FILE *fp = fopen(rpmdb_fn, "a");
+    fail_if(fp == NULL);
+    fputs("-changed", fp);
+    fclose(fp);
+    sack = create_kernel_sack(cachedir, root, system_fn);
+    ck_assert_str_eq(running_kernel_name(sack).c_str(), "kernel");
+    g_object_unref(sack);
+    fail_if(read_lines(cache_fn)[0] == key);
+
+    g_free(system2_fn);
+    g_free(system_fn);
+    g_free(cache_fn);
+    g_free(cachedir);
+    g_free(rpmdb_fn);
+    g_free(dbdir);
+    g_free(root);
+}
+END_TEST
+
 static void
 check_prestoinfo(Pool *pool)
 {
@@ -285,6 +763,69 @@ START_TEST(test_presto_from_cache)
 }
 END_TEST
 
+static std::map<std::string, std::vector<std::string>>
+describe_broken(DnfSack *sack, const libdnf::RepoClosure & closure)
+{
+    Pool *pool = dnf_sack_get_pool(sack);
+    std::map<std::string, std::vector<std::string>> result;
+    for (const auto & item : closure.getBroken()) {
+        auto & deps = result[pool_solvid2str(pool, item.first)];
+        for (Id dep : item.second)
+            deps.push_back(pool_dep2str(pool, dep));
+    }
+    return result;
+}
+
+START_TEST(test_repoclosure)
+{
+    DnfSack *sack = test_globals.sack;
+    libdnf::Query mainQuery(sack);
+    mainQuery.addFilter(HY_PKG_REPONAME, HY_EQ, "main");
+    libdnf::Query allQuery(sack);
+    libdnf::Query withoutLibQuery(sack);
+    withoutLibQuery.addFilter(HY_PKG_NAME, HY_NEQ, "penny-lib");
+    auto main = *mainQuery.runSet();
+    auto all = *allQuery.runSet();
+    auto withoutLib = *withoutLibQuery.runSet();
+
+    libdnf::RepoClosure closure(sack);
+    closure.check(main, all);
+    std::map<std::string, std::vector<std::string>> expected{{"hello-1-1.noarch", {"goodbye"}}};
+    fail_unless(describe_broken(sack, closure) == expected);
+
+    // only the requirers of P-lib are checked again, the result is the same as of a full check
+    closure.update(main, withoutLib, libdnf::PackageSet(sack));
+    libdnf::RepoClosure fresh(sack);
+    fresh.check(main, withoutLib);
+    expected["flying-3-0.noarch"] = {"P-lib"};
+    fail_unless(describe_broken(sack, closure) == expected);
+    fail_unless(describe_broken(sack, fresh) == expected);
+
+    // a changed package is checked again even if the sets are the same
+    closure.update(main, all, main);
+    expected.erase("flying-3-0.noarch");
+    fail_unless(describe_broken(sack, closure) == expected);
+
+    // the providers found by several threads are the same, each dependency may get its own thread
+    libdnf::RepoClosure threaded(sack);
+    threaded.setMinDepsPerThread(1);
+    threaded.check(all, withoutLib);
+    fresh.check(all, withoutLib);
+    fail_if(describe_broken(sack, fresh).empty());
+    fail_unless(describe_broken(sack, threaded) == describe_broken(sack, fresh));
+    threaded.update(all, all, libdnf::PackageSet(sack));
+    fresh.check(all, all);
+    fail_unless(describe_broken(sack, threaded) == describe_broken(sack, fresh));
+
+    // the checked packages shrink
+    auto hello = by_name_repo(sack, "hello", "main");
+    main.remove(dnf_package_get_id(hello));
+    g_object_unref(hello);
+    closure.update(main, all, libdnf::PackageSet(sack));
+    fail_unless(closure.getBroken().empty());
+}
+END_TEST
+
 Suite *
 sack_suite(void)
 {
@@ -296,6 +837,8 @@ sack_suite(void)
     tcase_add_test(tc, test_list_arches);
     tcase_add_test(tc, test_load_repo_err);
     tcase_add_test(tc, test_repo_written);
+    tcase_add_test(tc, test_repo_written_async);
+    tcase_add_test(tc, test_repo_written_after_crash);
     tcase_add_test(tc, test_add_cmdline_package);
     suite_add_tcase(s, tc);
 
@@ -308,10 +851,21 @@ sack_suite(void)
     tcase_add_unchecked_fixture(tc, fixture_yum, teardown);
     tcase_add_test(tc, test_filelist);
     tcase_add_test(tc, test_filelist_from_cache);
+    tcase_add_test(tc, test_filelist_lazy);
+    tcase_add_test(tc, test_filelist_lazy_failed);
+    tcase_add_test(tc, test_cache_per_metadata_type);
+    tcase_add_test(tc, test_snapshot);
+    tcase_add_test(tc, test_snapshot_rpmdb_changed);
+    tcase_add_test(tc, test_running_kernel_cache);
     tcase_add_test(tc, test_presto);
     tcase_add_test(tc, test_presto_from_cache);
     suite_add_tcase(s, tc);
 
+    tc = tcase_create("RepoClosure");
+    tcase_add_unchecked_fixture(tc, fixture_with_main, teardown);
+    tcase_add_test(tc, test_repoclosure);
+    suite_add_tcase(s, tc);
+
     tc = tcase_create("SackKnows");
     tcase_add_unchecked_fixture(tc, fixture_all, teardown);
     suite_add_tcase(s, tc);
@@ -28,11 +28,20 @@
 #include "libdnf/nsvcap.hpp"
 #include "libdnf/dnf-reldep.h"
 #include "libdnf/dnf-sack.h"
+#include "libdnf/hy-package.h"
+#include "libdnf/hy-selector.h"
 #include "libdnf/hy-subject.h"
+#include "libdnf/sack/packageset.hpp"
+#include "libdnf/sack/query.hpp"
+#include "libdnf/sack/subjectmatcher.hpp"
 #include "fixtures.h"
 #include "testshared.h"
 #include "test_suites.h"
 
+#include <set>
+#include <string>
+#include <vector>
+
 const char inp_fof[] = "four-of-fish-8:3.6.9-11.fc100.x86_64";
 const char inp_fof_noepoch[] = "four-of-fish-3.6.9-11.fc100.x86_64";
 const char inp_fof_nev[] = "four-of-fish-8:3.6.9";
@@ -320,6 +329,74 @@ START_TEST(module_form_n)
 }
 END_TEST
 
+START_TEST(subject_matcher)
+{
+    const char * subjects[] = {
+        "penny", "penny-lib", "pen*", "*-lib*", "penny-4", "penny-4-1", "penny-0:4-1.noarch",
+        "penny-lib-4-1.x86_64", "penny-lib.i686", "dog-1-2", "dog-1-*.i686", "dog.*", "baby-6:5.0",
+        "baby-5.0-11.x86_64", "baby-6:*", "flying-3.*", "flying-3-0", "pilchard-1.2.4-1.x86_64",
+        "pilchard-1.2.4", "jay-5.0-0", "*.noarch", "*", "*-*", "nosuchpkg", "nosuch*", "walrus-2",
+        "fool-1-[35]", "semolina.x86_64", "dog > 1", "/usr/bin/penny", ""};
+    DnfSack *sack = test_globals.sack;
+
+    libdnf::SubjectMatcher matcher(sack);
+    std::vector<std::size_t> indexes;
+    for (auto subject : subjects)
+        indexes.push_back(matcher.addSubject(subject));
+    libdnf::Query all(sack);
+    all.apply();
+    matcher.match(all.getResult());
+
+    for (std::size_t i = 0; i < indexes.size(); ++i) {
+        libdnf::Query query(sack);
+        auto ret = query.filterSubject(subjects[i], nullptr, false, true, false, false);
+        libdnf::PackageSet matched(sack);
+        matcher.addMatches(indexes[i], matched);
+        fail_unless(matcher.matched(indexes[i]) == ret.first, "matched differs for '%s'",
+                    subjects[i]);
+        fail_unless(matched.size() == query.size(), "results differ for '%s'", subjects[i]);
+        matched -= *query.getResultPset();
+        fail_unless(matched.size() == 0, "results differ for '%s'", subjects[i]);
+    }
+}
+END_TEST
+
+static std::set<Id>
+selector_ids(HySelector sltr)
+{
+    std::set<Id> ids;
+    g_autoptr(GPtrArray) matches = hy_selector_matches(sltr);
+    for (guint i = 0; i < matches->len; ++i)
+        ids.insert(dnf_package_get_id(static_cast<DnfPackage *>(g_ptr_array_index(matches, i))));
+    return ids;
+}
+
+START_TEST(subject_resolve_selectors)
+{
+    std::vector<std::string> subjects{
+        "penny", "pen*", "penny-4-1", "dog.i686", "dog-1-*", "flying", "fool", "*.noarch",
+        "nosuchpkg", "P-lib", "P-lib >= 1", "*lib", "/usr/bin/penny", "/no/such/file",
+        "/usr/bin/*", "*/penny", "dog > 1", ""};
+    DnfSack *sack = test_globals.sack;
+
+    for (const char * reponame : {static_cast<const char *>(nullptr), "updates"}) {
+        for (bool obsoletes : {false, true}) {
+            auto selectors = libdnf::resolveSubjectSelectors(sack, subjects, obsoletes, reponame);
+            ck_assert_int_eq(selectors.size(), subjects.size());
+            for (std::size_t i = 0; i < subjects.size(); ++i) {
+                HySubject subject = hy_subject_create(subjects[i].c_str());
+                HySelector expected = hy_subject_get_best_selector(subject, sack, NULL, obsoletes,
+                                                                   reponame);
+                fail_unless(selector_ids(selectors[i].get()) == selector_ids(expected),
+                            "selectors differ for '%s'", subjects[i].c_str());
+                hy_selector_free(expected);
+                hy_subject_free(subject);
+            }
+        }
+    }
+}
+END_TEST
+
 Suite *
 subject_suite(void)
 {
@@ -351,6 +428,8 @@ subject_suite(void)
 
     tc = tcase_create("Full");
     tcase_add_unchecked_fixture(tc, fixture_all, teardown);
+    tcase_add_test(tc, subject_matcher);
+    tcase_add_test(tc, subject_resolve_selectors);
     suite_add_tcase(s, tc);
 
     return s;
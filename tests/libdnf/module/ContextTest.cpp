@@ -9,19 +9,31 @@ CPPUNIT_TEST_SUITE_REGISTRATION(ContextTest);
 #include "libdnf/utils/File.hpp"
 #include "libdnf/sack/packageset.hpp"
 #include "libdnf/dnf-sack-private.hpp"
+#include "libdnf/hy-iutil-private.hpp"
+#include "libdnf/repo/Repo-private.hpp"
 
+#include <algorithm>
 #include <memory>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#define UNITTEST_DIR "/tmp/libdnfctxXXXXXX"
 
 void ContextTest::setUp()
 {
+    tmpdir = g_strdup(UNITTEST_DIR);
+    CPPUNIT_ASSERT(mkdtemp(tmpdir));
     dnf_context_set_config_file_path("");
     context = dnf_context_new();
 }
 
 void ContextTest::tearDown()
 {
+    g_autoptr(GError) error = nullptr;
     g_object_unref(context);
+    dnf_remove_recursive_v2(tmpdir, &error);
+    g_assert_no_error(error);
+    g_free(tmpdir);
 }
 
 // XXX: look into sharing assert_list_names in the future
@@ -46,10 +58,10 @@ void ContextTest::testLoadModules()
     constexpr auto install_root = TESTDATADIR "/modules/";
     dnf_context_set_install_root(context, install_root);
     g_autoptr(DnfLock) lock = dnf_lock_new();
-    dnf_lock_set_lock_dir(lock, "/tmp");
+    dnf_lock_set_lock_dir(lock, tmpdir);
     constexpr auto repos_dir = TESTDATADIR "/modules/yum.repos.d/";
     dnf_context_set_repo_dir(context, repos_dir);
-    dnf_context_set_solv_dir(context, "/tmp");
+    dnf_context_set_solv_dir(context, tmpdir);
     auto ret = dnf_context_setup(context, nullptr, &error);
     g_assert_no_error(error);
     g_assert(ret);
@@ -187,6 +199,154 @@ void ContextTest::testLoadModules()
     g_assert_no_error(error);
 }
 
+static DnfSack * setupModulesSack(DnfContext * context, const char * solvDir,
+                                  DnfContextSetupSackFlags flags = DNF_CONTEXT_SETUP_SACK_FLAG_NONE)
+{
+    GError *error = nullptr;
+    dnf_context_set_release_ver(context, "26");
+    dnf_context_set_arch(context, "x86_64");
+    dnf_context_set_install_root(context, TESTDATADIR "/modules/");
+    dnf_context_set_repo_dir(context, TESTDATADIR "/modules/yum.repos.d/");
+    dnf_context_set_solv_dir(context, solvDir);
+    dnf_context_set_platform_module(context, "platform:26");
+    auto ret = dnf_context_setup(context, nullptr, &error);
+    g_assert_no_error(error);
+    g_assert(ret);
+
+    DnfRepo *repo = dnf_repo_loader_get_repo_by_id(dnf_context_get_repo_loader(context), "test", &error);
+    g_assert_no_error(error);
+    DnfState *state = dnf_state_new();
+    dnf_repo_check(repo, G_MAXUINT, state, &error);
+    g_object_unref(state);
+
+    dnf_context_setup_sack_with_flags(context, dnf_context_get_state(context), flags, &error);
+    g_assert_no_error(error);
+    return dnf_context_get_sack(context);
+}
+
+static std::vector<std::string> describeModules(libdnf::ModulePackageContainer * container)
+{
+    std::vector<std::string> result;
+    for (auto package : container->getModulePackages()) {
+        auto description = package->getFullIdentifier() + " " + package->getRepoID();
+        for (const auto & artifact : package->getArtifacts()) {
+            description += " " + artifact;
+        }
+        for (const auto & require : package->getRequires(false)) {
+            description += " " + require;
+        }
+        result.push_back(description);
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+void ContextTest::testModuleCache()
+{
+    // the first context parses the modular metadata and writes the module cache
+    g_autofree gchar * cachePath = g_build_filename(tmpdir, "@modules-cache", NULL);
+    auto sack = setupModulesSack(context, tmpdir);
+    auto expected = describeModules(dnf_sack_get_module_container(sack));
+    auto expectedDefault = dnf_sack_get_module_container(sack)->getDefaultStream("httpd");
+    CPPUNIT_ASSERT(!expected.empty());
+    CPPUNIT_ASSERT(g_file_test(cachePath, G_FILE_TEST_EXISTS));
+
+    // the second one restores the module packages from the cache
+    g_autoptr(DnfContext) cachedContext = dnf_context_new();
+    auto cachedSack = setupModulesSack(cachedContext, tmpdir);
+    auto container = dnf_sack_get_module_container(cachedSack);
+    CPPUNIT_ASSERT(describeModules(container) == expected);
+    CPPUNIT_ASSERT_EQUAL(expectedDefault, container->getDefaultStream("httpd"));
+    auto moduleExcludes = std::unique_ptr<libdnf::PackageSet>(dnf_sack_get_module_excludes(cachedSack));
+    CPPUNIT_ASSERT(moduleExcludes->size() != 0);
+
+    // the documents are loaded on demand
+    for (auto package : container->getModulePackages()) {
+        if (package->getName() == "httpd" && package->getStream() == "2.4") {
+            CPPUNIT_ASSERT(!package->getProfiles().empty());
+            CPPUNIT_ASSERT(!package->getYaml().empty());
+        }
+    }
+}
+
+void ContextTest::testFilterModulesPhases()
+{
+    auto sack = setupModulesSack(context, tmpdir);
+    const char * hotfixRepos[] = {nullptr};
+    std::vector<libdnf::ModuleFilteringPhase> phases;
+    dnf_sack_filter_modules_v2(sack, nullptr, hotfixRepos, TESTDATADIR "/modules/", "platform:26", false,
+                               false, true, &phases);
+
+    std::vector<std::string> names;
+    for (const auto & phase : phases) {
+        names.push_back(phase.name);
+        CPPUNIT_ASSERT(phase.seconds >= 0);
+    }
+    std::vector<std::string> expected{"load_metadata", "add_platform", "defaults", "obsoletes", "resolve",
+                                      "collect_artifacts", "exclude_queries"};
+    CPPUNIT_ASSERT(names == expected);
+
+    auto container = dnf_sack_get_module_container(sack);
+    CPPUNIT_ASSERT_EQUAL(container->getModulePackages().size(), phases[0].count);
+    CPPUNIT_ASSERT_EQUAL(std::size_t(1), phases[1].count);
+    CPPUNIT_ASSERT(phases[4].count != 0);
+    auto moduleExcludes = std::unique_ptr<libdnf::PackageSet>(dnf_sack_get_module_excludes(sack));
+    CPPUNIT_ASSERT(phases[6].count >= moduleExcludes->size());
+}
+
+static std::vector<std::string> describePackages(DnfSack * sack)
+{
+    std::vector<std::string> result;
+    libdnf::Query query{sack, libdnf::Query::ExcludeFlags::IGNORE_EXCLUDES};
+    auto packageSet = query.runSet();
+    Id id = -1;
+    while ((id = packageSet->next(id)) != -1) {
+        auto package = dnf_package_new(sack, id);
+        result.push_back(std::string(dnf_package_get_nevra(package)) + " " + dnf_package_get_reponame(package));
+        g_object_unref(package);
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+void ContextTest::testSackSnapshot()
+{
+    // the first context loads the repos and writes the snapshot
+    g_autofree gchar * snapshot = g_build_filename(tmpdir, "@sack-snapshot", NULL);
+    auto sack = setupModulesSack(context, tmpdir, DNF_CONTEXT_SETUP_SACK_FLAG_USE_SNAPSHOT);
+    auto expected = describePackages(sack);
+    CPPUNIT_ASSERT(!expected.empty());
+    CPPUNIT_ASSERT(dnf_sack_wait_for_cache_writes(sack, nullptr));
+    CPPUNIT_ASSERT(g_file_test(snapshot, G_FILE_TEST_EXISTS));
+    struct stat written;
+    CPPUNIT_ASSERT_EQUAL(0, stat(snapshot, &written));
+
+    // the second one restores the same repos from it, the snapshot is not rewritten
+    g_autoptr(DnfContext) snapshotContext = dnf_context_new();
+    auto snapshotSack = setupModulesSack(snapshotContext, tmpdir, DNF_CONTEXT_SETUP_SACK_FLAG_USE_SNAPSHOT);
+    CPPUNIT_ASSERT(dnf_sack_wait_for_cache_writes(snapshotSack, nullptr));
+    CPPUNIT_ASSERT(describePackages(snapshotSack) == expected);
+    Pool * pool = dnf_sack_get_pool(snapshotSack);
+    Repo * repo;
+    int i;
+    FOR_REPOS(i, repo) {
+        if (repo->appdata)
+            CPPUNIT_ASSERT(libdnf::repoGetImpl(static_cast<HyRepo>(repo->appdata))->state_main == _HY_LOADED_CACHE);
+    }
+    struct stat restored;
+    CPPUNIT_ASSERT_EQUAL(0, stat(snapshot, &restored));
+    CPPUNIT_ASSERT_EQUAL(written.st_ino, restored.st_ino);
+
+    // the modules are filtered the same way on top of the snapshot
+    auto moduleExcludes = std::unique_ptr<libdnf::PackageSet>(dnf_sack_get_module_excludes(snapshotSack));
+    CPPUNIT_ASSERT(moduleExcludes->size() != 0);
+
+    // without the flag the same packages are loaded from the metadata
+    g_autoptr(DnfContext) plainContext = dnf_context_new();
+    auto plainSack = setupModulesSack(plainContext, tmpdir);
+    CPPUNIT_ASSERT(describePackages(plainSack) == expected);
+}
+
 void ContextTest::sackHas(DnfSack * sack, libdnf::ModulePackage * pkg) const
 {
     libdnf::Query query{sack};
@@ -10,6 +10,9 @@ class ContextTest : public CppUnit::TestCase
 {
     CPPUNIT_TEST_SUITE(ContextTest);
         CPPUNIT_TEST(testLoadModules);
+        CPPUNIT_TEST(testModuleCache);
+        CPPUNIT_TEST(testFilterModulesPhases);
+        CPPUNIT_TEST(testSackSnapshot);
     CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -17,9 +20,13 @@ public:
     void tearDown() override;
 
     void testLoadModules();
+    void testModuleCache();
+    void testFilterModulesPhases();
+    void testSackSnapshot();
 
 private:
     DnfContext *context;
+    char *tmpdir;
     void sackHas(DnfSack * sack, libdnf::ModulePackage * pkg) const;
     void sackHasNot(DnfSack * sack, libdnf::ModulePackage * pkg) const;
 };
@@ -5,39 +5,56 @@ CPPUNIT_TEST_SUITE_REGISTRATION(ModulePackageContainerTest);
 #include "libdnf/log.hpp"
 #include "libdnf/dnf-sack-private.hpp"
 #include "libdnf/hy-iutil-private.hpp"
+#include "libdnf/hy-package.h"
+#include "libdnf/nevra.hpp"
+#include "libdnf/repo/solvable/DependencyContainer.hpp"
+#include "libdnf/sack/packageset.hpp"
+#include "libdnf/sack/query.hpp"
+#include "libdnf/utils/utils.hpp"
 
 #include <algorithm>
+#include <array>
+#include <fnmatch.h>
+#include <map>
+#include <memory>
+#include <sys/stat.h>
 
 #define UNITTEST_DIR "/tmp/libdnf22XXXXXX"
 
-void ModulePackageContainerTest::setUp()
+static DnfContext * createContext(const char * installRoot)
 {
     g_autoptr(GError) error = nullptr;
-    tmpdir = g_strdup(UNITTEST_DIR);
-    char *retptr = mkdtemp(tmpdir);
-    CPPUNIT_ASSERT(retptr);
-    char * etc_target = g_strjoin(NULL, tmpdir, "/etc", NULL);
-    CPPUNIT_ASSERT(dnf_copy_recursive(TESTDATADIR "/modules/etc", etc_target, &error));
-    g_assert_no_error(error);
-    g_free(etc_target);
-
-    dnf_context_set_config_file_path("");
-    context = dnf_context_new();
+    DnfContext * context = dnf_context_new();
     dnf_context_set_release_ver(context, "26");
     dnf_context_set_arch(context, "x86_64");
     dnf_context_set_platform_module(context, "platform:26");
-    dnf_context_set_install_root(context, tmpdir);
+    dnf_context_set_install_root(context, installRoot);
     g_autoptr(DnfLock) lock = dnf_lock_new();
-    dnf_lock_set_lock_dir(lock, tmpdir);
+    dnf_lock_set_lock_dir(lock, installRoot);
     dnf_context_set_repo_dir(context, TESTDATADIR "/modules/yum.repos.d/");
-    dnf_context_set_solv_dir(context, tmpdir);
+    dnf_context_set_solv_dir(context, installRoot);
     dnf_context_setup(context, nullptr, &error);
     g_assert_no_error(error);
 
     DnfState *state = dnf_context_get_state(context);
     dnf_context_setup_sack(context, state, &error);
     g_assert_no_error(error);
+    return context;
+}
+
+void ModulePackageContainerTest::setUp()
+{
+    g_autoptr(GError) error = nullptr;
+    tmpdir = g_strdup(UNITTEST_DIR);
+    char *retptr = mkdtemp(tmpdir);
+    CPPUNIT_ASSERT(retptr);
+    char * etc_target = g_strjoin(NULL, tmpdir, "/etc", NULL);
+    CPPUNIT_ASSERT(dnf_copy_recursive(TESTDATADIR "/modules/etc", etc_target, &error));
+    g_assert_no_error(error);
+    g_free(etc_target);
 
+    dnf_context_set_config_file_path("");
+    context = createContext(tmpdir);
     auto sack = dnf_context_get_sack(context);
     modules = dnf_sack_get_module_container(sack);
 }
@@ -156,3 +173,397 @@ void ModulePackageContainerTest::testInstallRemoveProfile()
 
     modules->save();
 }
+
+void ModulePackageContainerTest::testQuery()
+{
+    auto matches = [](const std::string & pattern, const std::string & value) {
+        return pattern.empty() || fnmatch(pattern.c_str(), value.c_str(), 0) == 0;
+    };
+    // name, stream, version, context, arch
+    const std::vector<std::array<std::string, 5>> specs = {
+        {"httpd", "2.4", "", "", ""},
+        {"httpd", "", "", "", "x86_64"},
+        {"http*", "2.?", "", "", ""},
+        {"", "", "", "", ""},
+        {"base-runtime", "f26", "*", "*", "*"},
+        {"httpd", "nonexistent", "", "", ""},
+        {"nonexistent", "", "", "", ""},
+    };
+    auto all = modules->getModulePackages();
+    std::sort(all.begin(), all.end(),
+              [](libdnf::ModulePackage * a, libdnf::ModulePackage * b) { return a->getId() < b->getId(); });
+    for (const auto & spec : specs) {
+        std::vector<libdnf::ModulePackage *> expected;
+        for (auto package : all) {
+            auto arch = package->getArch().empty() ? "noarch" : package->getArch();
+            if (matches(spec[0], package->getName()) && matches(spec[1], package->getStream()) &&
+                matches(spec[2], package->getVersion()) && matches(spec[3], package->getContext()) &&
+                matches(spec[4], arch)) {
+                expected.push_back(package);
+            }
+        }
+        CPPUNIT_ASSERT(modules->query(spec[0], spec[1], spec[2], spec[3], spec[4]) == expected);
+    }
+    CPPUNIT_ASSERT(!modules->query("httpd", "2.4", "", "", "").empty());
+}
+
+void ModulePackageContainerTest::testResolveRepeated()
+{
+    auto activeIds = [this]() {
+        std::vector<Id> ids;
+        for (auto package : modules->getModulePackages()) {
+            if (modules->isModuleActive(package)) {
+                ids.push_back(package->getId());
+            }
+        }
+        return ids;
+    };
+
+    auto first = modules->resolveActiveModulePackages(false);
+    auto active = activeIds();
+    CPPUNIT_ASSERT(!active.empty());
+
+    // unchanged module states give the same result
+    auto second = modules->resolveActiveModulePackages(false);
+    CPPUNIT_ASSERT(first == second);
+    CPPUNIT_ASSERT(activeIds() == active);
+
+    // a changed state is solved again
+    modules->disable("httpd");
+    modules->resolveActiveModulePackages(false);
+    for (auto package : modules->query("httpd", "", "", "", "")) {
+        CPPUNIT_ASSERT(!modules->isModuleActive(package));
+    }
+
+    modules->rollback();
+    CPPUNIT_ASSERT(modules->resolveActiveModulePackages(false) == first);
+    CPPUNIT_ASSERT(activeIds() == active);
+}
+
+// an enabled stream requiring a module which does not exist, the strict solve fails
+static const char * BROKEN_MODULE_YAML =
+    "---\n"
+    "document: modulemd\n"
+    "version: 2\n"
+    "data:\n"
+    "  name: broken\n"
+    "  stream: \"1\"\n"
+    "  version: 1\n"
+    "  context: c0ffee42\n"
+    "  static_context: true\n"
+    "  arch: x86_64\n"
+    "  summary: Broken module\n"
+    "  description: Requires a missing module\n"
+    "  license:\n"
+    "    module: [MIT]\n"
+    "  dependencies:\n"
+    "  - requires:\n"
+    "      missing: [\"1\"]\n"
+    "...\n";
+
+static std::pair<std::vector<std::vector<std::string>>, libdnf::ModulePackageContainer::ModuleErrorType>
+resolveWithBroken(libdnf::ModulePackageContainer * container, bool parallel,
+                  std::vector<std::string> & active)
+{
+    container->add(BROKEN_MODULE_YAML, "test");
+    container->enable("broken", "1");
+    container->setParallelFallbackSolves(parallel);
+    auto result = container->resolveActiveModulePackages(false);
+    for (auto package : container->getModulePackages()) {
+        if (container->isModuleActive(package)) {
+            active.push_back(package->getFullIdentifier());
+        }
+    }
+    std::sort(active.begin(), active.end());
+    return result;
+}
+
+void ModulePackageContainerTest::testResolveParallelFallback()
+{
+    std::vector<std::string> parallelActive;
+    auto parallel = resolveWithBroken(modules, true, parallelActive);
+
+    // the same modules resolved by the serial fallback in a second context
+    g_autoptr(DnfContext) serialContext = createContext(tmpdir);
+    auto serialModules = dnf_sack_get_module_container(dnf_context_get_sack(serialContext));
+    std::vector<std::string> serialActive;
+    auto serial = resolveWithBroken(serialModules, false, serialActive);
+
+    CPPUNIT_ASSERT(parallel.second == libdnf::ModulePackageContainer::ModuleErrorType::ERROR);
+    CPPUNIT_ASSERT(parallel.second == serial.second);
+    CPPUNIT_ASSERT(!parallel.first.empty());
+    CPPUNIT_ASSERT(parallel.first == serial.first);
+    CPPUNIT_ASSERT(!parallelActive.empty());
+    CPPUNIT_ASSERT(parallelActive == serialActive);
+    for (const auto & identifier : parallelActive) {
+        CPPUNIT_ASSERT(identifier.compare(0, 7, "broken:") != 0);
+    }
+    bool httpdActive = false;
+    for (auto package : modules->query("httpd", "2.4", "", "", "")) {
+        httpdActive = httpdActive || modules->isModuleActive(package);
+    }
+    CPPUNIT_ASSERT(httpdActive);
+}
+
+void ModulePackageContainerTest::testSaveChangedOnly()
+{
+    g_autofree gchar * dir = g_build_filename(tmpdir, "etc", "dnf", "modules.d", NULL);
+    std::string unchanged;
+    for (auto package : modules->getModulePackages()) {
+        if (package->getName() != "httpd" && package->getName() != "base-runtime") {
+            unchanged = package->getName();
+            break;
+        }
+    }
+
+    modules->disable("base-runtime");
+    modules->save();
+
+    g_autofree gchar * disabledFile = g_build_filename(dir, "base-runtime.module", NULL);
+    g_autofree gchar * content = nullptr;
+    CPPUNIT_ASSERT(g_file_get_contents(disabledFile, &content, nullptr, nullptr));
+    CPPUNIT_ASSERT(strstr(content, "state=disabled"));
+
+    // modules without a state on disk and without changes are not written
+    if (!unchanged.empty()) {
+        g_autofree gchar * unchangedFile = g_build_filename(dir, (unchanged + ".module").c_str(), NULL);
+        CPPUNIT_ASSERT(!g_file_test(unchangedFile, G_FILE_TEST_EXISTS));
+    }
+    for (const auto & file : libdnf::filesystem::getDirContent(dir)) {
+        CPPUNIT_ASSERT(!libdnf::string::endsWith(file, ".tmp"));
+    }
+}
+
+void ModulePackageContainerTest::testSaveFailedRename()
+{
+    g_autofree gchar * dir = g_build_filename(tmpdir, "etc", "dnf", "modules.d", NULL);
+    g_autofree gchar * runtimeFile = g_build_filename(dir, "base-runtime.module", NULL);
+    g_autofree gchar * httpdFile = g_build_filename(dir, "httpd.module", NULL);
+    g_autofree gchar * content = nullptr;
+    struct stat st;
+
+    // the permissions of a replaced file are kept
+    CPPUNIT_ASSERT_EQUAL(0, chmod(runtimeFile, 0640));
+    modules->disable("base-runtime");
+    modules->save();
+    CPPUNIT_ASSERT_EQUAL(0, stat(runtimeFile, &st));
+    CPPUNIT_ASSERT_EQUAL(static_cast<mode_t>(0640), st.st_mode & 07777);
+
+    // a directory in place of the file makes the rename fail
+    CPPUNIT_ASSERT_EQUAL(0, unlink(httpdFile));
+    g_autofree gchar * blocker = g_build_filename(httpdFile, "blocker", NULL);
+    CPPUNIT_ASSERT_EQUAL(0, g_mkdir_with_parents(httpdFile, 0755));
+    CPPUNIT_ASSERT(g_file_set_contents(blocker, "", 0, nullptr));
+    modules->disable("httpd");
+    CPPUNIT_ASSERT_THROW(modules->save(), libdnf::ModulePackageContainer::Exception);
+    for (const auto & file : libdnf::filesystem::getDirContent(dir)) {
+        CPPUNIT_ASSERT(!libdnf::string::endsWith(file, ".tmp"));
+    }
+
+    // the module is not marked saved, the next save writes it
+    g_autoptr(GError) error = nullptr;
+    CPPUNIT_ASSERT(dnf_remove_recursive_v2(httpdFile, &error));
+    g_assert_no_error(error);
+    modules->save();
+    CPPUNIT_ASSERT(g_file_get_contents(httpdFile, &content, nullptr, nullptr));
+    CPPUNIT_ASSERT(strstr(content, "state=disabled"));
+}
+
+// artifacts of an active and of an inactive stream, well-formed, malformed, with "0:" epochs,
+// source and demodularized ones
+static const char * ARTIFACTS_MODULE_YAML =
+    "---\n"
+    "document: modulemd\n"
+    "version: 2\n"
+    "data:\n"
+    "  name: artifacts\n"
+    "  stream: \"1\"\n"
+    "  version: 1\n"
+    "  context: c0ffee42\n"
+    "  static_context: true\n"
+    "  arch: x86_64\n"
+    "  summary: Artifacts\n"
+    "  description: Active stream\n"
+    "  license:\n"
+    "    module: [MIT]\n"
+    "  demodularized:\n"
+    "    rpms:\n"
+    "    - glibc-debuginfo-common\n"
+    "  artifacts:\n"
+    "    rpms:\n"
+    "    - bash-0:4.4.12-2.x86_64\n"
+    "    - bash-doc-00:4.4.12-2.noarch\n"
+    "    - glibc-2.25-4.x86_64\n"
+    "    - glibc-debuginfo-common-0:2.25-4.x86_64\n"
+    "    - basesystem-a:11-3.noarch\n"
+    "    - glibc(x)-2.25-4.x86_64\n"
+    "    - dummy-nscd 2.25-4.x86_64\n"
+    "    - filesystem-3.2-40\n"
+    "    - -1-2.x86_64\n"
+    "    - glibc-common-2.25-4.\n"
+    "    - grub2-0:2.02-0.40.src\n"
+    "    - filesystem-0:3.2-40.nosrc\n"
+    "...\n"
+    "---\n"
+    "document: modulemd\n"
+    "version: 2\n"
+    "data:\n"
+    "  name: artifacts\n"
+    "  stream: \"2\"\n"
+    "  version: 1\n"
+    "  context: c0ffee42\n"
+    "  static_context: true\n"
+    "  arch: x86_64\n"
+    "  summary: Artifacts\n"
+    "  description: Inactive stream\n"
+    "  license:\n"
+    "    module: [MIT]\n"
+    "  artifacts:\n"
+    "    rpms:\n"
+    "    - glibc-0:2.17-157.x86_64\n"
+    "    - bash-4.2.46-21.x86_64\n"
+    "    - dummy-nscd-a:2.17-157.x86_64\n"
+    "    - filesystem-3.2-21.x86_64.\n"
+    "    - grub2-2.02-0.40.x86_64\n"
+    "...\n";
+
+static std::vector<const char *>
+toCStrings(const std::vector<std::string> & strings)
+{
+    std::vector<const char *> cStrings;
+    for (const auto & str : strings) {
+        cStrings.push_back(str.c_str());
+    }
+    cStrings.push_back(nullptr);
+    return cStrings;
+}
+
+// the module excludes and includes as computed by the HY_PKG_NEVRA_STRICT and HY_PKG_NAME queries
+// setModuleExcludes() used before the artifacts were matched by pool Ids
+static void
+referenceModuleExcludes(DnfSack * sack, libdnf::ModulePackageContainer & container,
+                        libdnf::PackageSet & excludes, libdnf::PackageSet & includes)
+{
+    auto allPackages = container.getModulePackages();
+    std::map<std::string, std::vector<std::string>> demodularizedNames;
+    for (auto package : container.getLatestModules(allPackages, true)) {
+        auto demodularized = package->getDemodularizedRpms();
+        if (!demodularized.empty()) {
+            demodularizedNames[package->getNameStream() + "." + package->getArch()] = demodularized;
+        }
+    }
+
+    std::vector<std::string> includeNEVRAs;
+    std::vector<std::string> excludeNEVRAs;
+    std::vector<std::string> names;
+    std::vector<std::string> srcNames;
+    libdnf::DependencyContainer nameDependencies{sack};
+    libdnf::Nevra nevra;
+    for (auto package : allPackages) {
+        auto artifacts = package->getArtifacts();
+        if (!container.isModuleActive(package->getId())) {
+            excludeNEVRAs.insert(excludeNEVRAs.end(), artifacts.begin(), artifacts.end());
+            continue;
+        }
+        includeNEVRAs.insert(includeNEVRAs.end(), artifacts.begin(), artifacts.end());
+        auto it = demodularizedNames.find(package->getNameStream() + "." + package->getArch());
+        for (const auto & rpm : artifacts) {
+            if (!nevra.parse(rpm.c_str(), HY_FORM_NEVRA)) {
+                continue;
+            }
+            if (it != demodularizedNames.end() &&
+                std::find(it->second.begin(), it->second.end(), nevra.getName()) != it->second.end()) {
+                continue;
+            }
+            if (nevra.getArch() == "src" || nevra.getArch() == "nosrc") {
+                srcNames.push_back(nevra.getName());
+            } else {
+                names.push_back(nevra.getName());
+                nameDependencies.addReldep(nevra.getName().c_str());
+            }
+        }
+    }
+    auto includeCStrings = toCStrings(includeNEVRAs);
+    auto excludeCStrings = toCStrings(excludeNEVRAs);
+    auto namesCStrings = toCStrings(names);
+    auto srcNamesCStrings = toCStrings(srcNames);
+
+    // the module excludes of the sack are set already
+    libdnf::Query keepPackages{sack, libdnf::Query::ExcludeFlags::IGNORE_MODULAR_EXCLUDES};
+    const char * keepRepo[] = {HY_CMDLINE_REPO_NAME, HY_SYSTEM_REPO_NAME, nullptr};
+    keepPackages.addFilter(HY_PKG_REPONAME, HY_NEQ, keepRepo);
+
+    libdnf::Query includeQuery{sack, libdnf::Query::ExcludeFlags::IGNORE_MODULAR_EXCLUDES};
+    libdnf::Query excludeQuery{keepPackages};
+    libdnf::Query excludeProvidesQuery{keepPackages};
+    libdnf::Query excludeNamesQuery{keepPackages};
+    libdnf::Query excludeSrcNamesQuery{keepPackages};
+    includeQuery.addFilter(HY_PKG_NEVRA_STRICT, HY_EQ, includeCStrings.data());
+
+    excludeQuery.addFilter(HY_PKG_NEVRA_STRICT, HY_EQ, excludeCStrings.data());
+    excludeQuery.queryDifference(includeQuery);
+
+    excludeProvidesQuery.addFilter(HY_PKG_PROVIDES, &nameDependencies);
+    excludeProvidesQuery.queryDifference(includeQuery);
+
+    excludeSrcNamesQuery.addFilter(HY_PKG_NAME, HY_EQ, srcNamesCStrings.data());
+    const char * srcArchs[] = {"src", "nosrc", nullptr};
+    excludeSrcNamesQuery.addFilter(HY_PKG_ARCH, HY_EQ, srcArchs);
+
+    excludeNamesQuery.addFilter(HY_PKG_NAME, HY_EQ, namesCStrings.data());
+    excludeNamesQuery.queryUnion(excludeSrcNamesQuery);
+    excludeNamesQuery.queryDifference(includeQuery);
+
+    excludes += *excludeQuery.getResultPset();
+    excludes += *excludeProvidesQuery.getResultPset();
+    excludes += *excludeNamesQuery.getResultPset();
+    includes += *includeQuery.getResultPset();
+}
+
+static std::vector<std::string>
+packageNevras(DnfSack * sack, const libdnf::PackageSet & pset)
+{
+    std::vector<std::string> nevras;
+    Id id = -1;
+    while ((id = pset.next(id)) != -1) {
+        g_autoptr(DnfPackage) package = dnf_package_new(sack, id);
+        nevras.push_back(dnf_package_get_nevra(package));
+    }
+    std::sort(nevras.begin(), nevras.end());
+    return nevras;
+}
+
+void ModulePackageContainerTest::testModuleExcludesMatchQueries()
+{
+    auto sack = dnf_context_get_sack(context);
+    modules->add(ARTIFACTS_MODULE_YAML, "test");
+    modules->enable("artifacts", "1");
+    dnf_sack_filter_modules_v2(sack, modules, nullptr, nullptr, nullptr, true, false, false);
+
+    libdnf::PackageSet expectedExcludes(sack);
+    libdnf::PackageSet expectedIncludes(sack);
+    referenceModuleExcludes(sack, *modules, expectedExcludes, expectedIncludes);
+    std::unique_ptr<libdnf::PackageSet> excludes(dnf_sack_get_module_excludes(sack));
+    std::unique_ptr<libdnf::PackageSet> includes(dnf_sack_get_module_includes(sack));
+    CPPUNIT_ASSERT(excludes && includes);
+    auto excluded = packageNevras(sack, *excludes);
+    auto included = packageNevras(sack, *includes);
+    CPPUNIT_ASSERT(excluded == packageNevras(sack, expectedExcludes));
+    CPPUNIT_ASSERT(included == packageNevras(sack, expectedIncludes));
+
+    auto has = [](const std::vector<std::string> & nevras, const char * nevra) {
+        return std::find(nevras.begin(), nevras.end(), nevra) != nevras.end();
+    };
+    // "0:" epochs are matched, other bash builds are excluded by the name
+    CPPUNIT_ASSERT(has(included, "bash-4.4.12-2.x86_64"));
+    CPPUNIT_ASSERT(has(included, "bash-doc-4.4.12-2.noarch"));
+    CPPUNIT_ASSERT(has(excluded, "bash-4.2.46-21.x86_64"));
+    // a demodularized name excludes nothing by the name
+    CPPUNIT_ASSERT(has(included, "glibc-debuginfo-common-2.25-4.x86_64"));
+    CPPUNIT_ASSERT(!has(excluded, "glibc-debuginfo-common-2.17-157.x86_64"));
+    // malformed artifacts name nothing
+    CPPUNIT_ASSERT(!has(excluded, "basesystem-11-3.noarch"));
+    CPPUNIT_ASSERT(!has(excluded, "filesystem-3.2-21.x86_64"));
+    // source artifacts do not exclude binary packages
+    CPPUNIT_ASSERT(!has(excluded, "grub2-2.02-0.40.x86_64"));
+}
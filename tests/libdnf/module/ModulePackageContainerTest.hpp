@@ -14,6 +14,12 @@ class ModulePackageContainerTest : public CppUnit::TestCase
         CPPUNIT_TEST(testDisableEnableModules);
         CPPUNIT_TEST(testRollback);
         CPPUNIT_TEST(testInstallRemoveProfile);
+        CPPUNIT_TEST(testQuery);
+        CPPUNIT_TEST(testResolveRepeated);
+        CPPUNIT_TEST(testResolveParallelFallback);
+        CPPUNIT_TEST(testSaveChangedOnly);
+        CPPUNIT_TEST(testSaveFailedRename);
+        CPPUNIT_TEST(testModuleExcludesMatchQueries);
     CPPUNIT_TEST_SUITE_END();
 
 public:
@@ -24,6 +30,12 @@ public:
     void testDisableEnableModules();
     void testRollback();
     void testInstallRemoveProfile();
+    void testQuery();
+    void testResolveRepeated();
+    void testResolveParallelFallback();
+    void testSaveChangedOnly();
+    void testSaveFailedRename();
+    void testModuleExcludesMatchQueries();
 
 private:
     DnfContext *context;
@@ -0,0 +1,186 @@
+#include "ModuleMetadataTest.hpp"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ModuleMetadataTest);
+
+#include "libdnf/hy-iutil-private.hpp"
+#include "libdnf/module/ModulePackage-private.hpp"
+#include "libdnf/utils/File.hpp"
+
+extern "C" {
+#   include <solv/solv_xfopen.h>
+}
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#define UNITTEST_DIR "/tmp/libdnfmdXXXXXX"
+
+// several modular repos, parsed by more than one thread
+static constexpr int REPOS = 6;
+static constexpr int MODULES = 40;
+static constexpr int STREAMS = 4;
+
+static void
+writeModulesYaml(const std::string & path, int repo)
+{
+    std::ofstream out(path);
+    for (int module = 0; module < MODULES; ++module) {
+        for (int stream = 0; stream < STREAMS; ++stream) {
+            out << "---\n"
+                << "document: modulemd\n"
+                << "version: 2\n"
+                << "data:\n"
+                << "  name: module" << module << "\n"
+                << "  stream: stream" << stream << "\n"
+                << "  version: " << repo + 1 << "\n"
+                << "  context: c0ffee42\n"
+                << "  arch: x86_64\n"
+                << "  summary: Module " << module << "\n"
+                << "  description: Stream " << stream << " of module " << module << "\n"
+                << "  license:\n"
+                << "    module: [MIT]\n"
+                << "  profiles:\n"
+                << "    default:\n"
+                << "      rpms: [pkg" << module << "]\n"
+                << "  artifacts:\n"
+                << "    rpms:\n";
+            for (int rpm = 0; rpm < 20; ++rpm) {
+                out << "    - pkg" << module << "-sub" << rpm << "-0:" << stream << ".0-1.module_"
+                    << repo << ".x86_64\n";
+            }
+            out << "...\n";
+        }
+    }
+}
+
+static unsigned int
+countStreams(ModulemdModuleIndex * index)
+{
+    unsigned int count = 0;
+    char ** names = modulemd_module_index_get_module_names_as_strv(index);
+    for (char ** name = names; name && *name; ++name) {
+        auto module = modulemd_module_index_get_module(index, *name);
+        count += modulemd_module_get_all_streams(module)->len;
+    }
+    g_strfreev(names);
+    return count;
+}
+
+void ModuleMetadataTest::setUp()
+{
+    tmpdir = g_strdup(UNITTEST_DIR);
+    CPPUNIT_ASSERT(mkdtemp(tmpdir));
+    for (int repo = 0; repo < REPOS; ++repo) {
+        paths.push_back(std::string(tmpdir) + "/repo" + std::to_string(repo) + "-modules.yaml");
+        writeModulesYaml(paths.back(), repo);
+    }
+}
+
+void ModuleMetadataTest::tearDown()
+{
+    g_autoptr(GError) error = nullptr;
+    dnf_remove_recursive_v2(tmpdir, &error);
+    g_assert_no_error(error);
+    g_free(tmpdir);
+    paths.clear();
+}
+
+void ModuleMetadataTest::testParseFilesParallel()
+{
+    std::vector<libdnf::ModuleMetadata::IndexPtr> serial;
+    for (const auto & path : paths)
+        serial.emplace_back(libdnf::ModuleMetadata::parseFile(path), g_object_unref);
+    auto parallel = libdnf::ModuleMetadata::parseFiles(paths);
+
+    CPPUNIT_ASSERT_EQUAL(serial.size(), parallel.size());
+    for (std::size_t i = 0; i < serial.size(); ++i) {
+        CPPUNIT_ASSERT_EQUAL(static_cast<unsigned int>(MODULES * STREAMS), countStreams(serial[i].get()));
+        CPPUNIT_ASSERT_EQUAL(countStreams(serial[i].get()), countStreams(parallel[i].get()));
+        // the result keeps the order of the paths
+        auto module = modulemd_module_index_get_module(parallel[i].get(), "module0");
+        auto stream = static_cast<ModulemdModuleStream *>(
+            g_ptr_array_index(modulemd_module_get_all_streams(module), 0));
+        CPPUNIT_ASSERT_EQUAL(static_cast<guint64>(i + 1), modulemd_module_stream_get_version(stream));
+        // both parses give the same documents
+        g_autofree gchar * serialYaml = modulemd_module_index_dump_to_string(serial[i].get(), nullptr);
+        g_autofree gchar * parallelYaml = modulemd_module_index_dump_to_string(parallel[i].get(), nullptr);
+        CPPUNIT_ASSERT(serialYaml && parallelYaml);
+        CPPUNIT_ASSERT_EQUAL(std::string(serialYaml), std::string(parallelYaml));
+    }
+}
+
+void ModuleMetadataTest::testParseFilesMissing()
+{
+    auto withMissing = paths;
+    withMissing.insert(withMissing.begin() + 1, std::string(tmpdir) + "/missing-modules.yaml");
+    CPPUNIT_ASSERT_THROW(libdnf::ModuleMetadata::parseFiles(withMissing), libdnf::File::OpenError);
+}
+
+void ModuleMetadataTest::testParseFileCompressedShared()
+{
+    // a compressed modules.yaml of a repo with its own defaults
+    const char * yaml =
+        "---\n"
+        "document: modulemd\n"
+        "version: 2\n"
+        "data:\n"
+        "  name: shared\n"
+        "  stream: one\n"
+        "  version: 1\n"
+        "  context: c0ffee42\n"
+        "  arch: x86_64\n"
+        "  summary: Shared one\n"
+        "  description: Stream one\n"
+        "  license:\n"
+        "    module: [MIT]\n"
+        "...\n"
+        "---\n"
+        "document: modulemd\n"
+        "version: 2\n"
+        "data:\n"
+        "  name: shared\n"
+        "  stream: two\n"
+        "  version: 1\n"
+        "  context: c0ffee42\n"
+        "  arch: x86_64\n"
+        "  summary: Shared two\n"
+        "  description: Stream two\n"
+        "  license:\n"
+        "    module: [MIT]\n"
+        "...\n"
+        "---\n"
+        "document: modulemd-defaults\n"
+        "version: 1\n"
+        "data:\n"
+        "  module: shared\n"
+        "  stream: two\n"
+        "...\n";
+    auto path = std::string(tmpdir) + "/shared-modules.yaml.gz";
+    FILE * out = solv_xfopen(path.c_str(), "w");
+    CPPUNIT_ASSERT(out);
+    CPPUNIT_ASSERT_EQUAL(std::size_t(1), fwrite(yaml, strlen(yaml), 1, out));
+    CPPUNIT_ASSERT_EQUAL(0, fclose(out));
+
+    // the file is parsed once, the same index provides the module packages and the defaults
+    libdnf::ModuleMetadata::IndexPtr index(libdnf::ModuleMetadata::parseFile(path), g_object_unref);
+    CPPUNIT_ASSERT_EQUAL(2u, countStreams(index.get()));
+
+    libdnf::ModuleMetadata packagesMetadata;
+    packagesMetadata.addMetadataFromIndex(index.get(), 0);
+    packagesMetadata.resolveAddedMetadata();
+    std::vector<std::string> streams;
+    for (const auto & data : packagesMetadata.getAllModuleStreams())
+        streams.push_back(data->name + ":" + data->stream);
+    std::sort(streams.begin(), streams.end());
+    CPPUNIT_ASSERT((streams == std::vector<std::string>{"shared:one", "shared:two"}));
+
+    libdnf::ModuleMetadata defaultsMetadata;
+    defaultsMetadata.addMetadataFromIndex(index.get(), 0);
+    defaultsMetadata.resolveAddedMetadata();
+    CPPUNIT_ASSERT_EQUAL(std::string("two"), defaultsMetadata.getDefaultStreams()["shared"]);
+
+    // resolving does not modify the shared index
+    CPPUNIT_ASSERT_EQUAL(2u, countStreams(index.get()));
+    CPPUNIT_ASSERT(modulemd_module_get_defaults(modulemd_module_index_get_module(index.get(), "shared")));
+}
@@ -0,0 +1,33 @@
+#ifndef LIBDNF_MODULEMETADATATEST_HPP
+#define LIBDNF_MODULEMETADATATEST_HPP
+
+#include <cppunit/TestCase.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include "libdnf/module/modulemd/ModuleMetadata.hpp"
+
+#include <string>
+#include <vector>
+
+class ModuleMetadataTest : public CppUnit::TestCase
+{
+    CPPUNIT_TEST_SUITE(ModuleMetadataTest);
+    CPPUNIT_TEST(testParseFilesParallel);
+    CPPUNIT_TEST(testParseFilesMissing);
+    CPPUNIT_TEST(testParseFileCompressedShared);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void setUp() override;
+    void tearDown() override;
+
+    void testParseFilesParallel();
+    void testParseFilesMissing();
+    void testParseFileCompressedShared();
+
+private:
+    char * tmpdir{nullptr};
+    std::vector<std::string> paths;
+};
+
+#endif /* LIBDNF_MODULEMETADATATEST_HPP */
@@ -0,0 +1,121 @@
+#ifndef LIBDNF_PARSERREFERENCE_HPP
+#define LIBDNF_PARSERREFERENCE_HPP
+
+#include "libdnf/hy-types.h"
+#include "libdnf/nevra.hpp"
+#include "libdnf/nsvcap.hpp"
+#include "libdnf/utils/regex/regex.hpp"
+#include "libdnf/utils/utils.hpp"
+
+#include <cstdlib>
+#include <string>
+
+// The parsers used to be regular expressions, they are kept here as the reference
+// for ParserTest and the parser benchmark.
+
+#define PKG_NAME "([^:(/=<> ]+)"
+#define PKG_EPOCH "(([0-9]+):)?"
+#define PKG_VERSION "([^-:(/=<> ]+)"
+#define PKG_RELEASE PKG_VERSION
+#define PKG_ARCH "([^-:.(/=<> ]+)"
+
+static const Regex NEVRA_FORM_REGEX[]{
+    Regex("^" PKG_NAME "-" PKG_EPOCH PKG_VERSION "-" PKG_RELEASE "\\." PKG_ARCH "$", REG_EXTENDED),
+    Regex("^" PKG_NAME "-" PKG_EPOCH PKG_VERSION "-" PKG_RELEASE          "()"  "$", REG_EXTENDED),
+    Regex("^" PKG_NAME "-" PKG_EPOCH PKG_VERSION        "()"              "()"  "$", REG_EXTENDED),
+    Regex("^" PKG_NAME      "()()"      "()"            "()"     "\\." PKG_ARCH "$", REG_EXTENDED),
+    Regex("^" PKG_NAME      "()()"      "()"            "()"              "()"  "$", REG_EXTENDED)
+};
+
+#define GLOB "][*?!"
+#define MODULE_NAME "([" GLOB ASCII_LETTERS DIGITS "+._-" "]+)"
+#define MODULE_STREAM MODULE_NAME
+#define MODULE_VERSION "([" GLOB DIGITS "-]+)"
+#define MODULE_CONTEXT MODULE_NAME
+#define MODULE_ARCH MODULE_NAME
+#define MODULE_PROFILE MODULE_NAME
+
+static const Regex NSVCAP_FORM_REGEX[]{
+    Regex("^" MODULE_NAME ":" MODULE_STREAM ":" MODULE_VERSION ":" MODULE_CONTEXT "::?" MODULE_ARCH "\\/"  MODULE_PROFILE "$", REG_EXTENDED),
+    Regex("^" MODULE_NAME ":" MODULE_STREAM ":" MODULE_VERSION ":" MODULE_CONTEXT "::?" MODULE_ARCH "\\/?" "()"           "$", REG_EXTENDED),
+    Regex("^" MODULE_NAME ":" MODULE_STREAM ":" MODULE_VERSION     "()"           "::"  MODULE_ARCH "\\/"  MODULE_PROFILE "$", REG_EXTENDED),
+    Regex("^" MODULE_NAME ":" MODULE_STREAM ":" MODULE_VERSION     "()"           "::"  MODULE_ARCH "\\/?" "()"           "$", REG_EXTENDED),
+    Regex("^" MODULE_NAME ":" MODULE_STREAM     "()"               "()"           "::"  MODULE_ARCH "\\/"  MODULE_PROFILE "$", REG_EXTENDED),
+    Regex("^" MODULE_NAME ":" MODULE_STREAM     "()"               "()"           "::"  MODULE_ARCH "\\/?" "()"           "$", REG_EXTENDED),
+    Regex("^" MODULE_NAME ":" MODULE_STREAM ":" MODULE_VERSION ":" MODULE_CONTEXT       "()"        "\\/"  MODULE_PROFILE "$", REG_EXTENDED),
+    Regex("^" MODULE_NAME ":" MODULE_STREAM ":" MODULE_VERSION     "()"                 "()"        "\\/"  MODULE_PROFILE "$", REG_EXTENDED),
+    Regex("^" MODULE_NAME ":" MODULE_STREAM ":" MODULE_VERSION ":" MODULE_CONTEXT       "()"        "\\/?" "()"           "$", REG_EXTENDED),
+    Regex("^" MODULE_NAME ":" MODULE_STREAM ":" MODULE_VERSION     "()"                 "()"        "\\/?" "()"           "$", REG_EXTENDED),
+    Regex("^" MODULE_NAME ":" MODULE_STREAM     "()"               "()"                 "()"        "\\/"  MODULE_PROFILE "$", REG_EXTENDED),
+    Regex("^" MODULE_NAME ":" MODULE_STREAM     "()"               "()"                 "()"        "\\/?" "()"           "$", REG_EXTENDED),
+    Regex("^" MODULE_NAME     "()"              "()"               "()"           "::"  MODULE_ARCH "\\/"  MODULE_PROFILE "$", REG_EXTENDED),
+    Regex("^" MODULE_NAME     "()"              "()"               "()"           "::"  MODULE_ARCH "\\/?" "()"           "$", REG_EXTENDED),
+    Regex("^" MODULE_NAME     "()"              "()"               "()"                 "()"        "\\/"  MODULE_PROFILE "$", REG_EXTENDED),
+    Regex("^" MODULE_NAME     "()"              "()"               "()"                 "()"        "\\/?" "()"           "$", REG_EXTENDED)
+};
+
+static const Regex RELDEP_REGEX("^(\\S*)\\s*(<=|>=|<|>|=|==)?\\s*(\\S*)$", REG_EXTENDED);
+
+inline bool
+referenceNevra(const char * str, HyForm form, libdnf::Nevra & nevra)
+{
+    auto result = NEVRA_FORM_REGEX[form - 1].match(str, false, 7);
+    if (!result.isMatched() || result.getMatchedLen(1) == 0)
+        return false;
+    nevra.setName(result.getMatchedString(1));
+    if (result.getMatchedLen(3) > 0)
+        nevra.setEpoch(atoi(result.getMatchedString(3).c_str()));
+    else
+        nevra.setEpoch(libdnf::Nevra::EPOCH_NOT_SET);
+    nevra.setVersion(result.getMatchedString(4));
+    nevra.setRelease(result.getMatchedString(5));
+    nevra.setArch(result.getMatchedString(6));
+    return true;
+}
+
+inline bool
+referenceNsvcap(const char * str, HyModuleForm form, libdnf::Nsvcap & nsvcap)
+{
+    auto result = NSVCAP_FORM_REGEX[form - 1].match(str, false, 7);
+    if (!result.isMatched() || result.getMatchedLen(1) == 0)
+        return false;
+    nsvcap.setName(result.getMatchedString(1));
+    nsvcap.setStream(result.getMatchedString(2));
+    nsvcap.setVersion(result.getMatchedString(3));
+    nsvcap.setContext(result.getMatchedString(4));
+    nsvcap.setArch(result.getMatchedString(5));
+    nsvcap.setProfile(result.getMatchedString(6));
+    return true;
+}
+
+struct Reldep {
+    bool parsed;
+    std::string name;
+    std::string evr;
+    int cmpType;
+};
+
+inline Reldep
+referenceReldep(const char * str)
+{
+    auto result = RELDEP_REGEX.match(str, false, 4);
+    if (!result.isMatched() || result.getMatchedLen(1) == 0)
+        return {false, "", "", 0};
+    auto name = result.getMatchedString(1);
+    auto cmpType = result.getMatchedString(2);
+    auto evr = result.getMatchedString(3);
+    if (cmpType.empty())
+        return evr.empty() ? Reldep{true, name, "", 0} : Reldep{true, str, "", 0};
+    if (evr.empty())
+        return {false, "", "", 0};
+    int flags = 0;
+    if (cmpType.find('<') != std::string::npos)
+        flags |= HY_LT;
+    if (cmpType.find('>') != std::string::npos)
+        flags |= HY_GT;
+    if (cmpType.find('=') != std::string::npos)
+        flags |= HY_EQ;
+    return {true, name, evr, flags};
+}
+
+#endif /* LIBDNF_PARSERREFERENCE_HPP */
@@ -0,0 +1,99 @@
+#include "ParserTest.hpp"
+
+CPPUNIT_TEST_SUITE_REGISTRATION(ParserTest);
+
+#include "ParserReference.hpp"
+
+#include "libdnf/repo/DependencySplitter.hpp"
+
+#include <random>
+#include <string>
+#include <vector>
+
+// real-world shaped strings and random strings of the tokens that matter to the parsers
+static std::vector<std::string>
+buildParserInputs()
+{
+    std::vector<std::string> inputs{
+        "", "-", ".", ":", "/",
+        "kernel-core-5.14.0-70.13.1.el9_0.x86_64", "python3-libdnf-1:0.67.0-3.fc36.noarch",
+        "foo-bar-0:1-2.src", "foo-:1-2.noarch", "foo-a:1-2.noarch", "foo.x86_64", "foo",
+        "nodejs:12:820190612090123:abcdef01:x86_64/default", "nodejs:12::x86_64/", "nodejs::x86_64",
+        "nodejs:1*:8[0-9]*/", "glibc >= 2.34", "glibc>=2.34", "a == 1", "a ==1", "a <=",
+        "hello world.jpg", " foo", "foo ", "libfoo.so.1()(64bit)", "pkgconfig(gio-2.0) = 2.70",
+    };
+    static const char * const TOKENS[]{
+        "a", "B", "1", "42", "-", ":", "::", ".", "/", "(", ")", "=", "==", "<", "<=", ">", ">=",
+        " ", "\t", "*", "?", "!", "[", "]", "+", "_", "x86_64", "noarch"
+    };
+    std::mt19937 random(2022);
+    std::uniform_int_distribution<std::size_t> length(1, 14);
+    std::uniform_int_distribution<std::size_t> token(0, sizeof(TOKENS) / sizeof(*TOKENS) - 1);
+    for (int i = 0; i < 5000; ++i) {
+        std::string input;
+        for (auto tokens = length(random); tokens > 0; --tokens)
+            input += TOKENS[token(random)];
+        inputs.push_back(std::move(input));
+    }
+    return inputs;
+}
+
+// the inputs are shared by all tests, they are built on the first use
+static const std::vector<std::string> &
+parserInputs()
+{
+    static const std::vector<std::string> inputs = buildParserInputs();
+    return inputs;
+}
+
+void ParserTest::testNevra()
+{
+    for (const auto & input : parserInputs()) {
+        for (auto form : {HY_FORM_NEVRA, HY_FORM_NEVR, HY_FORM_NEV, HY_FORM_NA, HY_FORM_NAME}) {
+            libdnf::Nevra expected, parsed;
+            auto matched = referenceNevra(input.c_str(), form, expected);
+            CPPUNIT_ASSERT_EQUAL_MESSAGE(input, matched, parsed.parse(input.c_str(), form));
+            if (!matched)
+                continue;
+            CPPUNIT_ASSERT_EQUAL_MESSAGE(input, expected.getName(), parsed.getName());
+            CPPUNIT_ASSERT_EQUAL_MESSAGE(input, expected.getEpoch(), parsed.getEpoch());
+            CPPUNIT_ASSERT_EQUAL_MESSAGE(input, expected.getVersion(), parsed.getVersion());
+            CPPUNIT_ASSERT_EQUAL_MESSAGE(input, expected.getRelease(), parsed.getRelease());
+            CPPUNIT_ASSERT_EQUAL_MESSAGE(input, expected.getArch(), parsed.getArch());
+        }
+    }
+}
+
+void ParserTest::testNsvcap()
+{
+    for (const auto & input : parserInputs()) {
+        for (int form = HY_MODULE_FORM_NSVCAP; form <= HY_MODULE_FORM_N; ++form) {
+            libdnf::Nsvcap expected, parsed;
+            auto moduleForm = static_cast<HyModuleForm>(form);
+            auto matched = referenceNsvcap(input.c_str(), moduleForm, expected);
+            CPPUNIT_ASSERT_EQUAL_MESSAGE(input, matched, parsed.parse(input.c_str(), moduleForm));
+            if (!matched)
+                continue;
+            CPPUNIT_ASSERT_EQUAL_MESSAGE(input, expected.getName(), parsed.getName());
+            CPPUNIT_ASSERT_EQUAL_MESSAGE(input, expected.getStream(), parsed.getStream());
+            CPPUNIT_ASSERT_EQUAL_MESSAGE(input, expected.getVersion(), parsed.getVersion());
+            CPPUNIT_ASSERT_EQUAL_MESSAGE(input, expected.getContext(), parsed.getContext());
+            CPPUNIT_ASSERT_EQUAL_MESSAGE(input, expected.getArch(), parsed.getArch());
+            CPPUNIT_ASSERT_EQUAL_MESSAGE(input, expected.getProfile(), parsed.getProfile());
+        }
+    }
+}
+
+void ParserTest::testReldep()
+{
+    for (const auto & input : parserInputs()) {
+        auto expected = referenceReldep(input.c_str());
+        libdnf::DependencySplitter parsed;
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(input, expected.parsed, parsed.parse(input.c_str()));
+        if (!expected.parsed)
+            continue;
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(input, expected.name, parsed.getName());
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(input, expected.evr, parsed.getEVR());
+        CPPUNIT_ASSERT_EQUAL_MESSAGE(input, expected.cmpType, parsed.getCmpType());
+    }
+}
@@ -0,0 +1,21 @@
+#ifndef LIBDNF_PARSERTEST_HPP
+#define LIBDNF_PARSERTEST_HPP
+
+#include <cppunit/TestCase.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+class ParserTest : public CppUnit::TestCase
+{
+    CPPUNIT_TEST_SUITE(ParserTest);
+    CPPUNIT_TEST(testNevra);
+    CPPUNIT_TEST(testNsvcap);
+    CPPUNIT_TEST(testReldep);
+    CPPUNIT_TEST_SUITE_END();
+
+public:
+    void testNevra();
+    void testNsvcap();
+    void testReldep();
+};
+
+#endif /* LIBDNF_PARSERTEST_HPP */